@@ -0,0 +1,133 @@
+#include <iostream>
+
+#include "up_exception.hpp"
+#include "up_inet.hpp"
+#include "up_loopback.hpp"
+#include "up_out.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    /* The engine transfers nothing. It is used to measure the overhead of
+     * the stream itself (i.e. without any syscall). The class is final, so
+     * that basic_stream can call its operations directly. */
+    class null_engine final : public up::stream::engine
+    {
+    public: // --- scope ---
+        using self = null_engine;
+    public: // --- life ---
+        explicit null_engine() = default;
+        null_engine(const self& rhs) = delete;
+        null_engine(self&& rhs) noexcept = default;
+        ~null_engine() noexcept override = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        auto try_shutdown() const -> status override { return 0; }
+        void hard_close() const override { }
+        auto try_read_some(up::chunk::into chunk) const -> status override { return chunk.size(); }
+        auto try_write_some(up::chunk::from chunk) const -> status override { return chunk.size(); }
+        auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status override { return chunks.total(); }
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status override { return chunks.total(); }
+        auto downgrade() -> std::unique_ptr<up::stream::engine> override
+        {
+            throw up::make_exception("null-engine-bad-downgrade-error");
+        }
+        auto get_underlying_engine() const -> const engine* override { return this; }
+        auto get_native_handle() const -> up::stream::native_handle override
+        {
+            return up::stream::native_handle::invalid;
+        }
+    };
+
+    template <typename Function>
+    void measure(const char* name, std::size_t iterations, Function&& function)
+    {
+        auto start = up::steady_clock::now();
+        for (std::size_t i = 0; i != iterations; ++i) {
+            function();
+            // prevents that the compiler folds the whole loop
+            asm volatile("" : : : "memory");
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(up::steady_clock::now() - start);
+        up::out(std::cout, name, ": ", elapsed.count() / double(iterations), " ns/call\n");
+    }
+
+    void bench_null(std::size_t iterations)
+    {
+        auto patience = up::stream::infinite_patience();
+        char buffer[64] = { };
+        std::size_t total = 0;
+        auto stream = up::stream(std::make_unique<null_engine>());
+        measure("stream/null/write_some", iterations, [&] {
+                total += stream.write_some({buffer, sizeof(buffer)}, patience);
+            });
+        stream.set_counters(std::make_shared<up::stream::counters>());
+        measure("stream/null/write_some+counters", iterations, [&] {
+                total += stream.write_some({buffer, sizeof(buffer)}, patience);
+            });
+        auto basic = up::basic_stream<null_engine>();
+        measure("basic_stream/null/write_some", iterations, [&] {
+                total += basic.write_some({buffer, sizeof(buffer)}, patience);
+            });
+        up::out(std::cout, "(", total, " bytes)\n");
+    }
+
+    // one byte ping-pong through in-process rings (no syscalls)
+    void bench_loopback(std::size_t iterations)
+    {
+        auto patience = up::stream::infinite_patience();
+        auto streams = up::loopback::make_streams();
+        char c = 'x';
+        measure("stream/loopback/ping-pong", iterations, [&] {
+                streams.first.write_some({&c, 1}, patience);
+                streams.second.read_some({&c, 1}, patience);
+            });
+    }
+
+    // one byte ping-pong over loopback (dominated by the syscalls)
+    void bench_tcp(std::size_t iterations)
+    {
+        using o = up::tcp::socket::option;
+        auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47619));
+        auto listener = up::tcp::socket(endpoint, {o::reuseaddr}).listen(2);
+        auto patience = up::stream::deadline_patience(60s);
+        char c = 'x';
+        {
+            auto client = up::tcp::socket(up::ip::version::v4).connect(endpoint, patience);
+            auto server = listener.accept(patience);
+            measure("stream/tcp/ping-pong", iterations, [&] {
+                    client.write_some({&c, 1}, patience);
+                    server.read_some({&c, 1}, patience);
+                });
+        }
+        {
+            auto client = up::tcp::socket(up::ip::version::v4).connect_basic(endpoint, patience);
+            auto server = listener.accept_basic(patience);
+            measure("basic_stream/tcp/ping-pong", iterations, [&] {
+                    client.write_some({&c, 1}, patience);
+                    server.read_some({&c, 1}, patience);
+                });
+        }
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+
+        std::ios::sync_with_stdio(false);
+
+        std::size_t iterations = argc == 2 ? std::stoul(argv[1]) : 1000000;
+        bench_null(iterations * 100);
+        bench_loopback(iterations * 10);
+        bench_tcp(iterations);
+
+    } catch (...) {
+        up::log_current_exception(std::cerr, "ERROR: ");
+        return EXIT_FAILURE;
+    }
+}
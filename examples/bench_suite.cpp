@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+
+#include "up_buffered_reader.hpp"
+#include "up_defer.hpp"
+#include "up_exception.hpp"
+#include "up_inet.hpp"
+#include "up_loopback.hpp"
+#include "up_out.hpp"
+#include "up_shm.hpp"
+#include "up_tls.hpp"
+
+/*
+ * Benchmark suite for streams: each workload runs over each transport, and
+ * the client reports the throughput, the latency percentiles of the
+ * messages and the number of calls per message. The server side runs in a
+ * separate thread.
+ *
+ * Usage: bench_suite [messages [pem]]
+ *
+ * The TLS transports are only used if a PEM file with the private key and
+ * the certificate of the server is given.
+ */
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    using operation = up::stream::patience::operation;
+    using streams = std::pair<up::stream, up::stream>;
+
+    /* Wrapper for the lowest engine of the client, that counts the transfers
+     * (i.e. the syscalls for TCP) and the would blocks (i.e. the subsequent
+     * waits in the patience). The engine is wrapped before the TLS upgrade,
+     * so that the counters also include the transfers of the TLS records. */
+    class counting_engine final : public up::stream::engine
+    {
+    public: // --- scope ---
+        using self = counting_engine;
+    private: // --- state ---
+        std::unique_ptr<up::stream::engine> _engine;
+        std::shared_ptr<up::stream::counters> _counters;
+    public: // --- life ---
+        explicit counting_engine(std::unique_ptr<up::stream::engine> engine, std::shared_ptr<up::stream::counters> counters)
+            : _engine(std::move(engine)), _counters(std::move(counters))
+        { }
+        counting_engine(const self& rhs) = delete;
+        counting_engine(self&& rhs) noexcept = delete;
+        ~counting_engine() noexcept override = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto try_shutdown() const -> status override
+        {
+            return _record(operation::write, _engine->try_shutdown());
+        }
+        void hard_close() const override { _engine->hard_close(); }
+        auto try_read_some(up::chunk::into chunk) const -> status override
+        {
+            return _record(operation::read, _engine->try_read_some(chunk));
+        }
+        auto try_write_some(up::chunk::from chunk) const -> status override
+        {
+            return _record(operation::write, _engine->try_write_some(chunk));
+        }
+        auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status override
+        {
+            return _record(operation::read, _engine->try_read_some_bulk(chunks));
+        }
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status override
+        {
+            return _record(operation::write, _engine->try_write_some_bulk(chunks));
+        }
+        auto downgrade() -> std::unique_ptr<up::stream::engine> override
+        {
+            throw up::make_exception("counting-engine-bad-downgrade-error");
+        }
+        auto get_underlying_engine() const -> const engine* override
+        {
+            return _engine->get_underlying_engine();
+        }
+        auto get_native_handle() const -> up::stream::native_handle override
+        {
+            return _engine->get_native_handle();
+        }
+    private:
+        auto _record(operation op, status result) const -> status
+        {
+            _counters->record(op, result);
+            return result;
+        }
+    };
+
+    auto total_calls(const up::stream::counters& counters) -> uint64_t
+    {
+        return counters.calls(operation::read) + counters.calls(operation::write)
+            + counters.would_block(operation::read) + counters.would_block(operation::write);
+    }
+
+
+    struct workload final
+    {
+        enum class type : uint8_t { echo, request_response, bulk, };
+        const char* name;
+        type kind;
+        std::size_t request; // size of each message from the client
+        std::size_t response; // size of each response (unused for echo and bulk)
+        std::size_t messages;
+    };
+
+    /* Transports create a connected pair of client and server. The counters
+     * have to be attached to the lowest engine of the client. */
+    struct transport final
+    {
+        const char* name;
+        std::function<streams(const std::shared_ptr<up::stream::counters>& counters)> connect;
+    };
+
+    auto counted(std::shared_ptr<up::stream::counters> counters)
+    {
+        return [counters=std::move(counters)](std::unique_ptr<up::stream::engine> engine) -> std::unique_ptr<up::stream::engine> {
+            return std::make_unique<counting_engine>(std::move(engine), counters);
+        };
+    }
+
+    auto tcp_transport() -> transport
+    {
+        return {"tcp", [](const std::shared_ptr<up::stream::counters>& counters) {
+                using o = up::tcp::socket::option;
+                auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47629));
+                auto listener = up::tcp::socket(endpoint, {o::reuseaddr}).listen(1);
+                auto patience = up::stream::deadline_patience(10s);
+                auto client = up::tcp::socket(up::ip::version::v4).connect(endpoint, patience);
+                auto server = listener.accept(patience);
+                client.upgrade(counted(counters));
+                return streams(std::move(client), std::move(server));
+            }};
+    }
+
+    auto loopback_transport() -> transport
+    {
+        return {"loopback", [](const std::shared_ptr<up::stream::counters>& counters) {
+                auto&& engines = up::loopback::make_engines(1 << 18);
+                auto client = up::stream(std::make_unique<counting_engine>(std::move(engines.first), counters));
+                return streams(std::move(client), up::stream(std::move(engines.second)));
+            }};
+    }
+
+    auto shm_transport() -> transport
+    {
+        return {"shm", [](const std::shared_ptr<up::stream::counters>& counters) {
+                // both sides in this process, but with separate mappings
+                auto first = up::shm::channel(1 << 18);
+                std::vector<int> descriptors;
+                for (int fd : first.descriptors()) {
+                    descriptors.push_back(::fcntl(fd, F_DUPFD_CLOEXEC, 0));
+                }
+                auto second = up::shm::channel::adopt(descriptors);
+                auto client = up::stream(std::make_unique<counting_engine>(
+                        std::move(first).make_engine(up::shm::side::first), counters));
+                return streams(std::move(client), std::move(second).make_stream(up::shm::side::second));
+            }};
+    }
+
+    // performs the handshake on top of the given transport
+    auto tls_transport(const char* name, transport base, const up::shared_string& pem) -> transport
+    {
+        auto server_context = std::make_shared<up::tls::server_context>(up::tls::identity(pem, pem),
+            up::tls::server_context::options());
+        auto client_context = std::make_shared<up::tls::client_context>(up::tls::authority(), up::nullopt,
+            up::tls::client_context::options());
+        return {name, [base=std::move(base), server_context, client_context](const std::shared_ptr<up::stream::counters>& counters) {
+                auto&& pair = base.connect(counters);
+                auto patience = up::stream::deadline_patience(10s);
+                std::exception_ptr error;
+                std::thread thread([&]() noexcept {
+                        try {
+                            auto patience = up::stream::deadline_patience(10s);
+                            pair.second.upgrade([&](std::unique_ptr<up::stream::engine> engine) {
+                                    return server_context->upgrade(std::move(engine), patience,
+                                        up::tls::server_context::ignore_hostname());
+                                });
+                        } catch (...) {
+                            error = std::current_exception();
+                        }
+                    });
+                UP_DEFER {
+                    if (thread.joinable()) {
+                        thread.join();
+                    }
+                };
+                pair.first.upgrade([&](std::unique_ptr<up::stream::engine> engine) {
+                        // the certificate is not verified (the benchmark uses any given identity)
+                        return client_context->upgrade(std::move(engine), patience, up::nullopt,
+                            [](bool, std::size_t, const up::tls::certificate&) noexcept { return true; });
+                    });
+                thread.join();
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                return std::move(pair);
+            }};
+    }
+
+
+    void serve(const workload& load, const up::stream& stream)
+    {
+        auto patience = up::stream::deadline_patience(60s);
+        auto reader = up::buffered_reader(1 << 16, 1 << 20);
+        auto response = std::string(load.response, 'r');
+        for (std::size_t i = 0; i != load.messages; ++i) {
+            auto message = reader.read_exact(stream, load.request, patience);
+            if (!message) {
+                throw up::make_exception("bench-unexpected-end-of-stream").with(load.name, i);
+            }
+            switch (load.kind) {
+            case workload::type::echo:
+                stream.write_all(up::chunk::from(*message), patience);
+                break;
+            case workload::type::request_response:
+                stream.write_all(up::chunk::from(response), patience);
+                break;
+            case workload::type::bulk:
+                break;
+            }
+        }
+        if (load.kind == workload::type::bulk) {
+            // acknowledges the whole transfer
+            stream.write_all({"a", 1}, patience);
+        }
+    }
+
+    auto percentile(const std::vector<up::duration>& sorted, double fraction) -> double
+    {
+        auto index = std::min(sorted.size() - 1, std::size_t(double(sorted.size()) * fraction));
+        return std::chrono::duration<double, std::micro>(sorted[index]).count();
+    }
+
+    void run(const workload& load, const transport& transport)
+    {
+        auto counters = std::make_shared<up::stream::counters>();
+        auto&& pair = transport.connect(counters);
+        auto&& client = pair.first;
+        auto calls = total_calls(*counters); // e.g. the TLS handshake
+        std::exception_ptr error;
+        std::thread thread([&]() noexcept {
+                try {
+                    serve(load, pair.second);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            });
+        UP_DEFER { thread.join(); };
+        auto patience = up::stream::deadline_patience(60s);
+        auto reader = up::buffered_reader(1 << 16, 1 << 20);
+        auto request = std::string(load.request, 'q');
+        auto expected = load.kind == workload::type::echo ? load.request : load.response;
+        std::vector<up::duration> latencies;
+        latencies.reserve(load.messages);
+        auto start = up::steady_clock::now();
+        for (std::size_t i = 0; i != load.messages; ++i) {
+            auto begin = up::steady_clock::now();
+            client.write_all(up::chunk::from(request), patience);
+            if (load.kind != workload::type::bulk && !reader.read_exact(client, expected, patience)) {
+                throw up::make_exception("bench-unexpected-end-of-stream").with(load.name, i);
+            }
+            latencies.push_back(up::steady_clock::now() - begin);
+        }
+        if (load.kind == workload::type::bulk && !reader.read_exact(client, 1, patience)) {
+            throw up::make_exception("bench-missing-acknowledgement").with(load.name);
+        }
+        auto elapsed = std::chrono::duration<double>(up::steady_clock::now() - start).count();
+        calls = total_calls(*counters) - calls;
+        std::sort(latencies.begin(), latencies.end());
+        auto messages = double(load.messages);
+        auto bytes = messages * double(load.request + (load.kind == workload::type::bulk ? 0 : expected));
+        up::out(std::cout, load.name, "/", transport.name, ": ",
+            messages / elapsed, " msg/s, ",
+            bytes / elapsed / 1e6, " MB/s, p50 ",
+            percentile(latencies, 0.5), " us, p99 ",
+            percentile(latencies, 0.99), " us, p999 ",
+            percentile(latencies, 0.999), " us, ",
+            double(calls) / messages, " calls/msg\n");
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+
+        std::ios::sync_with_stdio(false);
+
+        std::size_t messages = argc >= 2 ? std::stoul(argv[1]) : 100000;
+        if (messages == 0) {
+            // the percentiles require at least one latency
+            throw up::make_exception("bench-bad-messages").with(messages);
+        }
+        std::vector<workload> workloads = {
+            {"echo-64", workload::type::echo, 64, 0, messages},
+            {"echo-4k", workload::type::echo, 4096, 0, messages},
+            {"request-response-64-1k", workload::type::request_response, 64, 1024, messages},
+            {"bulk-64k", workload::type::bulk, 1 << 16, 0, std::max<std::size_t>(messages / 10, 1)},
+        };
+        std::vector<transport> transports = {tcp_transport(), loopback_transport(), shm_transport()};
+        if (argc >= 3) {
+            up::shared_string pem = argv[2];
+            transports.push_back(tls_transport("tls", tcp_transport(), pem));
+            transports.push_back(tls_transport("tls-loopback", loopback_transport(), pem));
+        }
+        for (auto&& load : workloads) {
+            for (auto&& transport : transports) {
+                run(load, transport);
+            }
+        }
+
+    } catch (...) {
+        up::log_current_exception(std::cerr, "ERROR: ");
+        return EXIT_FAILURE;
+    }
+}
@@ -3,6 +3,7 @@
 #include "up_buffer.hpp"
 #include "up_exception.hpp"
 #include "up_inet.hpp"
+#include "up_reactor.hpp"
 #include "up_tls.hpp"
 
 namespace
@@ -30,6 +31,37 @@ namespace
         }
     }
 
+    /* Same as echo_server, but serves many connections concurrently on a
+     * single thread. Each connection is handled in its own fiber. Idle
+     * connections expire after 30 seconds. Re-arming the deadline after each
+     * message is cheap, because it only moves a timer within the timer wheel
+     * of the reactor. */
+    __attribute__((unused))
+    void reactor_echo_server(up::tcp::endpoint endpoint)
+    {
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(std::move(endpoint), {o::reuseaddr}).listen(1024);
+        up::reactor reactor;
+        reactor.spawn([&]() {
+                for (;;) {
+                    auto stream = std::make_shared<up::tcp::connection>(
+                        listener.accept(up::reactor::patience(reactor)));
+                    reactor.spawn([&reactor, stream]() {
+                            auto buffer = up::buffer();
+                            auto deadline = up::reactor::patience(reactor, 30s);
+                            while (auto count = stream->read_some(buffer.reserve(1 << 14), deadline)) {
+                                buffer.produce(count);
+                                while (buffer.available()) {
+                                    buffer.consume(stream->write_some(buffer, deadline));
+                                }
+                                deadline = 30s;
+                            }
+                        });
+                }
+            });
+        reactor.run();
+    }
+
     [[noreturn]]
     __attribute__((unused))
     void tls_echo_server(up::tcp::endpoint endpoint)
@@ -106,10 +138,13 @@ int main(int argc, char* argv[])
         auto now = up::steady_clock::now();
         auto deadline = up::stream::deadline_patience(now + 30s);
 
+        std::vector<up::tcp::endpoint> candidates;
         for (auto&& address : up::ip::resolve_endpoints("www.heise.de.")) {
-            // skip IPv6 addresses
-            if (address.version() == up::ip::version::v6) continue;
-            http_get(connect(address, "http", deadline), deadline);
+            candidates.emplace_back(address, up::tcp::resolve_port("http"));
+        }
+        if (!candidates.empty()) {
+            // unreachable addresses (e.g. IPv6 without route) do not stall the connect
+            http_get(up::tcp::connect_any(candidates, deadline), deadline);
             return EXIT_SUCCESS;
         }
 
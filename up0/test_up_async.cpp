@@ -0,0 +1,65 @@
+#include "up_async.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    auto make_endpoint()
+    {
+        return up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47613));
+    }
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::reactor reactor;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto expires_at = up::steady_clock::now() + 5s;
+        up::optional<up::tcp::connection> server;
+        up::optional<up::tcp::connection> client;
+        char buffer[16] = { };
+        std::size_t count = 0;
+        up::async::accept(reactor, listener, expires_at).then([&](auto&& awaitable) {
+                server.emplace(awaitable.await_resume());
+                up::async::read_some(reactor, *server, {buffer, sizeof(buffer)}, expires_at)
+                    .then([&](auto&& awaitable) { count = awaitable.await_resume(); });
+            });
+        up::async::connect(reactor, up::tcp::socket(up::ip::version::v4), make_endpoint(), expires_at)
+            .then([&](auto&& awaitable) {
+                    client.emplace(awaitable.await_resume());
+                    up::async::write_all(reactor, *client, {"hello", 5}, expires_at)
+                        .then([](auto&& awaitable) { awaitable.await_resume(); });
+                });
+        reactor.run();
+        UP_TEST_EQUAL(count, 5u);
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("hello"));
+    };
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::reactor reactor;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        bool expired = false;
+        up::async::accept(reactor, listener, up::steady_clock::now() + 10ms).then([&](auto&& awaitable) {
+                try {
+                    awaitable.await_resume();
+                } catch (const up::stream::timeout&) {
+                    expired = true;
+                }
+            });
+        reactor.run();
+        UP_TEST_TRUE(expired);
+    };
+
+    UP_TEST_CASE {
+        up::reactor reactor;
+        auto resolver = up::resolver();
+        std::vector<up::ip::endpoint> endpoints;
+        up::async::resolve_endpoints(reactor, resolver, "localhost", up::steady_clock::now() + 5s)
+            .then([&](auto&& awaitable) { endpoints = awaitable.await_resume(); });
+        reactor.run();
+        UP_TEST_TRUE(!endpoints.empty());
+    };
+
+}
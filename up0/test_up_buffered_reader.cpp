@@ -0,0 +1,81 @@
+#include "up_buffered_reader.hpp"
+#include "up_exception.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    // delivers the given pieces, one per read operation
+    class script_engine final
+    {
+    public: // --- scope ---
+        using self = script_engine;
+        using status = up::stream::engine::status;
+    private: // --- state ---
+        std::vector<std::string> _pieces;
+        mutable std::size_t _reads = 0;
+    public: // --- life ---
+        explicit script_engine(std::vector<std::string> pieces)
+            : _pieces(std::move(pieces))
+        { }
+    public: // --- operations ---
+        auto reads() const { return _reads; }
+        auto try_shutdown() const -> status { return 0; }
+        void hard_close() const { }
+        auto try_read_some(up::chunk::into chunk) const -> status
+        {
+            if (_reads == _pieces.size()) {
+                return 0;
+            }
+            auto&& piece = _pieces[_reads++];
+            if (piece.size() > chunk.size()) {
+                throw up::make_exception("unexpected-script-engine-chunk-size");
+            }
+            std::memcpy(chunk.data(), piece.data(), piece.size());
+            return piece.size();
+        }
+        auto try_write_some(up::chunk::from chunk) const -> status { return chunk.size(); }
+        auto get_native_handle() const -> up::stream::native_handle
+        {
+            return up::stream::native_handle::invalid;
+        }
+    };
+
+    UP_TEST_CASE {
+        auto stream = up::basic_stream<script_engine>(
+            std::vector<std::string>{"one\r\ntwo\r", "\nthr", "ee\r\n", "four"});
+        auto patience = up::stream::infinite_patience();
+        auto reader = up::buffered_reader();
+        UP_TEST_EQUAL(*reader.read_until(stream, "\r\n", patience), up::string_view("one"));
+        UP_TEST_EQUAL(stream.get_engine().reads(), 1u);
+        UP_TEST_EQUAL(*reader.read_until(stream, "\r\n", patience), up::string_view("two"));
+        UP_TEST_EQUAL(*reader.read_until(stream, "\r\n", patience), up::string_view("three"));
+        UP_TEST_EQUAL(stream.get_engine().reads(), 3u);
+        UP_TEST_EQUAL(reader.peek(stream, patience), up::string_view("four"));
+        UP_TEST_EQUAL(*reader.read_exact(stream, 2, patience), up::string_view("fo"));
+        UP_TEST_EQUAL(reader.buffered(), up::string_view("ur"));
+        bool truncated = false;
+        try {
+            reader.read_until(stream, "\r\n", patience);
+        } catch (...) {
+            truncated = true;
+        }
+        UP_TEST_TRUE(truncated);
+    };
+
+    UP_TEST_CASE {
+        auto stream = up::basic_stream<script_engine>(
+            std::vector<std::string>{std::string("\0\3abc\0\2de", 9)});
+        auto patience = up::stream::infinite_patience();
+        auto reader = up::buffered_reader();
+        std::vector<std::string> messages;
+        while (auto header = reader.read_exact(stream, 2, patience)) {
+            auto size = std::size_t(uint8_t((*header)[0])) << 8 | uint8_t((*header)[1]);
+            messages.emplace_back(reader.read_exact(stream, size, patience)->to_string());
+        }
+        UP_TEST_EQUAL(messages.size(), 2u);
+        UP_TEST_EQUAL(messages[1], "de");
+        UP_TEST_EQUAL(stream.get_engine().reads(), 1u);
+    };
+
+}
@@ -0,0 +1,79 @@
+#include "up_buffered_writer.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    // records all write operations and cork changes
+    class record_engine final
+    {
+    public: // --- scope ---
+        using self = record_engine;
+        using status = up::stream::engine::status;
+    public: // --- state ---
+        mutable std::vector<std::string> writes;
+        mutable std::vector<bool> corks;
+    public: // --- operations ---
+        void cork(bool enabled) const
+        {
+            corks.push_back(enabled);
+        }
+        auto try_shutdown() const -> status { return 0; }
+        void hard_close() const { }
+        auto try_read_some(up::chunk::into chunk __attribute__((unused))) const -> status { return 0; }
+        auto try_write_some(up::chunk::from chunk) const -> status
+        {
+            writes.emplace_back(chunk.data(), chunk.size());
+            return chunk.size();
+        }
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status
+        {
+            std::string data;
+            auto total = chunks.total();
+            while (chunks.total()) {
+                auto&& head = chunks.head();
+                data.append(head.data(), head.size());
+                chunks.drain(head.size());
+            }
+            writes.emplace_back(std::move(data));
+            return total;
+        }
+        auto get_native_handle() const -> up::stream::native_handle
+        {
+            return up::stream::native_handle::invalid;
+        }
+    };
+
+    UP_TEST_CASE {
+        auto stream = up::basic_stream<record_engine>();
+        auto patience = up::stream::infinite_patience();
+        auto writer = up::buffered_writer(8);
+        writer.write(stream, {"HTTP", 4}, patience);
+        writer.write(stream, {"/1.1", 4}, patience);
+        UP_TEST_EQUAL(writer.buffered(), 8u);
+        UP_TEST_TRUE(stream.get_engine().writes.empty());
+        writer.flush(stream, patience);
+        UP_TEST_EQUAL(stream.get_engine().writes.size(), 1u);
+        UP_TEST_EQUAL(stream.get_engine().writes[0], "HTTP/1.1");
+        // small messages are never corked
+        UP_TEST_TRUE(stream.get_engine().corks.empty());
+    };
+
+    UP_TEST_CASE {
+        auto stream = up::basic_stream<record_engine>();
+        auto patience = up::stream::infinite_patience();
+        auto writer = up::buffered_writer(8);
+        writer.write(stream, {"head", 4}, patience);
+        writer.write(stream, {"large body", 10}, patience);
+        writer.write(stream, {"tail", 4}, patience);
+        writer.flush(stream, patience);
+        auto&& engine = stream.get_engine();
+        UP_TEST_EQUAL(engine.writes.size(), 2u);
+        UP_TEST_EQUAL(engine.writes[0], "headlarge body");
+        UP_TEST_EQUAL(engine.writes[1], "tail");
+        UP_TEST_EQUAL(engine.corks.size(), 2u);
+        UP_TEST_TRUE(engine.corks[0]);
+        UP_TEST_TRUE(!engine.corks[1]);
+    };
+
+}
@@ -0,0 +1,350 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "up_defer.hpp"
+#include "up_inet.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    auto make_endpoint()
+    {
+        return up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47625));
+    }
+
+    UP_TEST_CASE {
+        // the ports of the endpoints are in host byte order
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(server.remote().port(), client.local().port());
+        UP_TEST_EQUAL(server.local().port(), make_endpoint().port());
+        UP_TEST_EQUAL(client.remote().port(), make_endpoint().port());
+    };
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        cpu_set_t original;
+        if (::sched_getaffinity(0, sizeof(original), &original) != 0 || !CPU_ISSET(0, &original)) {
+            return; // not supported
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        if (::sched_setaffinity(0, sizeof(set), &set) != 0) {
+            return; // not supported
+        }
+        UP_DEFER { ::sched_setaffinity(0, sizeof(original), &original); };
+        // all connections are received on CPU 0, which is mapped to the second listener
+        auto first = up::tcp::socket(make_endpoint(), {o::reuseaddr, o::reuseport}).listen(8);
+        auto second = up::tcp::socket(make_endpoint(), {o::reuseaddr, o::reuseport}).listen(8);
+        first.steer_by_cpu({1, 0});
+        std::vector<up::tcp::connection> clients;
+        for (std::size_t i = 0; i != 4; ++i) {
+            clients.push_back(up::tcp::socket(up::ip::version::v4)
+                .connect(make_endpoint(), up::stream::deadline_patience(5s)));
+        }
+        for (std::size_t i = 0; i != 4; ++i) {
+            auto connection = second.accept(up::stream::deadline_patience(5s));
+            UP_TEST_EQUAL(connection.incoming_cpu(), 0);
+        }
+        UP_TEST_TRUE(!first.try_accept());
+    };
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(8);
+        std::vector<up::tcp::connection> clients;
+        for (std::size_t i = 0; i != 5; ++i) {
+            clients.push_back(up::tcp::socket(up::ip::version::v4)
+                .connect(make_endpoint(), up::stream::deadline_patience(5s)));
+        }
+        auto options = up::tcp::listener::accept_options()
+            .keepalive(60s, 3, 10s)
+            .qos(up::tcp::connection::qos_priority::class1, up::tcp::connection::qos_drop::low);
+        auto first = listener.accept_many(up::stream::deadline_patience(5s), 3, options);
+        UP_TEST_EQUAL(first.size(), 3u);
+        auto second = listener.accept_many(up::stream::deadline_patience(5s), 8, options);
+        UP_TEST_EQUAL(second.size(), 2u);
+        UP_TEST_TRUE(!listener.try_accept());
+    };
+
+    UP_TEST_CASE {
+        // a failing accept (EMFILE) does not drop the accepted connections
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(8);
+        std::vector<up::tcp::connection> clients;
+        for (std::size_t i = 0; i != 3; ++i) {
+            clients.push_back(up::tcp::socket(up::ip::version::v4)
+                .connect(make_endpoint(), up::stream::deadline_patience(5s)));
+        }
+        rlimit saved;
+        UP_TEST_EQUAL(::getrlimit(RLIMIT_NOFILE, &saved), 0);
+        // all descriptors below the lowest free one are in use
+        int lowest = ::dup(0);
+        UP_TEST_TRUE(lowest != -1);
+        ::close(lowest);
+        std::vector<up::tcp::connection> first;
+        {
+            rlimit limited = saved;
+            limited.rlim_cur = rlim_t(lowest + 1);
+            UP_TEST_EQUAL(::setrlimit(RLIMIT_NOFILE, &limited), 0);
+            UP_DEFER { ::setrlimit(RLIMIT_NOFILE, &saved); };
+            first = listener.accept_many(up::stream::deadline_patience(5s), 8, {});
+        }
+        UP_TEST_EQUAL(first.size(), 1u);
+        auto second = listener.accept_many(up::stream::deadline_patience(5s), 8, {});
+        UP_TEST_EQUAL(second.size(), 2u);
+    };
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        client.zerocopy(1 << 12);
+        // small writes are copied
+        client.write_all({"hello", 5}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(client.zerocopy_sent(), 0u);
+        auto data = std::string(1 << 18, 'z');
+        client.write_all(up::chunk::from(data), up::stream::deadline_patience(5s));
+        auto sent = client.zerocopy_sent();
+        UP_TEST_TRUE(sent > 0);
+        std::size_t total = 0;
+        char buffer[1 << 14];
+        while (total != data.size() + 5) {
+            total += server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        }
+        // the pages are released after the receiver has consumed the data (loopback)
+        client.zerocopy_wait(sent, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(client.zerocopy_completed(), sent);
+    };
+
+    class counting_patience final : public up::stream::patience
+    {
+    public: // --- state ---
+        std::size_t _waits = 0;
+        int _handle = -1; // of the last wait
+        up::stream::deadline_patience _delegate{up::steady_clock::now() + 50ms};
+    private:
+        void _wait(up::stream::native_handle handle, operation op) override
+        {
+            ++_waits;
+            _handle = up::to_underlying_type(handle);
+            _delegate(handle, op);
+        }
+    };
+
+    UP_TEST_CASE {
+        // unread data does not wake up zerocopy_wait
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        client.zerocopy(1 << 12);
+        auto data = std::string(1 << 16, 'z');
+        client.write_all(up::chunk::from(data), up::stream::deadline_patience(5s));
+        server.write_all({"unread", 6}, up::stream::deadline_patience(5s));
+        // waits for a send, that will never be completed
+        counting_patience patience;
+        bool expired = false;
+        try {
+            client.zerocopy_wait(client.zerocopy_sent() + 1, patience);
+        } catch (const up::stream::timeout&) {
+            expired = true;
+        }
+        UP_TEST_TRUE(expired);
+        UP_TEST_TRUE(patience._waits < 16);
+        // the handle for waiting is kept open and reused
+        UP_TEST_TRUE(::fcntl(patience._handle, F_GETFD) != -1);
+        counting_patience second;
+        try {
+            client.zerocopy_wait(client.zerocopy_sent() + 1, second);
+        } catch (const up::stream::timeout&) {
+            // expected
+        }
+        UP_TEST_EQUAL(second._handle, patience._handle);
+    };
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        using direction = up::tcp::relay::direction;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(2);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto inbound = listener.accept(up::stream::deadline_patience(5s));
+        auto outbound = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        auto relay = up::tcp::relay(inbound, outbound);
+        char buffer[16] = { };
+        client.write_all({"ping", 4}, up::stream::deadline_patience(5s));
+        while (relay.transferred(direction::forward) != 4) {
+            relay.try_pump();
+        }
+        auto count = server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("ping"));
+        // half-close: the backward direction continues
+        client.shutdown(up::stream::deadline_patience(5s));
+        server.write_all({"pong", 4}, up::stream::deadline_patience(5s));
+        server.shutdown(up::stream::deadline_patience(5s));
+        relay.pump(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 0u);
+        count = client.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("pong"));
+        UP_TEST_EQUAL(client.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 0u);
+        UP_TEST_EQUAL(relay.transferred(direction::backward), 4u);
+    };
+
+    UP_TEST_CASE {
+        // a reset peer raises an error instead of SIGPIPE
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(2);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto inbound = listener.accept(up::stream::deadline_patience(5s));
+        auto outbound = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        {
+            auto server = listener.accept(up::stream::deadline_patience(5s));
+            linger value{1, 0};
+            UP_TEST_EQUAL(::setsockopt(up::to_underlying_type(server.get_native_handle()),
+                    SOL_SOCKET, SO_LINGER, &value, sizeof(value)), 0);
+        }
+        auto relay = up::tcp::relay(inbound, outbound);
+        // the first attempt fails with ECONNRESET, and the following with EPIPE
+        std::size_t failures = 0;
+        for (auto deadline = up::steady_clock::now() + 5s; failures != 2 && up::steady_clock::now() < deadline; ) {
+            client.write_all({"ping", 4}, up::stream::deadline_patience(5s));
+            try {
+                relay.try_pump();
+            } catch (...) {
+                ++failures;
+            }
+        }
+        UP_TEST_EQUAL(failures, 2u);
+    };
+
+    UP_TEST_CASE {
+        auto any = up::udp::endpoint(up::ipv4::endpoint::loopback, up::udp::port::any);
+        auto receiver = up::udp::socket(any, {});
+        auto sender = up::udp::socket(any, {});
+        auto destination = receiver.local();
+        up::chunk::from messages[] = {{"first", 5}, {"", 0}, {"third datagram", 14}};
+        sender.send_many(destination, messages, 3, up::stream::deadline_patience(5s));
+        char buffers[4][8];
+        up::chunk::into chunks[] = {
+            {buffers[0], 8}, {buffers[1], 8}, {buffers[2], 8}, {buffers[3], 8},
+        };
+        std::vector<up::udp::datagram> datagrams;
+        std::size_t count = 0;
+        while (count != 3) {
+            count += receiver.recv_many(chunks + count, 4 - count, datagrams, up::stream::deadline_patience(5s));
+        }
+        UP_TEST_EQUAL(up::string_view(buffers[0], 5), up::string_view("first"));
+        UP_TEST_EQUAL(up::string_view(buffers[2], 8), up::string_view("third da"));
+        UP_TEST_TRUE(datagrams.back().truncated());
+        UP_TEST_EQUAL(datagrams.back().size(), 8u);
+        UP_TEST_EQUAL(datagrams.back().source().port(), sender.local().port());
+        UP_TEST_EQUAL(receiver.try_recv_many(chunks, 4, datagrams), 0u);
+        UP_TEST_TRUE(datagrams.empty());
+        // connected sockets
+        sender.connect(destination);
+        UP_TEST_EQUAL(sender.try_send_many(messages, 1), 1u);
+        UP_TEST_EQUAL(receiver.recv_many(chunks, 4, datagrams, up::stream::deadline_patience(5s)), 1u);
+        UP_TEST_EQUAL(datagrams.front().size(), 5u);
+        UP_TEST_TRUE(!datagrams.front().truncated());
+    };
+
+    UP_TEST_CASE {
+        // segmentation offload (the loopback device may coalesce the datagrams again)
+        auto any = up::udp::endpoint(up::ipv4::endpoint::loopback, up::udp::port::any);
+        auto receiver = up::udp::socket(any, {});
+        receiver.gro(true);
+        auto sender = up::udp::socket(any, {});
+        auto data = std::string(10500, 's');
+        sender.send_segmented(receiver.local(), up::chunk::from(data), 1000, up::stream::deadline_patience(5s));
+        std::vector<char> buffer(1 << 17);
+        up::chunk::into chunks[] = {{buffer.data(), 1 << 16}, {buffer.data() + (1 << 16), 1 << 16}};
+        std::vector<up::udp::datagram> datagrams;
+        std::size_t total = 0;
+        std::size_t segments = 0;
+        while (total != data.size()) {
+            receiver.recv_many(chunks, 2, datagrams, up::stream::deadline_patience(5s));
+            for (auto&& datagram : datagrams) {
+                UP_TEST_TRUE(!datagram.truncated());
+                UP_TEST_TRUE(datagram.segment_size() == 1000 || datagram.segment_size() == 500);
+                total += datagram.size();
+                segments += (datagram.size() + datagram.segment_size() - 1) / datagram.segment_size();
+            }
+        }
+        UP_TEST_EQUAL(segments, 11u);
+    };
+
+    UP_TEST_CASE {
+        // TCP Fast Open (falls back to the regular handshake if disabled)
+        using o = up::tcp::socket::option;
+        auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47633));
+        auto listener = up::tcp::socket(endpoint, {o::reuseaddr, o::fastopen}).listen(8);
+        int sysctl = 0;
+        if (auto file = std::fopen("/proc/sys/net/ipv4/tcp_fastopen", "r")) {
+            UP_DEFER { std::fclose(file); };
+            if (std::fscanf(file, "%d", &sysctl) != 1) {
+                sysctl = 0;
+            }
+        }
+        for (std::size_t i = 0; i != 2; ++i) {
+            auto client = up::tcp::socket(up::ip::version::v4)
+                .connect_fastopen(endpoint, {"hello", 5}, up::stream::deadline_patience(5s));
+            auto server = listener.accept(up::stream::deadline_patience(5s));
+            char buffer[8];
+            std::size_t count = 0;
+            while (count != 5) {
+                count += server.read_some({buffer + count, sizeof(buffer) - count}, up::stream::deadline_patience(5s));
+            }
+            UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("hello"));
+            if (i == 1 && (sysctl & 3) == 3) {
+                // the cookie has been obtained with the first connection
+                UP_TEST_TRUE(client.fastopen_used());
+                UP_TEST_TRUE(server.fastopen_used());
+            }
+        }
+    };
+
+    UP_TEST_CASE {
+        /* Happy Eyeballs: the SYNs to the first endpoint are dropped, because
+         * the accept queue of its listener is full (backlog zero). */
+        using o = up::tcp::socket::option;
+        auto stalled = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47635));
+        auto working = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47637));
+        auto stalled_listener = up::tcp::socket(stalled, {o::reuseaddr}).listen(0);
+        auto working_listener = up::tcp::socket(working, {o::reuseaddr}).listen(8);
+        auto queued = up::tcp::socket(up::ip::version::v4).connect(stalled, up::stream::deadline_patience(5s));
+        auto start = std::chrono::steady_clock::now();
+        auto client = up::tcp::connect_any({stalled, working}, up::stream::deadline_patience(5s), 50ms);
+        UP_TEST_TRUE(std::chrono::steady_clock::now() - start < 900ms);
+        UP_TEST_EQUAL(client.remote().port(), working.port());
+        auto server = working_listener.accept(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(server.remote().port(), client.local().port());
+        // the error of the last attempt is raised, if all attempts fail
+        bool failed = false;
+        try {
+            auto closed = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47639));
+            up::tcp::connect_any({closed, closed}, up::stream::deadline_patience(5s));
+        } catch (...) {
+            failed = true;
+        }
+        UP_TEST_TRUE(failed);
+    };
+
+}
@@ -0,0 +1,140 @@
+#include <unistd.h>
+
+#include "up_fs.hpp"
+#include "up_inet.hpp"
+#include "up_local.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    auto make_abstract_endpoint()
+    {
+        auto name = "up-test-local-" + std::to_string(::getpid());
+        return up::local::endpoint::make_abstract(up::shared_string(name.data(), name.size()));
+    }
+
+    UP_TEST_CASE {
+        auto endpoint = make_abstract_endpoint();
+        auto listener = up::local::socket(endpoint, {}).listen(4);
+        auto client = up::local::socket().connect(endpoint, up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        UP_TEST_TRUE(client.remote().get_kind() == up::local::endpoint::kind::abstract);
+        UP_TEST_TRUE(server.remote().get_kind() == up::local::endpoint::kind::unnamed);
+        UP_TEST_TRUE(server.local().name() == endpoint.name());
+        UP_TEST_EQUAL(server.peer_credentials().pid, ::getpid());
+        client.write_all({"hello", 5}, up::stream::deadline_patience(5s));
+        client.shutdown(up::stream::deadline_patience(5s));
+        char buffer[8];
+        UP_TEST_EQUAL(server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 5u);
+        UP_TEST_EQUAL(up::string_view(buffer, 5), up::string_view("hello"));
+        UP_TEST_EQUAL(server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 0u);
+    };
+
+    UP_TEST_CASE {
+        // stale socket files are replaced
+        using o = up::local::socket::option;
+        auto name = "/tmp/up-test-local-" + std::to_string(::getpid());
+        auto endpoint = up::local::endpoint(up::shared_string(name.data(), name.size()));
+        up::optional<up::local::listener> listener = up::local::socket(endpoint, {o::unlink}).listen(4);
+        listener = up::local::socket(endpoint, {o::unlink}).listen(4);
+        auto client = up::local::socket().connect(endpoint, up::stream::deadline_patience(5s));
+        UP_TEST_TRUE(listener->accept(up::stream::deadline_patience(5s)).remote().get_kind()
+            == up::local::endpoint::kind::unnamed);
+        ::unlink(name.c_str());
+    };
+
+    UP_TEST_CASE {
+        // hands over an accepted TCP connection
+        auto endpoint = make_abstract_endpoint();
+        auto listener = up::local::socket(endpoint, {}).listen(4);
+        auto front = up::local::socket().connect(endpoint, up::stream::deadline_patience(5s));
+        auto worker = listener.accept(up::stream::deadline_patience(5s));
+        using o = up::tcp::socket::option;
+        auto tcp_endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47631));
+        auto tcp_listener = up::tcp::socket(tcp_endpoint, {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4).connect(tcp_endpoint, up::stream::deadline_patience(5s));
+        {
+            auto accepted = tcp_listener.accept(up::stream::deadline_patience(5s));
+            int fd = up::to_underlying_type(accepted.get_native_handle());
+            front.send_descriptors({"conn", 4}, {fd}, up::stream::deadline_patience(5s));
+        }
+        std::vector<up::local::descriptor> descriptors;
+        char buffer[8];
+        UP_TEST_EQUAL(worker.receive_descriptors({buffer, sizeof(buffer)}, descriptors,
+                up::stream::deadline_patience(5s)), 4u);
+        UP_TEST_EQUAL(descriptors.size(), 1u);
+        auto connection = up::tcp::connection::adopt(descriptors.front().release());
+        UP_TEST_EQUAL(connection.remote().port(), client.local().port());
+        connection.write_all({"pong", 4}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(client.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 4u);
+        UP_TEST_EQUAL(up::string_view(buffer, 4), up::string_view("pong"));
+    };
+
+    class counting_patience final : public up::stream::patience
+    {
+    public: // --- state ---
+        std::size_t _waits = 0;
+        up::stream::deadline_patience _delegate{up::steady_clock::now() + 50ms};
+    private:
+        void _wait(up::stream::native_handle handle, operation op) override
+        {
+            ++_waits;
+            _delegate(handle, op);
+        }
+    };
+
+    UP_TEST_CASE {
+        // connecting to a full backlog backs off instead of spinning
+        auto endpoint = make_abstract_endpoint();
+        auto listener = up::local::socket(endpoint, {}).listen(0);
+        std::vector<up::local::connection> clients;
+        counting_patience patience;
+        bool timeout = false;
+        try {
+            for (;;) {
+                clients.push_back(up::local::socket().connect(endpoint, patience));
+            }
+        } catch (...) {
+            timeout = true;
+        }
+        UP_TEST_TRUE(timeout);
+        UP_TEST_TRUE(patience._waits != 0);
+        UP_TEST_TRUE(patience._waits < 16);
+        // the pending attempts are not affected
+        UP_TEST_TRUE(listener.accept(up::stream::deadline_patience(5s)).remote().get_kind()
+            == up::local::endpoint::kind::unnamed);
+    };
+
+    UP_TEST_CASE {
+        // hands over a file and rejects it as TCP connection
+        auto endpoint = make_abstract_endpoint();
+        auto listener = up::local::socket(endpoint, {}).listen(4);
+        auto front = up::local::socket().connect(endpoint, up::stream::deadline_patience(5s));
+        auto worker = listener.accept(up::stream::deadline_patience(5s));
+        {
+            auto file = up::fs::file(up::fs::file::memory, up::fs::context("test"), "adopt");
+            file.write_all({"content", 7}, 0);
+            front.send_descriptors({"file", 4}, {file.get_native_handle(), file.get_native_handle()},
+                up::stream::deadline_patience(5s));
+        }
+        std::vector<up::local::descriptor> descriptors;
+        char buffer[8];
+        UP_TEST_EQUAL(worker.receive_descriptors({buffer, sizeof(buffer)}, descriptors,
+                up::stream::deadline_patience(5s)), 4u);
+        UP_TEST_EQUAL(descriptors.size(), 2u);
+        bool rejected = false;
+        try {
+            up::tcp::connection::adopt(descriptors.front().release());
+        } catch (...) {
+            rejected = true;
+        }
+        UP_TEST_TRUE(rejected);
+        auto file = up::fs::file(up::fs::file::adopt, up::fs::context("test"), descriptors.back().release());
+        UP_TEST_EQUAL(file.read_some({buffer, sizeof(buffer)}, 0), 7u);
+        UP_TEST_EQUAL(up::string_view(buffer, 7), up::string_view("content"));
+    };
+
+}
@@ -0,0 +1,77 @@
+#include <thread>
+
+#include "up_exception.hpp"
+#include "up_loopback.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    UP_TEST_CASE {
+        auto streams = up::loopback::make_streams(4);
+        auto& client = streams.first;
+        auto& server = streams.second;
+        char buffer[16] = { };
+        // the capacity limits the transfer (backpressure)
+        UP_TEST_EQUAL(client.write_some({"hello world", 11}, up::stream::deadline_patience(5s)), 4u);
+        UP_TEST_TRUE(!client.try_write_some({"o", 1}).done());
+        auto count = server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("hell"));
+        UP_TEST_TRUE(!server.try_read_some({buffer, sizeof(buffer)}).done());
+        bool expired = false;
+        try {
+            server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(10ms));
+        } catch (const up::stream::timeout&) {
+            expired = true;
+        }
+        UP_TEST_TRUE(expired);
+        // wraps around the end of the ring
+        client.write_all(up::chunk::from_bulk(up::chunk::from{"o w", 3}, up::chunk::from{"o", 1}),
+            up::stream::deadline_patience(5s));
+        count = server.read_some(up::chunk::into_bulk(up::chunk::into{buffer, 2}, up::chunk::into{buffer + 2, 8}),
+            up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("o wo"));
+        client.shutdown(up::stream::deadline_patience(5s));
+        count = server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(count, 0u);
+    };
+
+    UP_TEST_CASE {
+        // blocking transfers between threads through a small ring
+        auto streams = up::loopback::make_streams(1000);
+        std::string data;
+        for (std::size_t i = 0; data.size() < (1 << 20); ++i) {
+            data += std::to_string(i);
+        }
+        std::thread writer([&]() noexcept {
+                streams.first.write_all(up::chunk::from(data), up::stream::deadline_patience(30s));
+                streams.first.shutdown(up::stream::deadline_patience(30s));
+            });
+        std::string received;
+        char buffer[777];
+        while (auto count = streams.second.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(30s))) {
+            received.append(buffer, count);
+        }
+        writer.join();
+        UP_TEST_EQUAL(received.size(), data.size());
+        UP_TEST_TRUE(received == data);
+    };
+
+    UP_TEST_CASE {
+        auto engines = up::loopback::make_engines(16);
+        auto server = up::stream(std::move(engines.second));
+        engines.first.reset();
+        char c;
+        UP_TEST_EQUAL(server.read_some({&c, 1}, up::stream::deadline_patience(5s)), 0u);
+        bool broken = false;
+        try {
+            server.write_some({"x", 1}, up::stream::deadline_patience(5s));
+        } catch (...) {
+            broken = true;
+        }
+        UP_TEST_TRUE(broken);
+    };
+
+}
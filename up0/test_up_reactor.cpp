@@ -0,0 +1,157 @@
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "up_defer.hpp"
+#include "up_reactor.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    class pipe final
+    {
+    public: // --- state ---
+        int _fds[2];
+    public: // --- life ---
+        explicit pipe()
+        {
+            if (::pipe2(_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+                throw std::runtime_error("pipe");
+            }
+        }
+        ~pipe() noexcept
+        {
+            ::close(_fds[0]);
+            ::close(_fds[1]);
+        }
+    public: // --- operations ---
+        auto reader() const { return up::stream::native_handle(_fds[0]); }
+        void write() const
+        {
+            char c = 0;
+            if (::write(_fds[1], &c, 1) != 1) {
+                throw std::runtime_error("write");
+            }
+        }
+    };
+
+    UP_TEST_CASE {
+        up::reactor reactor;
+        pipe pipe;
+        int trace = 0;
+        reactor.spawn([&]() {
+                trace = trace * 10 + 1;
+                up::reactor::patience patience(reactor);
+                patience(pipe.reader(), up::stream::patience::operation::read);
+                trace = trace * 10 + 3;
+            });
+        reactor.spawn([&]() {
+                trace = trace * 10 + 2;
+                pipe.write();
+            });
+        reactor.run();
+        UP_TEST_EQUAL(trace, 123);
+    };
+
+    UP_TEST_CASE {
+        up::reactor reactor;
+        pipe pipe;
+        bool expired = false;
+        reactor.spawn([&]() {
+                try {
+                    up::reactor::patience patience(reactor, 10ms);
+                    patience(pipe.reader(), up::stream::patience::operation::read);
+                } catch (const up::stream::timeout&) {
+                    expired = true;
+                }
+            });
+        reactor.run();
+        UP_TEST_TRUE(expired);
+    };
+
+    UP_TEST_CASE {
+        up::reactor reactor;
+        pipe pipe;
+        std::size_t count = 0;
+        reactor.watch(pipe.reader(), up::stream::patience::operation::read,
+            [&](bool expired) { count += expired ? 0 : 1; });
+        pipe.write();
+        reactor.run();
+        UP_TEST_EQUAL(count, 1u);
+    };
+
+    UP_TEST_CASE {
+        // a reused handle number is registered again after a watch
+        up::reactor reactor;
+        std::size_t count = 0;
+        int fd = -1;
+        {
+            pipe first;
+            fd = up::to_underlying_type(first.reader());
+            reactor.watch(first.reader(), up::stream::patience::operation::read,
+                [&](bool expired) { count += expired ? 0 : 1; });
+            first.write();
+            reactor.run();
+        }
+        pipe second;
+        UP_TEST_EQUAL(up::to_underlying_type(second.reader()), fd);
+        reactor.watch(second.reader(), up::stream::patience::operation::read, up::steady_clock::now() + 5s,
+            [&](bool expired) { count += expired ? 0 : 1; });
+        second.write();
+        reactor.run();
+        UP_TEST_EQUAL(count, 2u);
+    };
+
+    UP_TEST_CASE {
+        // a reused handle number is registered again within the same fiber
+        up::reactor reactor;
+        std::vector<int> fds;
+        reactor.spawn([&]() {
+                for (std::size_t round = 0; round != 2; ++round) {
+                    pipe pipe;
+                    fds.push_back(up::to_underlying_type(pipe.reader()));
+                    pipe.write();
+                    up::reactor::patience patience(reactor, 5s);
+                    patience(pipe.reader(), up::stream::patience::operation::read);
+                }
+            });
+        reactor.run();
+        UP_TEST_EQUAL(fds.size(), 2u);
+        UP_TEST_EQUAL(fds[0], fds[1]);
+    };
+
+    UP_TEST_CASE {
+        // the registration is re-armed for the operation, that is still waited for
+        up::reactor reactor;
+        int fds[2];
+        UP_TEST_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds), 0);
+        UP_DEFER {
+            ::close(fds[0]);
+            ::close(fds[1]);
+        };
+        int trace = 0;
+        reactor.spawn([&]() {
+                try {
+                    up::reactor::patience patience(reactor, 5s);
+                    patience(up::stream::native_handle(fds[0]), up::stream::patience::operation::read);
+                    trace = trace * 10 + 2;
+                } catch (const up::stream::timeout&) {
+                    trace = trace * 10 + 3;
+                }
+            });
+        reactor.spawn([&]() {
+                // the handle is writable immediately
+                up::reactor::patience patience(reactor, 5s);
+                patience(up::stream::native_handle(fds[0]), up::stream::patience::operation::write);
+                trace = trace * 10 + 1;
+                char c = 0;
+                UP_TEST_EQUAL(::write(fds[1], &c, 1), 1);
+            });
+        reactor.run();
+        UP_TEST_EQUAL(trace, 12);
+    };
+
+}
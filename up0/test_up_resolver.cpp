@@ -0,0 +1,94 @@
+#include "up_reactor.hpp"
+#include "up_resolver.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    bool contains_loopback(const std::vector<up::ip::endpoint>& endpoints)
+    {
+        for (auto&& endpoint : endpoints) {
+            if (endpoint.version() == up::ip::version::v4
+                && static_cast<const up::ipv4::endpoint&>(endpoint).to_string() == "127.0.0.1") {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    UP_TEST_CASE {
+        // the second lookup is answered from the cache
+        auto resolver = up::resolver();
+        UP_TEST_TRUE(contains_loopback(resolver.resolve_endpoints("localhost", up::stream::deadline_patience(5s))));
+        UP_TEST_EQUAL(resolver.size(), 1u);
+        auto query = resolver.lookup("localhost");
+        UP_TEST_TRUE(query.done());
+        UP_TEST_TRUE(contains_loopback(query.result()));
+        resolver.clear();
+        UP_TEST_EQUAL(resolver.size(), 0u);
+    };
+
+    UP_TEST_CASE {
+        // concurrent lookups of the same name
+        auto resolver = up::resolver(4);
+        std::vector<up::resolver::query> queries;
+        for (std::size_t i = 0; i != 8; ++i) {
+            queries.push_back(resolver.lookup("localhost"));
+        }
+        std::size_t found = 0;
+        for (auto&& query : queries) {
+            UP_TEST_TRUE(contains_loopback(query.wait(up::stream::deadline_patience(5s))));
+            ++found;
+        }
+        UP_TEST_EQUAL(found, queries.size());
+        UP_TEST_EQUAL(resolver.size(), 1u);
+    };
+
+    UP_TEST_CASE {
+        // negative caching
+        auto resolver = up::resolver(1, 16, 60s, 60s);
+        std::size_t failures = 0;
+        for (std::size_t i = 0; i != 2; ++i) {
+            auto query = resolver.lookup("nonexistent.invalid.");
+            UP_TEST_EQUAL(query.done(), i == 1);
+            try {
+                query.wait(up::stream::deadline_patience(30s));
+            } catch (...) {
+                ++failures;
+            }
+        }
+        UP_TEST_EQUAL(failures, 2u);
+        UP_TEST_EQUAL(resolver.size(), 1u);
+    };
+
+    UP_TEST_CASE {
+        // the least recently used name (127.0.0.2) is evicted
+        auto resolver = up::resolver(1, 2);
+        resolver.resolve_endpoints("127.0.0.1", up::stream::deadline_patience(5s));
+        resolver.resolve_endpoints("127.0.0.2", up::stream::deadline_patience(5s));
+        resolver.resolve_endpoints("127.0.0.1", up::stream::deadline_patience(5s));
+        resolver.resolve_endpoints("127.0.0.3", up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(resolver.size(), 2u);
+        UP_TEST_TRUE(resolver.lookup("127.0.0.1").done());
+        UP_TEST_TRUE(resolver.lookup("127.0.0.3").done());
+    };
+
+    UP_TEST_CASE {
+        // consecutive lookups within the same reactor fiber (without cache)
+        auto resolver = up::resolver(1, 0);
+        up::reactor reactor;
+        std::size_t found = 0;
+        reactor.spawn([&]() {
+                for (std::size_t i = 0; i != 3; ++i) {
+                    if (contains_loopback(resolver.resolve_endpoints("localhost", up::reactor::patience(reactor, 5s)))) {
+                        ++found;
+                    }
+                }
+            });
+        reactor.run();
+        UP_TEST_EQUAL(found, 3u);
+    };
+
+}
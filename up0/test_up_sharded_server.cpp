@@ -0,0 +1,126 @@
+#include <thread>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "up_defer.hpp"
+#include "up_sharded_server.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    UP_TEST_CASE {
+        auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47621));
+        auto server = up::sharded_server(endpoint,
+            [](up::tcp::connection connection, up::reactor& reactor, std::size_t shard __attribute__((unused))) {
+                up::reactor::patience patience(reactor, 5s);
+                char c;
+                auto count = connection.read_some({&c, 1}, patience);
+                connection.write_all({&c, count}, patience);
+                connection.shutdown(patience);
+            },
+            2);
+        UP_TEST_EQUAL(server.shards(), 2u);
+        for (char c = 'a'; c != 'i'; ++c) {
+            auto connection = up::tcp::socket(up::ip::version::v4)
+                .connect(endpoint, up::stream::deadline_patience(5s));
+            connection.write_all({&c, 1}, up::stream::deadline_patience(5s));
+            char reply = 0;
+            auto count = connection.read_some({&reply, 1}, up::stream::deadline_patience(5s));
+            UP_TEST_EQUAL(count, 1u);
+            UP_TEST_EQUAL(reply, c);
+        }
+        server.stop();
+        UP_TEST_EQUAL(server.accepted(0) + server.accepted(1), 8u);
+    };
+
+    UP_TEST_CASE {
+        auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47623));
+        std::atomic<std::size_t> served{0};
+        std::atomic<std::size_t> misplaced{0};
+        up::optional<up::sharded_server> server;
+        server.emplace(endpoint,
+            [&](up::tcp::connection connection, up::reactor& reactor, std::size_t shard) {
+                if (connection.incoming_cpu() != server->cpu(shard)) {
+                    ++misplaced;
+                }
+                ++served;
+                up::reactor::patience patience(reactor, 5s);
+                connection.shutdown(patience);
+            },
+            0, 128, up::sharded_server::steering::incoming_cpu);
+        for (std::size_t i = 0; i != 8; ++i) {
+            auto connection = up::tcp::socket(up::ip::version::v4)
+                .connect(endpoint, up::stream::deadline_patience(5s));
+            char c;
+            UP_TEST_EQUAL(connection.read_some({&c, 1}, up::stream::deadline_patience(5s)), 0u);
+        }
+        server->stop();
+        UP_TEST_EQUAL(served.load(), 8u);
+        UP_TEST_EQUAL(misplaced.load(), 0u);
+    };
+
+    // the descriptors below the returned one are in use
+    auto lowest_free_descriptor()
+    {
+        int result = ::dup(0);
+        UP_TEST_TRUE(result != -1);
+        ::close(result);
+        return result;
+    }
+
+    UP_TEST_CASE {
+        // startup errors of the workers are raised by the constructor
+        auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47641));
+        rlimit saved;
+        UP_TEST_EQUAL(::getrlimit(RLIMIT_NOFILE, &saved), 0);
+        bool failed = false;
+        {
+            // enough for the listener and the eventfd, but not for the reactor
+            rlimit limited = saved;
+            limited.rlim_cur = rlim_t(lowest_free_descriptor() + 2);
+            UP_TEST_EQUAL(::setrlimit(RLIMIT_NOFILE, &limited), 0);
+            UP_DEFER { ::setrlimit(RLIMIT_NOFILE, &saved); };
+            try {
+                up::sharded_server(endpoint,
+                    [](up::tcp::connection, up::reactor&, std::size_t) { }, 1);
+            } catch (...) {
+                failed = true;
+            }
+        }
+        UP_TEST_TRUE(failed);
+    };
+
+    UP_TEST_CASE {
+        // the shard continues to accept after a failed accept
+        auto endpoint = up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47643));
+        auto server = up::sharded_server(endpoint,
+            [](up::tcp::connection connection, up::reactor& reactor, std::size_t shard __attribute__((unused))) {
+                up::reactor::patience patience(reactor, 5s);
+                connection.write_all({"x", 1}, patience);
+            },
+            1);
+        auto socket = up::tcp::socket(up::ip::version::v4);
+        up::stream::deadline_patience patience(5s);
+        rlimit saved;
+        UP_TEST_EQUAL(::getrlimit(RLIMIT_NOFILE, &saved), 0);
+        up::optional<up::tcp::connection> connection;
+        {
+            rlimit limited = saved;
+            limited.rlim_cur = rlim_t(lowest_free_descriptor());
+            UP_TEST_EQUAL(::setrlimit(RLIMIT_NOFILE, &limited), 0);
+            UP_DEFER { ::setrlimit(RLIMIT_NOFILE, &saved); };
+            connection.emplace(std::move(socket).connect(endpoint, patience));
+            std::this_thread::sleep_for(50ms);
+        }
+        char c = 0;
+        UP_TEST_EQUAL(connection->read_some({&c, 1}, patience), 1u);
+        UP_TEST_EQUAL(c, 'x');
+        server.stop();
+        UP_TEST_EQUAL(server.accepted(0), 1u);
+    };
+
+}
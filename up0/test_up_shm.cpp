@@ -0,0 +1,122 @@
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "up_defer.hpp"
+#include "up_shm.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    auto duplicate(const std::vector<int>& descriptors)
+    {
+        std::vector<int> result;
+        for (int fd : descriptors) {
+            result.push_back(::fcntl(fd, F_DUPFD_CLOEXEC, 0));
+        }
+        return result;
+    }
+
+    UP_TEST_CASE {
+        // two mappings of the same memory file
+        auto first = up::shm::channel(1000);
+        auto second = up::shm::channel::adopt(duplicate(first.descriptors()));
+        auto writer = std::move(first).make_stream(up::shm::side::first);
+        auto reader = std::move(second).make_stream(up::shm::side::second);
+        std::string data;
+        for (std::size_t i = 0; data.size() < (1 << 20); ++i) {
+            data += std::to_string(i);
+        }
+        std::thread thread([&]() noexcept {
+                writer.write_all(up::chunk::from(data), up::stream::deadline_patience(30s));
+                writer.shutdown(up::stream::deadline_patience(30s));
+            });
+        std::string received;
+        char buffer[777];
+        while (auto count = reader.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(30s))) {
+            received.append(buffer, count);
+        }
+        thread.join();
+        UP_TEST_EQUAL(received.size(), data.size());
+        UP_TEST_TRUE(received == data);
+    };
+
+    UP_TEST_CASE {
+        // echo from a child process
+        auto channel = up::shm::channel(64);
+        auto descriptors = channel.descriptors();
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            int rv = 1;
+            try {
+                auto stream = up::shm::channel::adopt(duplicate(descriptors)).make_stream(up::shm::side::second);
+                char buffer[16];
+                while (auto count = stream.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s))) {
+                    stream.write_all({buffer, count}, up::stream::deadline_patience(5s));
+                }
+                stream.shutdown(up::stream::deadline_patience(5s));
+                rv = 0;
+            } catch (...) {
+            }
+            ::_exit(rv);
+        }
+        UP_TEST_TRUE(pid > 0);
+        auto stream = std::move(channel).make_stream(up::shm::side::first);
+        stream.write_all({"ping", 4}, up::stream::deadline_patience(5s));
+        char buffer[4];
+        std::size_t count = 0;
+        while (count != sizeof(buffer)) {
+            count += stream.read_some({buffer + count, sizeof(buffer) - count}, up::stream::deadline_patience(5s));
+        }
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("ping"));
+        stream.shutdown(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(stream.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 0u);
+        int status = 0;
+        UP_TEST_EQUAL(::waitpid(pid, &status, 0), pid);
+        UP_TEST_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    };
+
+    UP_TEST_CASE {
+        bool invalid = false;
+        try {
+            up::shm::channel::adopt(duplicate({0}));
+        } catch (...) {
+            invalid = true;
+        }
+        UP_TEST_TRUE(invalid);
+    };
+
+    UP_TEST_CASE {
+        // the capacity is not read again from the header after the validation
+        auto first = up::shm::channel(1000);
+        auto second = up::shm::channel::adopt(duplicate(first.descriptors()));
+        auto memfd = first.descriptors()[0];
+        auto header = static_cast<uint64_t*>(::mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0));
+        UP_TEST_TRUE(header != MAP_FAILED);
+        UP_DEFER { ::munmap(header, 4096); };
+        // the peer modifies the capacity (the second field of the header)
+        header[1] = uint64_t(1) << 40;
+        auto writer = std::move(first).make_stream(up::shm::side::first);
+        auto reader = std::move(second).make_stream(up::shm::side::second);
+        writer.write_all({"hello", 5}, up::stream::deadline_patience(5s));
+        reader.write_all({"world", 5}, up::stream::deadline_patience(5s));
+        char buffer[5];
+        std::size_t count = 0;
+        while (count != sizeof(buffer)) {
+            count += reader.read_some({buffer + count, sizeof(buffer) - count}, up::stream::deadline_patience(5s));
+        }
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("hello"));
+        count = 0;
+        while (count != sizeof(buffer)) {
+            count += writer.read_some({buffer + count, sizeof(buffer) - count}, up::stream::deadline_patience(5s));
+        }
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("world"));
+    };
+
+}
@@ -0,0 +1,205 @@
+#include <thread>
+
+#include "up_fs.hpp"
+#include "up_inet.hpp"
+#include "up_loopback.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    auto make_endpoint()
+    {
+        return up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47617));
+    }
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect_basic(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept_basic(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(client.get_engine().remote().port(), up::tcp::port(47617));
+        client.write_all({"hello", 5}, up::stream::deadline_patience(5s));
+        char buffer[16] = { };
+        auto count = server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("hello"));
+        // switch to the type-erased stream, e.g. for an upgrade
+        auto connection = up::tcp::connection(std::move(server).release());
+        connection.write_all({"world", 5}, up::stream::deadline_patience(5s));
+        count = client.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("world"));
+        connection.shutdown(up::stream::deadline_patience(5s));
+        count = client.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(count, 0u);
+        auto moved = up::tcp::basic_connection(std::move(client));
+        moved.get_engine().hard_close();
+        UP_TEST_EQUAL(up::to_underlying_type(moved.get_native_handle()), -1);
+    };
+
+    // the forwarding constructor does not hijack copies
+    static_assert(!std::is_constructible<up::tcp::basic_connection, up::tcp::basic_connection&>::value, "");
+    static_assert(std::is_nothrow_move_constructible<up::tcp::basic_connection>::value, "");
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        using op = up::stream::patience::operation;
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        auto counters = std::make_shared<up::stream::counters>();
+        server.set_counters(counters);
+        char buffer[16] = { };
+        bool expired = false;
+        try {
+            server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(10ms));
+        } catch (const up::stream::timeout&) {
+            expired = true;
+        }
+        UP_TEST_TRUE(expired);
+        client.write_all({"hello", 5}, up::stream::deadline_patience(5s));
+        server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s));
+        server.write_all({"hi", 2}, up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(counters->bytes(op::read), 5u);
+        UP_TEST_EQUAL(counters->bytes(op::write), 2u);
+        UP_TEST_EQUAL(counters->would_block(op::read), 1u);
+        UP_TEST_EQUAL(counters->calls(op::read), 2u);
+        UP_TEST_TRUE(counters->wait_time() >= 10ms);
+        server.shutdown(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(counters->calls(op::write), 1u);
+    };
+
+    auto make_file(const std::string& data)
+    {
+        auto file = up::fs::file(up::fs::file::memory, up::fs::context("test"), "send-file");
+        file.write_all(up::chunk::from(data), 0);
+        return file;
+    }
+
+    auto receive(const up::stream& stream, std::size_t size)
+    {
+        std::string result(size, '\0');
+        for (std::size_t offset = 0; offset != size; ) {
+            offset += stream.read_some({&result[offset], size - offset}, up::stream::deadline_patience(5s));
+        }
+        return result;
+    }
+
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        auto data = std::string(1 << 17, 'x') + "tail";
+        auto file = make_file(data);
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(1);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s));
+        auto server = listener.accept(up::stream::deadline_patience(5s));
+        // sendfile (larger than the socket buffer, so it would block)
+        std::string received;
+        std::thread reader([&]() noexcept { received = receive(client, data.size() - 3); });
+        server.send_file(file, 3, data.size() - 3, up::stream::deadline_patience(5s));
+        reader.join();
+        UP_TEST_TRUE(received == data.substr(3));
+        bool truncated = false;
+        try {
+            server.send_file(file, off_t(data.size()) - 2, 4, up::stream::deadline_patience(5s));
+        } catch (...) {
+            truncated = true;
+        }
+        UP_TEST_TRUE(truncated);
+    };
+
+    UP_TEST_CASE {
+        // status of the engine transfers
+        using op = up::stream::patience::operation;
+        using status = up::stream::engine::status;
+        UP_TEST_TRUE(status(5).done());
+        UP_TEST_EQUAL(status(5).count(), 5u);
+        UP_TEST_EQUAL(status(5).get(), 5u);
+        UP_TEST_TRUE(!status::would_block(op::read).done());
+        UP_TEST_TRUE(status::would_block(op::read).blocked_on() == op::read);
+        UP_TEST_TRUE(status::would_block(op::write).blocked_on() == op::write);
+        bool unreadable = false;
+        try {
+            status::would_block(op::read).get();
+        } catch (const up::stream::engine::unreadable&) {
+            unreadable = true;
+        }
+        UP_TEST_TRUE(unreadable);
+        bool unwritable = false;
+        try {
+            status::would_block(op::write).get();
+        } catch (const up::stream::engine::unwritable&) {
+            unwritable = true;
+        }
+        UP_TEST_TRUE(unwritable);
+        // transfers of an engine (loopback)
+        auto engines = up::loopback::make_engines(4);
+        auto& writer = *engines.first;
+        auto& reader = *engines.second;
+        char buffer[8];
+        auto result = reader.try_read_some({buffer, sizeof(buffer)});
+        UP_TEST_TRUE(!result.done());
+        UP_TEST_TRUE(result.blocked_on() == op::read);
+        result = writer.try_write_some({"abcdef", 6});
+        UP_TEST_TRUE(result.done());
+        UP_TEST_EQUAL(result.count(), 4u);
+        // the loopback engines wait for their eventfd in both directions
+        UP_TEST_TRUE(!writer.try_write_some({"ef", 2}).done());
+        result = reader.try_read_some({buffer, sizeof(buffer)});
+        UP_TEST_TRUE(result.done());
+        UP_TEST_EQUAL(up::string_view(buffer, result.count()), up::string_view("abcd"));
+        // end of stream is a completed transfer without bytes
+        UP_TEST_TRUE(writer.try_shutdown().done());
+        result = reader.try_read_some({buffer, sizeof(buffer)});
+        UP_TEST_TRUE(result.done());
+        UP_TEST_EQUAL(result.count(), 0u);
+    };
+
+    UP_TEST_CASE {
+        // fallback: copied through a buffer
+        auto data = std::string(100000, 'y');
+        auto file = make_file(data);
+        auto streams = up::loopback::make_streams(1 << 17);
+        streams.first.send_file(file, 0, data.size(), up::stream::deadline_patience(5s));
+        UP_TEST_TRUE(receive(streams.second, data.size()) == data);
+    };
+
+    UP_TEST_CASE {
+        auto streams = up::loopback::make_streams(16);
+        char c;
+        auto patience = up::stream::spinning_patience(10ms);
+        patience = 20ms;
+        bool expired = false;
+        try {
+            streams.second.read_some({&c, 1}, patience);
+        } catch (const up::stream::timeout&) {
+            expired = true;
+        }
+        UP_TEST_TRUE(expired);
+        // the data arrives within the budget
+        patience = up::stream::spinning_patience(1s);
+        std::thread writer([&]() noexcept {
+                std::this_thread::sleep_for(1ms);
+                streams.first.write_some({"a", 1}, up::stream::deadline_patience(5s));
+            });
+        UP_TEST_EQUAL(streams.second.read_some({&c, 1}, patience), 1u);
+        writer.join();
+        UP_TEST_EQUAL(patience.spun(), 1u);
+        UP_TEST_EQUAL(patience.slept(), 0u);
+        // the data arrives too late, so the budget is reduced
+        patience = up::stream::spinning_patience(1ms);
+        writer = std::thread([&]() noexcept {
+                std::this_thread::sleep_for(50ms);
+                streams.first.write_some({"b", 1}, up::stream::deadline_patience(5s));
+            });
+        UP_TEST_EQUAL(streams.second.read_some({&c, 1}, patience), 1u);
+        writer.join();
+        UP_TEST_EQUAL(c, 'b');
+        UP_TEST_EQUAL(patience.slept(), 1u);
+        UP_TEST_TRUE(patience.budget() < 1ms);
+    };
+
+}
@@ -0,0 +1,49 @@
+#include "up_test.hpp"
+#include "up_timer_wheel.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    UP_TEST_CASE {
+        up::timer_wheel wheel;
+        auto start = up::steady_clock::now();
+        int trace = 0;
+        up::timer_wheel::timer a([&]() { trace = trace * 10 + 1; });
+        up::timer_wheel::timer b([&]() { trace = trace * 10 + 2; });
+        up::timer_wheel::timer c([&]() { trace = trace * 10 + 3; });
+        a.arm(wheel, start + 5ms);
+        b.arm(wheel, start + 2h);
+        c.arm(wheel, start + 300ms);
+        UP_TEST_EQUAL(wheel.size(), 3u);
+        UP_TEST_TRUE(wheel.next_expiry() <= start + 6ms);
+        UP_TEST_EQUAL(wheel.advance(start + 4ms), 0u);
+        UP_TEST_EQUAL(wheel.advance(start + 6ms), 1u);
+        UP_TEST_EQUAL(wheel.advance(start + 299ms), 0u);
+        UP_TEST_EQUAL(wheel.advance(start + 301ms), 1u);
+        UP_TEST_EQUAL(wheel.advance(start + 2h - 1ms), 0u);
+        UP_TEST_EQUAL(wheel.advance(start + 2h + 1ms), 1u);
+        UP_TEST_EQUAL(trace, 132);
+        UP_TEST_TRUE(wheel.empty());
+        UP_TEST_TRUE(wheel.next_expiry() == up::steady_time_point::max());
+    };
+
+    UP_TEST_CASE {
+        up::timer_wheel wheel;
+        auto start = up::steady_clock::now();
+        std::size_t count = 0;
+        up::timer_wheel::timer a([&]() { ++count; });
+        up::timer_wheel::timer b([&]() { ++count; });
+        a.arm(wheel, start + 50ms);
+        a.arm(wheel, start + 200ms); // re-arm (e.g. on activity)
+        b.arm(wheel, start + 10ms);
+        b.cancel();
+        UP_TEST_EQUAL(wheel.size(), 1u);
+        UP_TEST_EQUAL(wheel.advance(start + 100ms), 0u);
+        UP_TEST_EQUAL(wheel.advance(start + 201ms), 1u);
+        UP_TEST_EQUAL(count, 1u);
+        UP_TEST_TRUE(!a.armed());
+    };
+
+}
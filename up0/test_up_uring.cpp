@@ -0,0 +1,125 @@
+#include "up_inet.hpp"
+#include "up_reactor.hpp"
+#include "up_test.hpp"
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    auto make_endpoint()
+    {
+        return up::tcp::endpoint(up::ipv4::endpoint::loopback, up::tcp::port(47615));
+    }
+
+    // works with and without io_uring support (fallback)
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::uring ring(4, 2);
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(4);
+        auto client = up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s), ring);
+        auto server = listener.accept(up::stream::deadline_patience(5s), ring);
+        client.write_all({"hello", 5}, up::stream::deadline_patience(5s));
+        char buffer[16];
+        std::size_t count = 0;
+        while (count != 5) {
+            count += server.read_some({buffer + count, sizeof(buffer) - count}, up::stream::deadline_patience(5s));
+        }
+        UP_TEST_EQUAL(up::string_view(buffer, count), up::string_view("hello"));
+        client.shutdown(up::stream::deadline_patience(5s));
+        UP_TEST_EQUAL(server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s)), 0u);
+    };
+
+    // channels are recycled, and exhausted rings fall back to regular transfers
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::uring ring(1, 1);
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(4);
+        for (int i = 0; i != 3; ++i) {
+            auto first = up::tcp::socket(up::ip::version::v4)
+                .connect(make_endpoint(), up::stream::deadline_patience(5s), ring);
+            auto second = listener.accept(up::stream::deadline_patience(5s), ring);
+            second.write_all({"x", 1}, up::stream::deadline_patience(5s));
+            char c = 0;
+            UP_TEST_EQUAL(first.read_some({&c, 1}, up::stream::deadline_patience(5s)), 1u);
+            UP_TEST_EQUAL(c, 'x');
+        }
+    };
+
+    // pending writes are completed when the connection is destroyed
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::uring ring(4, 2);
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(4);
+        auto client = up::make_optional(up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s), ring));
+        auto server = listener.accept_basic(up::stream::deadline_patience(5s));
+        // more than the send buffer of the channel
+        auto data = std::string(100000, 'x');
+        client->write_all(up::chunk::from(data), up::stream::deadline_patience(5s));
+        client = up::nullopt;
+        char buffer[1 << 14];
+        std::size_t total = 0;
+        try {
+            while (auto count = server.read_some({buffer, sizeof(buffer)}, up::stream::deadline_patience(5s))) {
+                total += count;
+            }
+        } catch (...) {
+            // reset after the data
+        }
+        UP_TEST_EQUAL(total, data.size());
+    };
+
+    // the release of a channel does not wait forever for a peer, that does not read
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::uring ring(1, 2);
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(4);
+        auto client = up::make_optional(up::tcp::socket(up::ip::version::v4)
+            .connect(make_endpoint(), up::stream::deadline_patience(5s), ring));
+        auto server = listener.accept_basic(up::stream::deadline_patience(5s));
+        auto data = std::string(1 << 16, 'x');
+        try {
+            for (;;) {
+                client->write_all(up::chunk::from(data), up::stream::deadline_patience(200ms));
+            }
+        } catch (const up::stream::timeout&) {
+            // the socket buffers are full
+        }
+        auto started = up::steady_clock::now();
+        client = up::nullopt;
+        UP_TEST_TRUE(up::steady_clock::now() - started < 2s);
+    };
+
+    // several channels of the same ring can be waited for at the same time
+    UP_TEST_CASE {
+        using o = up::tcp::socket::option;
+        up::uring ring(1, 4);
+        auto listener = up::tcp::socket(make_endpoint(), {o::reuseaddr}).listen(4);
+        std::vector<up::tcp::connection> clients;
+        std::vector<up::tcp::connection> servers;
+        for (int i = 0; i != 2; ++i) {
+            clients.push_back(up::tcp::socket(up::ip::version::v4)
+                .connect(make_endpoint(), up::stream::deadline_patience(5s)));
+            servers.push_back(listener.accept(up::stream::deadline_patience(5s), ring));
+        }
+        up::reactor reactor;
+        std::size_t received = 0;
+        for (auto&& server : servers) {
+            reactor.spawn([&reactor, &server, &received]() {
+                    up::reactor::patience patience(reactor, 5s);
+                    char c = 0;
+                    received += server.read_some({&c, 1}, patience);
+                });
+        }
+        reactor.spawn([&clients]() {
+                for (auto&& client : clients) {
+                    client.write_all({"x", 1}, up::stream::deadline_patience(5s));
+                }
+            });
+        reactor.run();
+        UP_TEST_EQUAL(received, 2u);
+    };
+
+}
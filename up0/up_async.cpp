@@ -0,0 +1,122 @@
+#include "up_async.hpp"
+
+#include "up_exception.hpp"
+
+
+auto up_async::async::read_some(
+    up::reactor& reactor,
+    const up::stream& stream,
+    up::chunk::into chunk,
+    const up::steady_time_point& expires_at)
+    -> awaitable<read_some_operation>
+{
+    return awaitable<read_some_operation>(reactor, expires_at, read_some_operation(stream, std::move(chunk)));
+}
+
+auto up_async::async::write_some(
+    up::reactor& reactor,
+    const up::stream& stream,
+    up::chunk::from chunk,
+    const up::steady_time_point& expires_at)
+    -> awaitable<write_some_operation>
+{
+    return awaitable<write_some_operation>(reactor, expires_at, write_some_operation(stream, std::move(chunk)));
+}
+
+auto up_async::async::write_all(
+    up::reactor& reactor,
+    const up::stream& stream,
+    up::chunk::from chunk,
+    const up::steady_time_point& expires_at)
+    -> awaitable<write_all_operation>
+{
+    return awaitable<write_all_operation>(reactor, expires_at, write_all_operation(stream, std::move(chunk)));
+}
+
+auto up_async::async::accept(
+    up::reactor& reactor,
+    up::tcp::listener& listener,
+    const up::steady_time_point& expires_at)
+    -> awaitable<accept_operation>
+{
+    return awaitable<accept_operation>(reactor, expires_at, accept_operation(listener));
+}
+
+auto up_async::async::connect(
+    up::reactor& reactor,
+    up::tcp::socket&& socket,
+    const up::tcp::endpoint& remote,
+    const up::steady_time_point& expires_at)
+    -> awaitable<connect_operation>
+{
+    return awaitable<connect_operation>(reactor, expires_at, connect_operation(std::move(socket), remote));
+}
+
+auto up_async::async::resolve_endpoints(
+    up::reactor& reactor,
+    up::resolver& resolver,
+    const up::string_view& name,
+    const up::steady_time_point& expires_at)
+    -> awaitable<resolve_endpoints_operation>
+{
+    return awaitable<resolve_endpoints_operation>(reactor, expires_at,
+        resolve_endpoints_operation(resolver.lookup(name)));
+}
+
+void up_async::async::raise_timeout(operation op, const up::steady_time_point& expires_at)
+{
+    throw up::make_exception("async-operation-timeout", up::stream::timeout()).with(op, expires_at);
+}
+
+
+bool up_async::async::read_some_operation::attempt()
+{
+    _status = _stream->try_read_some(_chunk);
+    return _status.done();
+}
+
+
+bool up_async::async::write_some_operation::attempt()
+{
+    _status = _stream->try_write_some(_chunk);
+    return _status.done();
+}
+
+
+bool up_async::async::write_all_operation::attempt()
+{
+    /* See stream::write_all regarding the do-while loop. */
+    do {
+        _status = _stream->try_write_some(_chunk);
+        if (!_status.done()) {
+            return false;
+        }
+        _chunk.drain(_status.count());
+    } while (_chunk.size());
+    return true;
+}
+
+
+bool up_async::async::accept_operation::attempt()
+{
+    _connection = _listener->try_accept();
+    return bool(_connection);
+}
+
+auto up_async::async::accept_operation::result() -> up::tcp::connection
+{
+    return std::move(*_connection);
+}
+
+
+bool up_async::async::connect_operation::attempt()
+{
+    return _socket.try_connect(_remote);
+}
+
+auto up_async::async::connect_operation::result() -> up::tcp::connection
+{
+    // completes immediately, because the connection has been established
+    return std::move(_socket).connect(_remote, up::stream::infinite_patience());
+}
+
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <exception>
+
+#include "up_inet.hpp"
+#include "up_reactor.hpp"
+#include "up_resolver.hpp"
+
+namespace up_async
+{
+
+    /**
+     * Awaitable stream and socket operations on top of the reactor.
+     *
+     * The factory functions return awaitables, which implement the protocol
+     * required by C++20 coroutines (await_ready, await_suspend and
+     * await_resume). That means they can be used with co_await from any
+     * coroutine type, that resumes on the thread running the reactor.
+     * Alternatively, then can be used to register a completion callback,
+     * which does not require coroutine support from the compiler.
+     *
+     * An operation is first attempted without waiting. Only if it would
+     * block, a one-shot watch is registered on the reactor, and the operation
+     * is attempted again when the native handle has become ready. The
+     * deadline is absolute and shared by all waits of the operation, similar
+     * to stream::deadline_patience. When it has expired, stream::timeout is
+     * raised from await_resume.
+     *
+     * The referenced reactor, streams, listeners and chunks must outlive the
+     * awaitables. An awaitable must not be moved while it is suspended.
+     */
+    class async final
+    {
+    public: // --- scope ---
+        using self = async;
+        using operation = up::stream::patience::operation;
+        template <typename Operation>
+        class awaitable;
+        class read_some_operation;
+        class write_some_operation;
+        class write_all_operation;
+        class accept_operation;
+        class connect_operation;
+        class resolve_endpoints_operation;
+        static auto read_some(
+            up::reactor& reactor,
+            const up::stream& stream,
+            up::chunk::into chunk,
+            const up::steady_time_point& expires_at = up::steady_time_point::max())
+            -> awaitable<read_some_operation>;
+        static auto write_some(
+            up::reactor& reactor,
+            const up::stream& stream,
+            up::chunk::from chunk,
+            const up::steady_time_point& expires_at = up::steady_time_point::max())
+            -> awaitable<write_some_operation>;
+        // result is the number of written bytes (i.e. the size of the chunk)
+        static auto write_all(
+            up::reactor& reactor,
+            const up::stream& stream,
+            up::chunk::from chunk,
+            const up::steady_time_point& expires_at = up::steady_time_point::max())
+            -> awaitable<write_all_operation>;
+        static auto accept(
+            up::reactor& reactor,
+            up::tcp::listener& listener,
+            const up::steady_time_point& expires_at = up::steady_time_point::max())
+            -> awaitable<accept_operation>;
+        static auto connect(
+            up::reactor& reactor,
+            up::tcp::socket&& socket,
+            const up::tcp::endpoint& remote,
+            const up::steady_time_point& expires_at = up::steady_time_point::max())
+            -> awaitable<connect_operation>;
+        // the lookup is started immediately (see resolver::lookup)
+        static auto resolve_endpoints(
+            up::reactor& reactor,
+            up::resolver& resolver,
+            const up::string_view& name,
+            const up::steady_time_point& expires_at = up::steady_time_point::max())
+            -> awaitable<resolve_endpoints_operation>;
+        [[noreturn]]
+        static void raise_timeout(operation op, const up::steady_time_point& expires_at);
+    };
+
+
+    /**
+     * The operation is a small class with the following members: attempt
+     * returns true if the operation has been completed, and result returns
+     * the result of a completed operation. get_native_handle and blocked_on
+     * describe what to wait for, if the last attempt would have blocked.
+     */
+    template <typename Operation>
+    class async::awaitable final
+    {
+    public: // --- scope ---
+        using self = awaitable;
+        using result_type = decltype(std::declval<Operation&>().result());
+    private: // --- state ---
+        up::reactor* _reactor;
+        up::steady_time_point _expires_at;
+        Operation _operation;
+        std::exception_ptr _exception;
+        bool _expired = false;
+    public: // --- life ---
+        explicit awaitable(up::reactor& reactor, const up::steady_time_point& expires_at, Operation&& operation)
+            : _reactor(&reactor), _expires_at(expires_at), _operation(std::move(operation))
+        { }
+        awaitable(const self& rhs) = delete;
+        awaitable(self&& rhs) noexcept = default;
+        ~awaitable() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        bool await_ready()
+        {
+            return _attempt();
+        }
+        // the handle is usually a std::coroutine_handle
+        template <typename Handle>
+        void await_suspend(Handle handle)
+        {
+            // small capture, so that std::function needs no allocation
+            _suspend([handle]() mutable { handle.resume(); });
+        }
+        // raises stream::timeout if the deadline has expired
+        auto await_resume() -> result_type
+        {
+            if (_exception) {
+                std::rethrow_exception(std::exchange(_exception, nullptr));
+            } else if (_expired) {
+                raise_timeout(_operation.blocked_on(), _expires_at);
+            } else {
+                return _operation.result();
+            }
+        }
+        /* The callback is invoked with a reference to the awaitable, either
+         * immediately or from the reactor. It should obtain the result with
+         * await_resume. */
+        template <typename Callback>
+        void then(Callback&& callback) &&
+        {
+            using state = std::pair<self, std::decay_t<Callback>>;
+            auto&& ptr = std::make_shared<state>(std::move(*this), std::forward<Callback>(callback));
+            if (ptr->first._attempt()) {
+                ptr->second(ptr->first);
+            } else {
+                ptr->first._suspend([ptr]() { ptr->second(ptr->first); });
+            }
+        }
+    private:
+        // returns true if the awaitable can be resumed
+        bool _attempt()
+        {
+            try {
+                return _operation.attempt();
+            } catch (...) {
+                _exception = std::current_exception();
+                return true;
+            }
+        }
+        template <typename Resume>
+        void _suspend(Resume&& resume)
+        {
+            _reactor->watch(
+                _operation.get_native_handle(), _operation.blocked_on(), _expires_at,
+                [this, resume=std::forward<Resume>(resume)](bool expired) mutable {
+                    if (expired) {
+                        _expired = true;
+                        resume();
+                    } else if (_attempt()) {
+                        resume();
+                    } else {
+                        _suspend(std::move(resume));
+                    }
+                });
+        }
+    };
+
+
+    class async::read_some_operation final
+    {
+    private: // --- state ---
+        const up::stream* _stream;
+        up::chunk::into _chunk;
+        up::stream::engine::status _status = std::size_t(0);
+    public: // --- life ---
+        explicit read_some_operation(const up::stream& stream, up::chunk::into chunk)
+            : _stream(&stream), _chunk(std::move(chunk))
+        { }
+    public: // --- operations ---
+        bool attempt();
+        auto result() const { return _status.count(); }
+        auto get_native_handle() const { return _stream->get_native_handle(); }
+        auto blocked_on() const { return _status.blocked_on(); }
+    };
+
+
+    class async::write_some_operation final
+    {
+    private: // --- state ---
+        const up::stream* _stream;
+        up::chunk::from _chunk;
+        up::stream::engine::status _status = std::size_t(0);
+    public: // --- life ---
+        explicit write_some_operation(const up::stream& stream, up::chunk::from chunk)
+            : _stream(&stream), _chunk(std::move(chunk))
+        { }
+    public: // --- operations ---
+        bool attempt();
+        auto result() const { return _status.count(); }
+        auto get_native_handle() const { return _stream->get_native_handle(); }
+        auto blocked_on() const { return _status.blocked_on(); }
+    };
+
+
+    class async::write_all_operation final
+    {
+    private: // --- state ---
+        const up::stream* _stream;
+        up::chunk::from _chunk;
+        std::size_t _total;
+        up::stream::engine::status _status = std::size_t(0);
+    public: // --- life ---
+        explicit write_all_operation(const up::stream& stream, up::chunk::from chunk)
+            : _stream(&stream), _chunk(std::move(chunk)), _total(_chunk.size())
+        { }
+    public: // --- operations ---
+        bool attempt();
+        auto result() const { return _total; }
+        auto get_native_handle() const { return _stream->get_native_handle(); }
+        auto blocked_on() const { return _status.blocked_on(); }
+    };
+
+
+    class async::accept_operation final
+    {
+    private: // --- state ---
+        up::tcp::listener* _listener;
+        up::optional<up::tcp::connection> _connection;
+    public: // --- life ---
+        explicit accept_operation(up::tcp::listener& listener)
+            : _listener(&listener)
+        { }
+    public: // --- operations ---
+        bool attempt();
+        auto result() -> up::tcp::connection;
+        auto get_native_handle() const { return _listener->get_native_handle(); }
+        auto blocked_on() const { return operation::read; }
+    };
+
+
+    class async::connect_operation final
+    {
+    private: // --- state ---
+        up::tcp::socket _socket;
+        up::tcp::endpoint _remote;
+    public: // --- life ---
+        explicit connect_operation(up::tcp::socket&& socket, const up::tcp::endpoint& remote)
+            : _socket(std::move(socket)), _remote(remote)
+        { }
+    public: // --- operations ---
+        bool attempt();
+        auto result() -> up::tcp::connection;
+        auto get_native_handle() const { return _socket.get_native_handle(); }
+        auto blocked_on() const { return operation::write; }
+    };
+
+
+    class async::resolve_endpoints_operation final
+    {
+    private: // --- state ---
+        up::resolver::query _query;
+    public: // --- life ---
+        explicit resolve_endpoints_operation(up::resolver::query&& query)
+            : _query(std::move(query))
+        { }
+    public: // --- operations ---
+        bool attempt() { return _query.done(); }
+        auto result() const { return _query.result(); }
+        auto get_native_handle() const { return _query.get_native_handle(); }
+        auto blocked_on() const { return operation::read; }
+    };
+
+}
+
+namespace up
+{
+
+    using up_async::async;
+
+}
@@ -0,0 +1,87 @@
+#include "up_buffered_reader.hpp"
+
+#include <cstring>
+
+#include "up_exception.hpp"
+#include "up_ints.hpp"
+
+
+up_buffered_reader::buffered_reader::buffered_reader(std::size_t read_size, std::size_t max_size)
+    : _read_size(read_size), _max_size(max_size)
+{
+    if (_read_size == 0) {
+        throw up::make_exception("invalid-buffered-reader-read-size").with(_read_size, _max_size);
+    }
+}
+
+auto up_buffered_reader::buffered_reader::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "buffered-reader",
+        up::invoke_to_insight_with_fallback(_buffer.available()),
+        up::invoke_to_insight_with_fallback(_consumed),
+        up::invoke_to_insight_with_fallback(_read_size),
+        up::invoke_to_insight_with_fallback(_max_size),
+        up::invoke_to_insight_with_fallback(_eof));
+}
+
+auto up_buffered_reader::buffered_reader::buffered() -> up::string_view
+{
+    _settle();
+    return {_buffer.warm(), _buffer.available()};
+}
+
+void up_buffered_reader::buffered_reader::_settle()
+{
+    if (_consumed) {
+        _buffer.consume(std::exchange(_consumed, 0));
+        _scanned = 0;
+    }
+}
+
+auto up_buffered_reader::buffered_reader::_find(const up::string_view& delimiter) -> std::size_t
+{
+    if (delimiter.empty()) {
+        throw up::make_exception("invalid-buffered-reader-delimiter");
+    }
+    /* The search uses memchr for the first character of the delimiter,
+     * which is vectorized by the C library. Already scanned data is skipped,
+     * so that long messages arriving in many pieces are scanned only once. */
+    auto data = _buffer.warm();
+    auto size = _buffer.available();
+    auto pos = _scanned;
+    while (pos + delimiter.size() <= size) {
+        auto p = static_cast<const char*>(std::memchr(data + pos, delimiter[0], size - pos));
+        if (p == nullptr) {
+            break;
+        }
+        pos = up::ints::cast<std::size_t>(p - data);
+        if (pos + delimiter.size() > size) {
+            break;
+        } else if (std::memcmp(p, delimiter.data(), delimiter.size()) == 0) {
+            return pos;
+        } else {
+            ++pos;
+        }
+    }
+    _scanned = size < delimiter.size() ? 0 : std::max(_scanned, size - delimiter.size() + 1);
+    return npos;
+}
+
+auto up_buffered_reader::buffered_reader::_take(std::size_t size, std::size_t consumed) -> up::string_view
+{
+    _consumed = consumed;
+    return {_buffer.warm(), size};
+}
+
+auto up_buffered_reader::buffered_reader::_truncated() -> up::optional<up::string_view>
+{
+    if (_buffer.available()) {
+        throw up::make_exception("buffered-reader-truncated-message").with(_buffer.available());
+    }
+    return up::nullopt;
+}
+
+void up_buffered_reader::buffered_reader::_raise_too_long(std::size_t size) const
+{
+    throw up::make_exception("buffered-reader-message-too-long").with(size, _max_size);
+}
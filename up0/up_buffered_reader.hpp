@@ -0,0 +1,153 @@
+#pragma once
+
+#include "up_buffer.hpp"
+#include "up_insight.hpp"
+#include "up_optional.hpp"
+#include "up_stream.hpp"
+
+namespace up_buffered_reader
+{
+
+    /**
+     * Reader for framed protocols on top of up::stream or up::basic_stream
+     * (the stream is passed to each operation). Each read from the stream
+     * fills as much of the buffer as possible, so that line- or
+     * length-framed protocols need a single syscall for many small messages.
+     *
+     * The results are views into the warm range of the buffer (no copy).
+     * They remain valid until the next operation on the reader. Operations
+     * returning an optional return nothing on end-of-stream at a message
+     * boundary. End-of-stream within a message raises an exception.
+     */
+    class buffered_reader final
+    {
+    public: // --- scope ---
+        using self = buffered_reader;
+        using patience = up::stream::patience;
+        static const constexpr std::size_t npos = std::size_t(-1);
+    private: // --- state ---
+        up::buffer _buffer;
+        std::size_t _read_size;
+        std::size_t _max_size;
+        std::size_t _consumed = 0; // size of the previous result (consumed lazily)
+        std::size_t _scanned = 0; // prefix of the warm range without delimiter
+        bool _eof = false;
+    public: // --- life ---
+        /* The read size is the minimal space reserved for each read. Messages
+         * longer than the maximal size are rejected. */
+        explicit buffered_reader(std::size_t read_size = 1 << 14, std::size_t max_size = 1 << 20);
+        buffered_reader(const self& rhs) = delete;
+        buffered_reader(self&& rhs) noexcept = default;
+        ~buffered_reader() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_buffer, rhs._buffer);
+            up::swap_noexcept(_read_size, rhs._read_size);
+            up::swap_noexcept(_max_size, rhs._max_size);
+            up::swap_noexcept(_consumed, rhs._consumed);
+            up::swap_noexcept(_scanned, rhs._scanned);
+            up::swap_noexcept(_eof, rhs._eof);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        // buffered data, that has not been returned yet (never reads)
+        auto buffered() -> up::string_view;
+        /* Returns the buffered data, reading from the stream only if nothing
+         * is buffered. The result is empty on end-of-stream. Nothing is
+         * consumed. */
+        template <typename Stream>
+        auto peek(const Stream& stream, patience& patience) -> up::string_view
+        {
+            _settle();
+            if (_buffer.available() == 0) {
+                _fill(stream, patience);
+            }
+            return {_buffer.warm(), _buffer.available()};
+        }
+        template <typename Stream>
+        auto peek(const Stream& stream, patience&& patience) -> up::string_view
+        {
+            return peek(stream, patience);
+        }
+        template <typename Stream>
+        auto read_exact(const Stream& stream, std::size_t n, patience& patience) -> up::optional<up::string_view>
+        {
+            _settle();
+            if (n > _max_size) {
+                _raise_too_long(n);
+            }
+            while (_buffer.available() < n) {
+                if (!_fill(stream, patience)) {
+                    return _truncated();
+                }
+            }
+            return _take(n, n);
+        }
+        template <typename Stream>
+        auto read_exact(const Stream& stream, std::size_t n, patience&& patience) -> up::optional<up::string_view>
+        {
+            return read_exact(stream, n, patience);
+        }
+        // the result does not contain the delimiter (but it is consumed)
+        template <typename Stream>
+        auto read_until(const Stream& stream, const up::string_view& delimiter, patience& patience)
+            -> up::optional<up::string_view>
+        {
+            _settle();
+            for (;;) {
+                auto pos = _find(delimiter);
+                if (pos != npos) {
+                    return _take(pos, pos + delimiter.size());
+                } else if (_buffer.available() > _max_size) {
+                    _raise_too_long(_buffer.available());
+                } else if (!_fill(stream, patience)) {
+                    return _truncated();
+                }
+            }
+        }
+        template <typename Stream>
+        auto read_until(const Stream& stream, const up::string_view& delimiter, patience&& patience)
+            -> up::optional<up::string_view>
+        {
+            return read_until(stream, delimiter, patience);
+        }
+    private:
+        void _settle();
+        // returns npos if not found (remembers the scanned prefix)
+        auto _find(const up::string_view& delimiter) -> std::size_t;
+        auto _take(std::size_t size, std::size_t consumed) -> up::string_view;
+        // returns nothing on end-of-stream at a message boundary
+        auto _truncated() -> up::optional<up::string_view>;
+        [[noreturn]]
+        void _raise_too_long(std::size_t size) const;
+        // returns false on end-of-stream
+        template <typename Stream>
+        bool _fill(const Stream& stream, patience& patience)
+        {
+            if (_eof) {
+                return false;
+            }
+            auto count = stream.read_some(_buffer.reserve(_read_size), patience);
+            if (count == 0) {
+                _eof = true;
+                return false;
+            }
+            _buffer.produce(count);
+            return true;
+        }
+    };
+
+}
+
+namespace up
+{
+
+    using up_buffered_reader::buffered_reader;
+
+}
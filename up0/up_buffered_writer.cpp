@@ -0,0 +1,30 @@
+#include "up_buffered_writer.hpp"
+
+#include <cstring>
+
+#include "up_exception.hpp"
+
+
+up_buffered_writer::buffered_writer::buffered_writer(std::size_t flush_size)
+    : _flush_size(flush_size)
+{
+    if (_flush_size == 0) {
+        throw up::make_exception("invalid-buffered-writer-flush-size").with(_flush_size);
+    }
+}
+
+auto up_buffered_writer::buffered_writer::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "buffered-writer",
+        up::invoke_to_insight_with_fallback(_buffer.available()),
+        up::invoke_to_insight_with_fallback(_flush_size),
+        up::invoke_to_insight_with_fallback(_corked));
+}
+
+void up_buffered_writer::buffered_writer::_append(const up::chunk::from& chunk)
+{
+    if (chunk.size()) {
+        std::memcpy(_buffer.reserve(chunk.size()).cold(), chunk.data(), chunk.size());
+        _buffer.produce(chunk.size());
+    }
+}
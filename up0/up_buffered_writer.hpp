@@ -0,0 +1,129 @@
+#pragma once
+
+#include "up_buffer.hpp"
+#include "up_detection_idiom.hpp"
+#include "up_insight.hpp"
+#include "up_stream.hpp"
+
+namespace up_buffered_writer
+{
+
+    /**
+     * Writer, that batches small writes on top of up::stream or
+     * up::basic_stream (the stream is passed to each operation). Chunks are
+     * copied into a buffer, and they are sent with a single syscall on
+     * flush, which should be called at each message boundary. Chunks larger
+     * than the flush size are not copied. They are sent together with the
+     * buffered data as a single bulk write (sendmsg).
+     *
+     * If the buffer has to be sent before the message is complete, the
+     * stream is corked (if it supports that, e.g. tcp::connection), so that
+     * the kernel does not send partial segments. It is uncorked by the next
+     * flush. Messages, that fit into the buffer, are never corked.
+     */
+    class buffered_writer final
+    {
+    public: // --- scope ---
+        using self = buffered_writer;
+        using patience = up::stream::patience;
+    private:
+        template <typename Stream>
+        using direct_cork_t = decltype(std::declval<const Stream&>().cork(true));
+        template <typename Stream>
+        using engine_cork_t = decltype(std::declval<const Stream&>().get_engine().cork(true));
+    private: // --- state ---
+        up::buffer _buffer;
+        std::size_t _flush_size;
+        bool _corked = false;
+    public: // --- life ---
+        explicit buffered_writer(std::size_t flush_size = 1 << 16);
+        buffered_writer(const self& rhs) = delete;
+        buffered_writer(self&& rhs) noexcept = default;
+        ~buffered_writer() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_buffer, rhs._buffer);
+            up::swap_noexcept(_flush_size, rhs._flush_size);
+            up::swap_noexcept(_corked, rhs._corked);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        // size of the buffered (not yet sent) data
+        auto buffered() const -> std::size_t { return _buffer.available(); }
+        template <typename Stream>
+        void write(const Stream& stream, up::chunk::from chunk, patience& patience)
+        {
+            if (_buffer.available() + chunk.size() <= _flush_size) {
+                _append(chunk);
+            } else {
+                // the message continues, so partial segments are held back
+                _cork(stream, true);
+                if (chunk.size() < _flush_size) {
+                    _send(stream, patience);
+                    _append(chunk);
+                } else if (_buffer.available()) {
+                    stream.write_all(up::chunk::from_bulk(up::chunk::from(_buffer), chunk), patience);
+                    _buffer.consume(_buffer.available());
+                } else {
+                    stream.write_all(chunk, patience);
+                }
+            }
+        }
+        template <typename Stream>
+        void write(const Stream& stream, up::chunk::from chunk, patience&& patience)
+        {
+            write(stream, chunk, patience);
+        }
+        // sends all buffered data (at the end of a message)
+        template <typename Stream>
+        void flush(const Stream& stream, patience& patience)
+        {
+            _send(stream, patience);
+            if (_corked) {
+                _cork(stream, false);
+            }
+        }
+        template <typename Stream>
+        void flush(const Stream& stream, patience&& patience)
+        {
+            flush(stream, patience);
+        }
+    private:
+        void _append(const up::chunk::from& chunk);
+        template <typename Stream>
+        void _send(const Stream& stream, patience& patience)
+        {
+            if (_buffer.available()) {
+                stream.write_all(_buffer, patience);
+                _buffer.consume(_buffer.available());
+            }
+        }
+        template <typename Stream>
+        void _cork(const Stream& stream, bool enabled)
+        {
+            if (_corked == enabled) {
+                // nothing
+            } else if constexpr (up::is_detected<direct_cork_t, Stream>::value) {
+                stream.cork(enabled);
+                _corked = enabled;
+            } else if constexpr (up::is_detected<engine_cork_t, Stream>::value) {
+                stream.get_engine().cork(enabled);
+                _corked = enabled;
+            } // else: not supported by the stream
+        }
+    };
+
+}
+
+namespace up
+{
+
+    using up_buffered_writer::buffered_writer;
+
+}
@@ -7,7 +7,6 @@ auto up_chunk::chunk::into::drain(std::size_t n) -> std::size_t
 {
     if (n >= _size) {
         _data += _size;
-        _size = 0;
         return n - std::exchange(_size, 0);
     } else {
         _data += n;
@@ -55,7 +54,6 @@ auto up_chunk::chunk::from::drain(std::size_t n) -> std::size_t
 {
     if (n >= _size) {
         _data += _size;
-        _size = 0;
         return n - std::exchange(_size, 0);
     } else {
         _data += n;
@@ -1562,6 +1562,19 @@ up_fs::fs::file::file(memory_t, context context, const up::string_view& name)
     _impl = std::make_shared<const impl>(handle(c->memfd_create(up::nts(name), 0)), std::move(c));
 }
 
+up_fs::fs::file::file(adopt_t, context context, int fd)
+    : _impl(nullptr)
+{
+    auto adopted = handle(fd);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw up::make_exception("fs-file-adopt-error").with(fd, up::errno_info(errno));
+    } else if (S_ISDIR(st.st_mode)) {
+        throw up::make_exception("fs-file-adopt-directory").with(fd);
+    }
+    _impl = std::make_shared<const impl>(std::move(adopted), context::accessor::get_impl(std::move(context)));
+}
+
 up_fs::fs::file::operator object() const
 {
     return object(object::init{_impl});
@@ -1708,6 +1721,11 @@ auto up_fs::fs::file::make_channel() const -> channel
     return channel(channel::init{up::impl_make(_impl)});
 }
 
+auto up_fs::fs::file::get_native_handle() const -> int
+{
+    return _impl->fd();
+}
+
 
 class up_fs::fs::file::lock::impl final
 {
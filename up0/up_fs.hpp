@@ -1,30 +1,13 @@
 #pragma once
 
 #include "up_chunk.hpp"
+#include "up_fs_fwd.hpp"
 #include "up_impl_ptr.hpp"
 #include "up_utility.hpp"
 
 namespace up_fs
 {
 
-    // namespace for file-system library
-    class fs final
-    {
-    public: // --- scope ---
-        enum class kind : uint8_t;
-        class stats;
-        class statfs;
-        class directory_entry;
-        class context;
-        class origin;
-        class location;
-        class object;
-        class locked_file;
-        class file;
-        class directory;
-    };
-
-
     /**
      * Different types of unix files. Every type not explicitly listed will
      * be treated as unknown, to make the code future proof.
@@ -306,6 +289,8 @@ namespace up_fs
         using options = up::enum_set<option>;
         enum class memory_t { };
         static constexpr const memory_t memory = memory_t();
+        enum class adopt_t { };
+        static constexpr const adopt_t adopt = adopt_t();
         class lock;
         class channel;
     private: // --- state ---
@@ -313,6 +298,9 @@ namespace up_fs
     public: // --- life ---
         explicit file(const location& location, options options);
         explicit file(memory_t, context context, const up::string_view& name);
+        /* Takes over an open file descriptor, e.g. received from another
+         * process (see local::connection). It is closed on failure. */
+        explicit file(adopt_t, context context, int fd);
         file(const self& rhs) = delete;
         file(self&& rhs) noexcept = default;
         ~file() noexcept = default;
@@ -350,6 +338,8 @@ namespace up_fs
         void linkto(const location& target) const;
         auto acquire_lock(bool exclusive, bool blocking = true) const -> lock;
         auto make_channel() const -> channel;
+        // descriptor owned by the file (e.g. for up::stream::send_file)
+        auto get_native_handle() const -> int;
     };
 
 
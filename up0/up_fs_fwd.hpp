@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * Declarations of the file-system library (see up_fs.hpp), e.g. for headers
+ * that only refer to the types in signatures.
+ */
+
+#include <cstdint>
+
+namespace up_fs
+{
+
+    // namespace for file-system library
+    class fs final
+    {
+    public: // --- scope ---
+        enum class kind : uint8_t;
+        class stats;
+        class statfs;
+        class directory_entry;
+        class context;
+        class origin;
+        class location;
+        class object;
+        class locked_file;
+        class file;
+        class directory;
+    };
+
+}
+
+namespace up
+{
+
+    using up_fs::fs;
+
+}
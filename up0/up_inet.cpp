@@ -1,13 +1,22 @@
 #include "up_inet.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include "up_defer.hpp"
@@ -697,21 +706,24 @@ namespace
     }
 
 
-    auto make_tcp_endpoint(const sockaddr_storage* addr, socklen_t length)
+    template <typename Protocol>
+    auto make_endpoint(const sockaddr_storage* addr, socklen_t length)
     {
+        using endpoint = typename Protocol::endpoint;
+        using port = typename Protocol::port;
         auto l = up::from_underlying_type<address_length>(length);
         if (length > sizeof(*addr)) {
             throw up::make_exception("invalid-endpoint-address-size")
                 .with(l, up::from_underlying_type<address_length>(sizeof(*addr)));
         } else if (addr->ss_family == AF_INET) {
             auto* a = get_sockaddr<sockaddr_in>(addr, address_family::v4, l);
-            auto p = up::from_underlying_type<up_inet::tcp::port>(a->sin_port);
-            return up_inet::tcp::endpoint(
+            auto p = up::from_underlying_type<port>(byte_order_network_to_host(a->sin_port));
+            return endpoint(
                 up_inet::ipv4::endpoint(up_inet::ipv4::endpoint::init{a->sin_addr}), p);
         } else if (addr->ss_family == AF_INET6) {
             auto* a = get_sockaddr<sockaddr_in6>(addr, address_family::v6, l);
-            auto p = up::from_underlying_type<up_inet::tcp::port>(a->sin6_port);
-            return up_inet::tcp::endpoint(
+            auto p = up::from_underlying_type<port>(byte_order_network_to_host(a->sin6_port));
+            return endpoint(
                 up_inet::ipv6::endpoint(up_inet::ipv6::endpoint::init{a->sin6_addr}), p);
         } else {
             throw up::make_exception("unexpected-ip-address-family")
@@ -720,22 +732,22 @@ namespace
     }
 
 
-    template <typename Callable>
-    auto identify_tcp_endpoint(Callable&& callable, int fd)
+    template <typename Protocol, typename Callable>
+    auto identify_endpoint(Callable&& callable, int fd)
     {
         sockaddr_storage addr;
         socklen_t length = sizeof(addr);
         int rv = callable(fd, reinterpret_cast<sockaddr*>(&addr), &length);
         if (rv == 0) {
-            return make_tcp_endpoint(&addr, length);
+            return make_endpoint<Protocol>(&addr, length);
         } else {
             throw up::make_exception("endpoint-identification-error").with(up::errno_info(errno));
         }
     }
 
 
-    template <typename Callable>
-    auto with_sockaddr(const up_inet::tcp::endpoint& endpoint, Callable&& callable)
+    template <typename Endpoint, typename Callable>
+    auto with_sockaddr(const Endpoint& endpoint, Callable&& callable)
     {
         if (endpoint.address().version() == up_inet::ip::version::v4) {
             sockaddr_in sa;
@@ -756,27 +768,27 @@ namespace
             return std::forward<Callable>(callable)(
                 reinterpret_cast<const sockaddr*>(&sa), sizeof(sa));
         } else {
-            throw up::make_exception("unexpected-tcp-endpoint-ip-address-version")
+            throw up::make_exception("unexpected-endpoint-ip-address-version")
                 .with(endpoint.address().version());
         }
     }
 
-    template <typename Unavailable, typename Operation, typename... Args>
-    auto do_transfer(Operation&& operation, up::source&& source, Args&&... args) -> std::size_t
+    template <typename Operation, typename... Args>
+    auto do_transfer(up::stream::patience::operation op, Operation&& operation, up::source&& source, Args&&... args)
+        -> up::stream::engine::status
     {
         bool restarted = false;
         for (;;) {
             ssize_t rv = operation();
             if (rv != -1) {
-                return rv;
+                return std::size_t(rv);
             } else if (errno == EINTR && !restarted) {
                 /* restart: This case should not happen at all, because
                  * non-blocking sockets are used. However, one retry is
                  * supported in case it happens nevertheless. */
                 restarted = true;
             } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                throw up::make_exception(std::move(source), Unavailable())
-                    .with(std::forward<Args>(args)..., up::errno_info(errno));
+                return up::stream::engine::status::would_block(op);
             } else {
                 throw up::make_exception(std::move(source))
                     .with(std::forward<Args>(args)..., up::errno_info(errno));
@@ -814,6 +826,135 @@ auto up_inet::tcp::endpoint::to_insight() const -> up::insight
 }
 
 
+namespace
+{
+
+    /* Bookkeeping of MSG_ZEROCOPY sends. The kernel numbers the successful
+     * sends consecutively (32 bit, wrapping around), and it reports ranges
+     * of completed sends on the error queue of the socket. These ranges are
+     * usually in order, but this is not guaranteed.
+     *
+     * The notifications are signaled as POLLERR. The socket itself can not
+     * be used for waiting, because it is also readable if unread data is
+     * pending. So the bookkeeping owns an epoll instance (without events,
+     * i.e. only errors and hangups), that becomes readable only on
+     * notifications. It is created once and reused by all waits. */
+    class tcp_zerocopy final
+    {
+    public: // --- scope ---
+        using self = tcp_zerocopy;
+    private: // --- state ---
+        int _epoll_fd = -1;
+        std::size_t _threshold;
+        uint32_t _sent = 0;
+        uint32_t _completed = 0; // all sends below are completed
+        std::vector<std::pair<uint32_t, uint32_t>> _pending; // ranges after a gap
+        uint64_t _copied = 0; // completions, for which the kernel had to copy
+    public: // --- life ---
+        explicit tcp_zerocopy(int fd, std::size_t threshold)
+            : _threshold(threshold)
+        {
+            _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (_epoll_fd == -1) {
+                throw up::make_exception("tcp-zerocopy-epoll-error").with(up::errno_info(errno));
+            }
+            epoll_event event{};
+            event.events = 0;
+            event.data.fd = fd;
+            if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                int error = errno;
+                close_aux(_epoll_fd);
+                throw up::make_exception("tcp-zerocopy-epoll-error").with(fd, up::errno_info(error));
+            }
+        }
+        tcp_zerocopy(const self& rhs) = delete;
+        tcp_zerocopy(self&& rhs) noexcept = delete;
+        ~tcp_zerocopy() noexcept
+        {
+            close_aux(_epoll_fd);
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto to_insight() const -> up::insight
+        {
+            return up::insight(typeid(*this), "tcp-zerocopy",
+                up::invoke_to_insight_with_fallback(_epoll_fd),
+                up::invoke_to_insight_with_fallback(_threshold),
+                up::invoke_to_insight_with_fallback(_sent),
+                up::invoke_to_insight_with_fallback(_completed),
+                up::invoke_to_insight_with_fallback(_copied));
+        }
+        void set_threshold(std::size_t threshold) { _threshold = threshold; }
+        // readable on notifications
+        auto get_native_handle() const { return up::stream::native_handle(_epoll_fd); }
+        auto flags(std::size_t size) const -> int
+        {
+            return size >= _threshold ? MSG_ZEROCOPY : 0;
+        }
+        auto sent() const { return _sent; }
+        auto completed() const { return _completed; }
+        void add_sent() { ++_sent; }
+        bool is_completed(uint32_t sent) const { return !_below(_completed, sent); }
+        // returns true if any notification has been reaped
+        bool reap(int fd)
+        {
+            bool result = false;
+            for (;;) {
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+                msghdr msg{};
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                if (::recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return result;
+                    } else if (errno != EINTR) {
+                        throw up::make_exception("tcp-connection-zerocopy-error").with(fd, up::errno_info(errno));
+                    }
+                    continue;
+                }
+                for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                        || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                        sock_extended_err error;
+                        std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                        if (error.ee_origin == SO_EE_ORIGIN_ZEROCOPY && error.ee_errno == 0) {
+                            _complete(error.ee_info, error.ee_data, error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+                            result = true;
+                        }
+                    }
+                }
+            }
+        }
+    private:
+        // compares sequence numbers with wrap around
+        static bool _below(uint32_t lhs, uint32_t rhs)
+        {
+            return int32_t(lhs - rhs) < 0;
+        }
+        void _complete(uint32_t first, uint32_t last, bool copied)
+        {
+            _copied += copied ? last - first + 1 : 0;
+            _pending.emplace_back(first, last);
+            for (bool merged = true; merged; ) {
+                merged = false;
+                for (auto i = _pending.begin(); i != _pending.end(); ++i) {
+                    if (!_below(_completed, i->first)) {
+                        if (!_below(i->second, _completed)) {
+                            _completed = i->second + 1;
+                        }
+                        _pending.erase(i);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+    };
+
+}
+
+
 class up_inet::tcp::socket::impl final
 {
 public: // --- scope ---
@@ -823,6 +964,7 @@ public: // --- state ---
     /* Socket descriptor. It should always be non-blocking, because there is
      * no benefit in real applications for blocking sockets. */
     int _fd;
+    std::unique_ptr<tcp_zerocopy> _zerocopy; // optional (see connection::zerocopy)
 public: // --- life ---
     explicit impl(const tcp::endpoint& endpoint, ip::version version)
         : _endpoint(endpoint), _fd(-1)
@@ -880,6 +1022,12 @@ public: // --- operations ---
     }
     auto to_insight() const -> up::insight
     {
+        if (_zerocopy) {
+            return up::insight(typeid(*this), "tcp-socket-impl",
+                up::invoke_to_insight_with_fallback(_endpoint),
+                up::invoke_to_insight_with_fallback(_fd),
+                _zerocopy->to_insight());
+        }
         return up::insight(typeid(*this), "tcp-socket-impl",
             up::invoke_to_insight_with_fallback(_endpoint),
             up::invoke_to_insight_with_fallback(_fd));
@@ -904,6 +1052,119 @@ public: // --- operations ---
 };
 
 
+namespace
+{
+
+    /* Transfers of the regular path of tcp::connection. The engine of
+     * tcp::basic_connection has inlined copies (without zero-copy). */
+    struct tcp_transfers
+    {
+        using socket_impl = up_inet::tcp::socket::impl;
+        using endpoint = up_inet::tcp::endpoint;
+        using status = up::stream::engine::status;
+        static auto shutdown(const socket_impl& socket, const endpoint& remote) -> status
+        {
+            /* We only provide a way to close the sending part of the socket. It
+             * is unclear, if SHUT_RD has any use at all. At least for TCP, it
+             * seems to have no effect at all. */
+            int rv = ::shutdown(socket._fd, SHUT_WR);
+            if (rv != 0) {
+                throw up::make_exception("tcp-connection-shutdown-error")
+                    .with(remote, up::errno_info(errno));
+            } // else: ok
+            return 0;
+        }
+        static auto read_some(const socket_impl& socket, const endpoint& remote, up::chunk::into chunk) -> status
+        {
+            return do_transfer(up::stream::patience::operation::read,
+                [&]() { return ::recv(socket._fd, chunk.data(), chunk.size(), 0); },
+                "tcp-connection-read-error", remote, chunk.size());
+        }
+        static auto write_some(const socket_impl& socket, const endpoint& remote, up::chunk::from chunk) -> status
+        {
+            int flags = socket._zerocopy ? socket._zerocopy->flags(chunk.size()) : 0;
+            return zerocopy_account(socket, flags, do_transfer(up::stream::patience::operation::write,
+                [&]() {
+                    return zerocopy_fallback(flags, [&](int extra) {
+                            return ::send(socket._fd, chunk.data(), chunk.size(), MSG_NOSIGNAL | extra);
+                        });
+                },
+                "tcp-connection-write-error", remote, chunk.size()));
+        }
+        static auto read_some_bulk(const socket_impl& socket, const endpoint& remote, up::chunk::into_bulk_t& chunks) -> status
+        {
+            return do_transfer(up::stream::patience::operation::read,
+                [&]() {
+                    msghdr msg = {
+                        .msg_name = nullptr,
+                        .msg_namelen = 0,
+                        .msg_iov = chunks.as<iovec>(),
+                        .msg_iovlen = up::ints::caster(chunks.count()),
+                        .msg_control = nullptr,
+                        .msg_controllen = 0,
+                        .msg_flags = 0,
+                    };
+                    return ::recvmsg(socket._fd, &msg, 0);
+                },
+                "tcp-connection-readv-error", remote, chunks.count(), chunks.total());
+        }
+        static auto write_some_bulk(const socket_impl& socket, const endpoint& remote, up::chunk::from_bulk_t& chunks) -> status
+        {
+            int flags = socket._zerocopy ? socket._zerocopy->flags(chunks.total()) : 0;
+            return zerocopy_account(socket, flags, do_transfer(up::stream::patience::operation::write,
+                [&]() {
+                    msghdr msg = {
+                        .msg_name = nullptr,
+                        .msg_namelen = 0,
+                        .msg_iov = chunks.as<iovec>(),
+                        .msg_iovlen = up::ints::caster(chunks.count()),
+                        .msg_control = nullptr,
+                        .msg_controllen = 0,
+                        .msg_flags = 0,
+                    };
+                    return zerocopy_fallback(flags, [&](int extra) {
+                            return ::sendmsg(socket._fd, &msg, MSG_NOSIGNAL | extra);
+                        });
+                },
+                "tcp-connection-writev-error", remote, chunks.count(), chunks.total()));
+        }
+        static auto send_file(const socket_impl& socket, const endpoint& remote, int file, off_t offset, std::size_t size) -> status
+        {
+            return do_transfer(up::stream::patience::operation::write,
+                [&]() { return ::sendfile(socket._fd, file, &offset, size); },
+                "tcp-connection-sendfile-error", remote, file, offset, size);
+        }
+    private:
+        /* The kernel refuses zero-copy sends with ENOBUFS, if too many
+         * notifications are outstanding. These sends are copied instead. */
+        template <typename Send>
+        static auto zerocopy_fallback(int& flags, Send&& send) -> ssize_t
+        {
+            auto rv = send(flags);
+            if (rv == -1 && errno == ENOBUFS && flags) {
+                flags = 0;
+                rv = send(flags);
+            }
+            return rv;
+        }
+        /* Before waiting for writability, the error queue is drained, because
+         * pending notifications would wake up the patience immediately. */
+        static auto zerocopy_account(const socket_impl& socket, int flags, status status) -> up::stream::engine::status
+        {
+            if (!flags) {
+                // nothing
+            } else if (status.done()) {
+                socket._zerocopy->add_sent();
+            } else {
+                socket._zerocopy->reap(socket._fd);
+            }
+            return status;
+        }
+    };
+
+}
+
+
 class up_inet::tcp::connection::engine final : public up::stream::engine
 {
 public: // --- scope ---
@@ -911,14 +1172,17 @@ public: // --- scope ---
 public: // --- state ---
     std::shared_ptr<socket::impl> _socket;
     tcp::endpoint _remote;
+    // optional: transfers are submitted through io_uring if present
+    std::unique_ptr<up::uring::channel> _channel;
 public: // --- life ---
-    explicit engine(std::shared_ptr<socket::impl>&& socket, tcp::endpoint remote)
-        : _socket(std::move(socket)), _remote(std::move(remote))
+    explicit engine(std::shared_ptr<socket::impl>&& socket, tcp::endpoint remote, std::unique_ptr<up::uring::channel> channel = nullptr)
+        : _socket(std::move(socket)), _remote(std::move(remote)), _channel(std::move(channel))
     { }
     engine(const self& rhs) = delete;
     engine(self&& rhs) noexcept = delete;
     ~engine() noexcept override
     {
+        _channel.reset();
         if (_socket->_fd != -1) {
             _socket->hard_close(true);
         }
@@ -930,69 +1194,62 @@ public: // --- operations ---
     {
         return up::insight(typeid(*this), "tcp-connection-engine",
             up::invoke_to_insight_with_fallback(*_socket),
-            up::invoke_to_insight_with_fallback(_remote));
+            up::invoke_to_insight_with_fallback(_remote),
+            up::invoke_to_insight_with_fallback(bool(_channel)));
     }
 private:
-    void shutdown() const override
+    auto try_shutdown() const -> status override
     {
-        /* We only provide a way to close the sending part of the socket. It
-         * is unclear, if SHUT_RD has any use at all. At least for TCP, it
-         * seems to have no effect at all. */
-        int rv = ::shutdown(_socket->_fd, SHUT_WR);
-        if (rv != 0) {
-            throw up::make_exception("tcp-connection-shutdown-error")
-                .with(_remote, up::errno_info(errno));
-        } // else: ok
+        if (_channel) {
+            auto status = _channel->try_flush();
+            if (!status.done()) {
+                return status;
+            }
+        }
+        return tcp_transfers::shutdown(*_socket, _remote);
     }
     void hard_close() const override
     {
+        if (_channel) {
+            _channel->release(false);
+        }
         _socket->hard_close();
     }
-    auto read_some(up::chunk::into chunk) const -> std::size_t override
-    {
-        return do_transfer<up::stream::engine::unreadable>(
-            [&]() { return ::recv(_socket->_fd, chunk.data(), chunk.size(), 0); },
-            "tcp-connection-read-error", _remote, chunk.size());
-    }
-    auto write_some(up::chunk::from chunk) const -> std::size_t override
-    {
-        return do_transfer<up::stream::engine::unwritable>(
-            [&]() { return ::send(_socket->_fd, chunk.data(), chunk.size(), MSG_NOSIGNAL); },
-            "tcp-connection-write-error", _remote, chunk.size());
-    }
-    auto read_some_bulk(up::chunk::into_bulk_t& chunks) const -> std::size_t override
-    {
-        return do_transfer<up::stream::engine::unreadable>(
-            [&]() {
-                msghdr msg = {
-                    .msg_name = nullptr,
-                    .msg_namelen = 0,
-                    .msg_iov = chunks.as<iovec>(),
-                    .msg_iovlen = up::ints::caster(chunks.count()),
-                    .msg_control = nullptr,
-                    .msg_controllen = 0,
-                    .msg_flags = 0,
-                };
-                return ::recvmsg(_socket->_fd, &msg, 0);
-            },
-            "tcp-connection-readv-error", _remote, chunks.count(), chunks.total());
-    }
-    auto write_some_bulk(up::chunk::from_bulk_t& chunks) const -> std::size_t override
-    {
-        return do_transfer<up::stream::engine::unwritable>(
-            [&]() {
-                msghdr msg = {
-                    .msg_name = nullptr,
-                    .msg_namelen = 0,
-                    .msg_iov = chunks.as<iovec>(),
-                    .msg_iovlen = up::ints::caster(chunks.count()),
-                    .msg_control = nullptr,
-                    .msg_controllen = 0,
-                    .msg_flags = 0,
-                };
-                return ::sendmsg(_socket->_fd, &msg, MSG_NOSIGNAL);
-            },
-            "tcp-connection-writev-error", _remote, chunks.count(), chunks.total());
+    auto try_read_some(up::chunk::into chunk) const -> status override
+    {
+        if (_channel) {
+            return _channel->try_read_some(chunk);
+        }
+        return tcp_transfers::read_some(*_socket, _remote, chunk);
+    }
+    auto try_write_some(up::chunk::from chunk) const -> status override
+    {
+        if (_channel) {
+            return _channel->try_write_some(chunk);
+        }
+        return tcp_transfers::write_some(*_socket, _remote, chunk);
+    }
+    auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status override
+    {
+        if (_channel) {
+            return _channel->try_read_some_bulk(chunks);
+        }
+        return tcp_transfers::read_some_bulk(*_socket, _remote, chunks);
+    }
+    auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status override
+    {
+        if (_channel) {
+            return _channel->try_write_some_bulk(chunks);
+        }
+        return tcp_transfers::write_some_bulk(*_socket, _remote, chunks);
+    }
+    auto try_send_file(up::stream::native_handle file, off_t offset, std::size_t size) const -> status override
+    {
+        if (_channel) {
+            // the channel might have queued writes
+            return up::stream::engine::try_send_file(file, offset, size);
+        }
+        return tcp_transfers::send_file(*_socket, _remote, up::to_underlying_type(file), offset, size);
     }
     auto downgrade() -> std::unique_ptr<up::stream::engine> override
     {
@@ -1004,23 +1261,144 @@ private:
     }
     auto get_native_handle() const -> up::stream::native_handle override
     {
-        return _socket->get_native_handle();
+        return _channel ? _channel->get_native_handle() : _socket->get_native_handle();
     }
 };
 
 
+namespace
+{
+
+    /* The connection falls back to the regular transfers, if the ring is
+     * unavailable or if all its channels are in use. */
+    auto make_connection(
+        std::shared_ptr<up_inet::tcp::socket::impl>&& socket,
+        up_inet::tcp::endpoint remote,
+        up::uring* ring)
+        -> up_inet::tcp::connection
+    {
+        using engine = up_inet::tcp::connection::engine;
+        auto&& channel = ring ? ring->open(socket->get_native_handle()) : nullptr;
+        return up_inet::tcp::connection(
+            std::make_unique<engine>(std::move(socket), std::move(remote), std::move(channel)));
+    }
+
+    void apply_qos(up_inet::tcp::socket::impl& socket,
+        up_inet::tcp::connection::qos_priority priority, up_inet::tcp::connection::qos_drop drop)
+    {
+        int value = dscp_lookup(dscp_table, up::to_underlying_type(priority), up::to_underlying_type(drop));
+        socket.setsockopt(IPPROTO_IP, IP_TOS, value);
+    }
+
+    void apply_keepalive(up_inet::tcp::socket::impl& socket,
+        std::chrono::seconds idle, std::size_t probes, std::chrono::seconds interval)
+    {
+        socket.setsockopt(SOL_SOCKET, SO_KEEPALIVE, int(1));
+        socket.setsockopt(IPPROTO_TCP, TCP_KEEPIDLE, up::ints::cast<int>(idle.count()));
+        socket.setsockopt(IPPROTO_TCP, TCP_KEEPCNT, up::ints::cast<int>(probes));
+        socket.setsockopt(IPPROTO_TCP, TCP_KEEPINTVL, up::ints::cast<int>(interval.count()));
+    }
+
+    /* Returns nothing if no connection is pending. The socket impl is only
+     * allocated, if a connection has been accepted. */
+    template <typename Result, typename Callback>
+    auto try_accept_aux(
+        const up_inet::tcp::socket::impl& listener,
+        const up_inet::tcp::listener::accept_options& options,
+        Callback&& callback)
+        -> up::optional<Result>
+    {
+        for (;;) {
+            /* Note: accept can be executed by several threads. However, the
+             * implementation is not fair. A better approach is to open several
+             * sockets with SO_REUSEPORT (since linux 3.9). This is also possible
+             * with different processes. */
+            sockaddr_storage addr;
+            socklen_t length = sizeof(addr);
+            int flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            int fd = ::accept4(listener._fd, reinterpret_cast<sockaddr*>(&addr), &length, flags);
+            if (fd != -1) {
+                auto&& socket = [&]() {
+                    try {
+                        return std::make_shared<up_inet::tcp::socket::impl>(listener._endpoint, fd);
+                    } catch (...) {
+                        close_aux(fd);
+                        throw;
+                    }
+                }();
+                if (options.get_nodelay()) {
+                    socket->setsockopt(IPPROTO_TCP, TCP_NODELAY, int(1));
+                }
+                if (auto&& qos = options.get_qos()) {
+                    apply_qos(*socket, qos->first, qos->second);
+                }
+                if (auto&& keepalive = options.get_keepalive()) {
+                    apply_keepalive(*socket, keepalive->idle, keepalive->probes, keepalive->interval);
+                }
+                return callback(std::move(socket), make_endpoint<up_inet::tcp>(&addr, length));
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return { };
+            } else if (errno == EINTR) {
+                // restart
+            } else {
+                throw up::make_exception("tcp-listener-accept-error")
+                    .with(listener._endpoint, up::errno_info(errno));
+            }
+        }
+    }
+
+}
+
+
 up_inet::tcp::connection::connection(std::unique_ptr<engine> engine)
     : stream(std::move(engine))
 { }
 
+up_inet::tcp::connection::connection(basic_engine&& engine)
+    : stream(std::make_unique<connection::engine>(std::move(engine._socket), std::move(engine._remote)))
+{ }
+
+auto up_inet::tcp::connection::adopt(int fd) -> connection
+{
+    auto&& socket = [&]() {
+        try {
+            int flags = ::fcntl(fd, F_GETFL);
+            if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+                throw up::make_exception("tcp-connection-adopt-error").with(fd, up::errno_info(errno));
+            }
+            int type = 0;
+            int protocol = 0;
+            socklen_t type_length = sizeof(type);
+            socklen_t protocol_length = sizeof(protocol);
+            if (::getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_length) != 0
+                || ::getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &protocol, &protocol_length) != 0) {
+                throw up::make_exception("tcp-connection-adopt-error").with(fd, up::errno_info(errno));
+            } else if (type != SOCK_STREAM || protocol != IPPROTO_TCP) {
+                throw up::make_exception("tcp-connection-adopt-bad-socket").with(fd, type, protocol);
+            }
+            return std::make_shared<socket::impl>(identify_endpoint<tcp>(::getsockname, fd), fd);
+        } catch (...) {
+            close_aux(fd);
+            throw;
+        }
+    }();
+    auto&& remote = identify_endpoint<tcp>(::getpeername, socket->_fd);
+    return make_connection(std::move(socket), std::move(remote), nullptr);
+}
+
 auto up_inet::tcp::connection::to_insight() const -> up::insight
 {
-    return static_cast<const engine*>(get_underlying_engine())->to_insight();
+    auto&& insight = static_cast<const engine*>(get_underlying_engine())->to_insight();
+    if (auto&& counters = get_counters()) {
+        return up::insight(typeid(*this), "tcp-connection", std::move(insight), counters->to_insight());
+    } else {
+        return std::move(insight);
+    }
 }
 
 auto up_inet::tcp::connection::local() const -> tcp::endpoint
 {
-    return identify_tcp_endpoint(
+    return identify_endpoint<up_inet::tcp>(
         ::getsockname,
         static_cast<const engine*>(get_underlying_engine())->_socket->_fd);
 }
@@ -1032,17 +1410,12 @@ auto up_inet::tcp::connection::remote() const -> const tcp::endpoint&
 
 void up_inet::tcp::connection::qos(qos_priority priority, qos_drop drop) const
 {
-    int value = dscp_lookup(dscp_table, up::to_underlying_type(priority), up::to_underlying_type(drop));
-    static_cast<const engine*>(get_underlying_engine())->_socket->setsockopt(IPPROTO_IP, IP_TOS, value);
+    apply_qos(*static_cast<const engine*>(get_underlying_engine())->_socket, priority, drop);
 }
 
 void up_inet::tcp::connection::keepalive(std::chrono::seconds idle, std::size_t probes, std::chrono::seconds interval) const
 {
-    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
-    socket.setsockopt(SOL_SOCKET, SO_KEEPALIVE, int(1));
-    socket.setsockopt(IPPROTO_TCP, TCP_KEEPIDLE, up::ints::cast<int>(idle.count()));
-    socket.setsockopt(IPPROTO_TCP, TCP_KEEPCNT, up::ints::cast<int>(probes));
-    socket.setsockopt(IPPROTO_TCP, TCP_KEEPINTVL, up::ints::cast<int>(interval.count()));
+    apply_keepalive(*static_cast<const engine*>(get_underlying_engine())->_socket, idle, probes, interval);
 }
 
 auto up_inet::tcp::connection::incoming_cpu() const -> int
@@ -1051,80 +1424,622 @@ auto up_inet::tcp::connection::incoming_cpu() const -> int
     return socket.getsockopt<int>(SOL_SOCKET, SO_INCOMING_CPU);
 }
 
+auto up_inet::tcp::connection::fastopen_used() const -> bool
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    // the size of tcp_info depends on the kernel version
+    tcp_info info;
+    socklen_t length = sizeof(info);
+    if (::getsockopt(socket._fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+        throw up::make_exception("query-network-socket-option-error")
+            .with(socket._fd, IPPROTO_TCP, TCP_INFO, up::errno_info(errno));
+    } else if (length < offsetof(tcp_info, tcpi_options) + sizeof(info.tcpi_options)) {
+        throw up::make_exception("query-network-socket-option-size-mismatch")
+            .with(socket._fd, IPPROTO_TCP, TCP_INFO, sizeof(info), length);
+    }
+    return info.tcpi_options & TCPI_OPT_SYN_DATA;
+}
+
+void up_inet::tcp::connection::cork(bool enabled) const
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    socket.setsockopt(IPPROTO_TCP, TCP_CORK, int(enabled));
+}
+
+void up_inet::tcp::connection::busy_poll(std::chrono::microseconds duration) const
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    socket.setsockopt(SOL_SOCKET, SO_BUSY_POLL, up::ints::cast<int>(duration.count()));
+}
+
+void up_inet::tcp::connection::zerocopy(std::size_t threshold) const
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    if (socket._zerocopy) {
+        socket._zerocopy->set_threshold(threshold);
+    } else {
+        socket.setsockopt(SOL_SOCKET, SO_ZEROCOPY, int(1));
+        socket._zerocopy = std::make_unique<tcp_zerocopy>(socket._fd, threshold);
+    }
+}
+
+auto up_inet::tcp::connection::zerocopy_sent() const -> uint32_t
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    return socket._zerocopy ? socket._zerocopy->sent() : 0;
+}
+
+auto up_inet::tcp::connection::zerocopy_completed() const -> uint32_t
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    if (!socket._zerocopy) {
+        return 0;
+    }
+    socket._zerocopy->reap(socket._fd);
+    return socket._zerocopy->completed();
+}
+
+void up_inet::tcp::connection::zerocopy_wait(uint32_t sent, up::stream::patience& patience) const
+{
+    auto&& socket = *static_cast<const engine*>(get_underlying_engine())->_socket;
+    if (!socket._zerocopy) {
+        return;
+    }
+    if (socket._zerocopy->reap(socket._fd), socket._zerocopy->is_completed(sent)) {
+        return;
+    }
+    while (socket._zerocopy->reap(socket._fd), !socket._zerocopy->is_completed(sent)) {
+        patience(socket._zerocopy->get_native_handle(), up::stream::patience::operation::read);
+    }
+}
+
 void up_inet::tcp::connection::_vtable_dummy() const { }
 
 
-class up_inet::tcp::listener::impl final
+namespace
+{
+
+    /* Blocks SIGPIPE for the current thread. Unlike send, splice does not
+     * support MSG_NOSIGNAL. So writing to a closed connection would raise
+     * SIGPIPE, which terminates the process by default. If the operation
+     * has failed with EPIPE, the generated signal is discarded (unless it
+     * was already pending before). The guard is created lazily once per
+     * pump (see relay_direction::step), so that the splices do not require
+     * additional syscalls. */
+    class sigpipe_guard final
+    {
+    public: // --- scope ---
+        using self = sigpipe_guard;
+    private: // --- state ---
+        sigset_t _sigpipe;
+        sigset_t _old_mask;
+        bool _pending = false;
+    public: // --- life ---
+        explicit sigpipe_guard()
+        {
+            ::sigemptyset(&_sigpipe);
+            ::sigaddset(&_sigpipe, SIGPIPE);
+            sigset_t pending;
+            ::sigemptyset(&pending);
+            ::sigpending(&pending);
+            _pending = ::sigismember(&pending, SIGPIPE) == 1;
+            int rv = ::pthread_sigmask(SIG_BLOCK, &_sigpipe, &_old_mask);
+            if (rv != 0) {
+                throw up::make_exception("tcp-relay-sigmask-error").with(up::errno_info(rv));
+            }
+        }
+        sigpipe_guard(const self& rhs) = delete;
+        sigpipe_guard(self&& rhs) noexcept = delete;
+        ~sigpipe_guard() noexcept
+        {
+            int rv = ::pthread_sigmask(SIG_SETMASK, &_old_mask, nullptr);
+            if (rv != 0) {
+                up::terminate("tcp-relay-sigmask-error", rv);
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        void discard() noexcept
+        {
+            if (!_pending) {
+                timespec timeout{0, 0};
+                while (::sigtimedwait(&_sigpipe, nullptr, &timeout) == -1 && errno == EINTR) {
+                    // restart
+                }
+            }
+        }
+    };
+
+
+    /* One direction of a relay: source socket -> pipe -> target socket. The
+     * sockets are owned by the connections. */
+    class relay_direction final
+    {
+    public: // --- scope ---
+        using self = relay_direction;
+    public: // --- state ---
+        int _source;
+        int _target;
+        int _pipe[2] = {-1, -1};
+        std::size_t _capacity = 0;
+        std::size_t _buffered = 0;
+        uint64_t _transferred = 0;
+        bool _eof = false;
+        bool _finished = false; // i.e. shutdown has been forwarded
+        // conditions, the direction is waiting for
+        bool _want_read = false;
+        bool _want_write = false;
+    public: // --- life ---
+        explicit relay_direction(int source, int target, std::size_t pipe_size)
+            : _source(source), _target(target)
+        {
+            if (::pipe2(_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+                throw up::make_exception("tcp-relay-pipe-error").with(up::errno_info(errno));
+            }
+            /* Larger pipes require privileges (see /proc/sys/fs/pipe-max-size).
+             * In this case, the default size is used. */
+            ::fcntl(_pipe[1], F_SETPIPE_SZ, up::ints::cast<int>(pipe_size));
+            int rv = ::fcntl(_pipe[1], F_GETPIPE_SZ);
+            if (rv == -1) {
+                close_aux(_pipe[0]);
+                close_aux(_pipe[1]);
+                throw up::make_exception("tcp-relay-pipe-error").with(up::errno_info(errno));
+            }
+            _capacity = up::ints::cast<std::size_t>(rv);
+        }
+        relay_direction(const self& rhs) = delete;
+        relay_direction(self&& rhs) noexcept = delete;
+        ~relay_direction() noexcept
+        {
+            close_aux(_pipe[0]);
+            close_aux(_pipe[1]);
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto to_insight() const -> up::insight
+        {
+            return up::insight(typeid(*this), "tcp-relay-direction",
+                up::invoke_to_insight_with_fallback(_source),
+                up::invoke_to_insight_with_fallback(_target),
+                up::invoke_to_insight_with_fallback(_buffered),
+                up::invoke_to_insight_with_fallback(_transferred),
+                up::invoke_to_insight_with_fallback(_eof),
+                up::invoke_to_insight_with_fallback(_finished));
+        }
+        // moves as much as possible without blocking
+        void step(up::optional<sigpipe_guard>& guard)
+        {
+            for (bool moved = true; moved; ) {
+                moved = false;
+                _want_read = false;
+                _want_write = false;
+                if (!_eof && _buffered < _capacity) {
+                    auto rv = _splice(_source, _pipe[1], _capacity - _buffered, nullptr);
+                    if (rv > 0) {
+                        _buffered += std::size_t(rv);
+                        moved = true;
+                    } else if (rv == 0) {
+                        _eof = true;
+                        moved = true;
+                    } else if (_buffered == 0) {
+                        // otherwise, the pipe might be full (partially used pages)
+                        _want_read = true;
+                    }
+                }
+                if (_buffered) {
+                    if (!guard) {
+                        guard.emplace();
+                    }
+                    auto rv = _splice(_pipe[0], _target, _buffered, &*guard);
+                    if (rv > 0) {
+                        _buffered -= std::size_t(rv);
+                        _transferred += std::size_t(rv);
+                        moved = true;
+                    } else {
+                        _want_write = true;
+                    }
+                }
+                if (_eof && _buffered == 0 && !_finished) {
+                    if (::shutdown(_target, SHUT_WR) != 0) {
+                        throw up::make_exception("tcp-relay-shutdown-error").with(_target, up::errno_info(errno));
+                    }
+                    _finished = true;
+                }
+            }
+        }
+    private:
+        // returns -1 if it would block (the guard is required for sockets as target)
+        static auto _splice(int from, int to, std::size_t size, sigpipe_guard* guard) -> ssize_t
+        {
+            for (;;) {
+                auto rv = ::splice(from, nullptr, to, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (rv != -1) {
+                    return rv;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return -1;
+                } else if (errno != EINTR) {
+                    int error = errno;
+                    if (error == EPIPE && guard) {
+                        guard->discard();
+                    }
+                    throw up::make_exception("tcp-relay-splice-error").with(from, to, size, up::errno_info(error));
+                }
+            }
+        }
+    };
+
+}
+
+
+class up_inet::tcp::relay::impl final
 {
 public: // --- scope ---
     using self = impl;
-public: // --- state ---
-    up::impl_ptr<socket::impl, socket::destroy> _socket;
+private: // --- state ---
+    // keeps the sockets alive
+    std::shared_ptr<socket::impl> _first;
+    std::shared_ptr<socket::impl> _second;
+    relay_direction _forward;
+    relay_direction _backward;
+    int _epoll_fd = -1;
+    // registered events of first and second
+    uint32_t _events[2] = {0, 0};
 public: // --- life ---
-    explicit impl(up::impl_ptr<socket::impl, socket::destroy>&& socket, int backlog)
-        : _socket(std::move(socket))
+    explicit impl(std::shared_ptr<socket::impl> first, std::shared_ptr<socket::impl> second, std::size_t pipe_size)
+        : _first(std::move(first)), _second(std::move(second))
+        , _forward(_first->_fd, _second->_fd, pipe_size)
+        , _backward(_second->_fd, _first->_fd, pipe_size)
     {
-        // TODO: Linux 4.4 added support for SO_INCOMING_CPU on listeners
-        int rv = ::listen(_socket->_fd, backlog);
-        if (rv != 0) {
-            throw up::make_exception("tcp-socket-listen-error")
-                .with(backlog, up::errno_info(errno));
+        if (_first == _second) {
+            throw up::make_exception("tcp-relay-same-connection").with(_first->_fd);
+        }
+        _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll_fd == -1) {
+            throw up::make_exception("tcp-relay-epoll-error").with(up::errno_info(errno));
+        }
+        try {
+            _control(EPOLL_CTL_ADD, _first->_fd, 0);
+            _control(EPOLL_CTL_ADD, _second->_fd, 0);
+        } catch (...) {
+            close_aux(_epoll_fd);
+            throw;
         }
     }
     impl(const self& rhs) = delete;
     impl(self&& rhs) noexcept = delete;
-    ~impl() noexcept = default;
+    ~impl() noexcept
+    {
+        close_aux(_epoll_fd);
+    }
 public: // --- operations ---
     auto operator=(const self& rhs) & -> self& = delete;
     auto operator=(self&& rhs) & noexcept -> self& = delete;
     auto to_insight() const -> up::insight
     {
-        return up::insight(typeid(*this), "tcp-listener-impl",
-            up::invoke_to_insight_with_fallback(*_socket));
+        return up::insight(typeid(*this), "tcp-relay-impl",
+            _forward.to_insight(),
+            _backward.to_insight());
+    }
+    auto get_native_handle() const
+    {
+        return up::stream::native_handle(_epoll_fd);
+    }
+    bool try_pump(up::optional<sigpipe_guard>& guard)
+    {
+        _forward.step(guard);
+        _backward.step(guard);
+        /* The epoll instance watches exactly the conditions, the directions
+         * are waiting for. So it is only readable, if progress is possible. */
+        _update(0, _first->_fd, _forward._want_read, _backward._want_write);
+        _update(1, _second->_fd, _backward._want_read, _forward._want_write);
+        return _forward._finished && _backward._finished;
+    }
+    auto transferred(direction direction) const
+    {
+        return direction == direction::forward ? _forward._transferred : _backward._transferred;
+    }
+private:
+    void _control(int op, int fd, uint32_t events)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (::epoll_ctl(_epoll_fd, op, fd, &event) != 0) {
+            throw up::make_exception("tcp-relay-epoll-error").with(op, fd, events, up::errno_info(errno));
+        }
+    }
+    void _update(std::size_t index, int fd, bool read, bool write)
+    {
+        uint32_t events = (read ? EPOLLIN : 0u) | (write ? EPOLLOUT : 0u);
+        if (events != _events[index]) {
+            _control(EPOLL_CTL_MOD, fd, events);
+            _events[index] = events;
+        }
     }
 };
 
 
-void up_inet::tcp::listener::destroy(impl* ptr)
+namespace
+{
+
+    auto relay_socket(const up_inet::tcp::connection::engine* engine, bool upgraded)
+        -> std::shared_ptr<up_inet::tcp::socket::impl>
+    {
+        if (upgraded || engine->_channel) {
+            throw up::make_exception("tcp-relay-unsupported-connection").with(upgraded, bool(engine->_channel));
+        }
+        return engine->_socket;
+    }
+
+}
+
+
+void up_inet::tcp::relay::destroy(impl* ptr)
 {
     std::default_delete<impl>()(ptr);
 }
 
-up_inet::tcp::listener::listener(up::impl_ptr<impl, destroy> impl)
-    : _impl(std::move(impl))
+up_inet::tcp::relay::relay(const connection& first, const connection& second, std::size_t pipe_size)
+    : _impl(up::impl_make(
+        relay_socket(static_cast<const connection::engine*>(first.get_underlying_engine()), first.is_upgraded()),
+        relay_socket(static_cast<const connection::engine*>(second.get_underlying_engine()), second.is_upgraded()),
+        pipe_size))
 { }
 
-auto up_inet::tcp::listener::to_insight() const -> up::insight
+auto up_inet::tcp::relay::to_insight() const -> up::insight
 {
     return _impl->to_insight();
 }
 
-auto up_inet::tcp::listener::accept(up::stream::patience& patience) -> connection
+auto up_inet::tcp::relay::get_native_handle() const -> up::stream::native_handle
 {
-    bool waited = false;
-    sockaddr_storage addr;
-    socklen_t length = sizeof(addr);
-    for (;;) {
-        /* Note: accept can be executed by several threads. However, the
-         * implementation is not fair. A better approach is to open several
-         * sockets with SO_REUSEPORT (since linux 3.9). This is also possible
-         * with different processes. */
-        auto&& socket = std::make_shared<socket::impl>(_impl->_socket->_endpoint, -1);
-        int flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
-        socket->_fd = ::accept4(_impl->_socket->_fd, reinterpret_cast<sockaddr*>(&addr), &length, flags);
-        if (socket->_fd != -1) {
-            socket->setsockopt(IPPROTO_TCP, TCP_NODELAY, int(1));
-            return connection(std::make_unique<connection::engine>(std::move(socket), make_tcp_endpoint(&addr, length)));
-        } else if (!waited && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            patience(_impl->_socket->get_native_handle(), up::stream::patience::operation::read);
-            waited = true;
-        } else if (errno == EINTR) {
-            // restart
-        } else {
-            throw up::make_exception("tcp-listener-accept-error")
-                .with(_impl->_socket->_endpoint, up::errno_info(errno));
-        }
-    }
+    return _impl->get_native_handle();
+}
+
+bool up_inet::tcp::relay::try_pump()
+{
+    up::optional<sigpipe_guard> guard;
+    return _impl->try_pump(guard);
+}
+
+void up_inet::tcp::relay::pump(up::stream::patience& patience)
+{
+    // SIGPIPE remains blocked while waiting
+    up::optional<sigpipe_guard> guard;
+    while (!_impl->try_pump(guard)) {
+        patience(_impl->get_native_handle(), up::stream::patience::operation::read);
+    }
+}
+
+auto up_inet::tcp::relay::transferred(direction direction) const -> uint64_t
+{
+    return _impl->transferred(direction);
+}
+
+
+up_inet::tcp::basic_engine::basic_engine(std::shared_ptr<socket::impl> socket, tcp::endpoint remote)
+    : _socket(std::move(socket)), _fd(&_socket->_fd), _remote(std::move(remote))
+{ }
+
+up_inet::tcp::basic_engine::~basic_engine() noexcept
+{
+    if (_socket && _socket->_fd != -1) {
+        _socket->hard_close(true);
+    }
+}
+
+auto up_inet::tcp::basic_engine::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "tcp-basic-engine",
+        up::invoke_to_insight_with_fallback(*_socket),
+        up::invoke_to_insight_with_fallback(_remote));
+}
+
+auto up_inet::tcp::basic_engine::local() const -> tcp::endpoint
+{
+    return identify_endpoint<up_inet::tcp>(::getsockname, _socket->_fd);
+}
+
+void up_inet::tcp::basic_engine::cork(bool enabled) const
+{
+    _socket->setsockopt(IPPROTO_TCP, TCP_CORK, int(enabled));
+}
+
+auto up_inet::tcp::basic_engine::try_shutdown() const -> status
+{
+    return tcp_transfers::shutdown(*_socket, _remote);
+}
+
+void up_inet::tcp::basic_engine::hard_close() const
+{
+    _socket->hard_close();
+}
+
+void up_inet::tcp::basic_engine::_raise(transfer kind, int error, std::size_t count, std::size_t total) const
+{
+    switch (kind) {
+    case transfer::read:
+        throw up::make_exception("tcp-connection-read-error").with(_remote, count, up::errno_info(error));
+    case transfer::write:
+        throw up::make_exception("tcp-connection-write-error").with(_remote, count, up::errno_info(error));
+    case transfer::readv:
+        throw up::make_exception("tcp-connection-readv-error").with(_remote, count, total, up::errno_info(error));
+    case transfer::writev:
+        throw up::make_exception("tcp-connection-writev-error").with(_remote, count, total, up::errno_info(error));
+    }
+    throw up::make_exception("tcp-connection-bad-transfer").with(up::to_underlying_type(kind));
+}
+
+
+class up_inet::tcp::listener::impl final
+{
+public: // --- scope ---
+    using self = impl;
+public: // --- state ---
+    up::impl_ptr<socket::impl, socket::destroy> _socket;
+public: // --- life ---
+    explicit impl(up::impl_ptr<socket::impl, socket::destroy>&& socket, int backlog)
+        : _socket(std::move(socket))
+    {
+        int rv = ::listen(_socket->_fd, backlog);
+        if (rv != 0) {
+            throw up::make_exception("tcp-socket-listen-error")
+                .with(backlog, up::errno_info(errno));
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept = default;
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "tcp-listener-impl",
+            up::invoke_to_insight_with_fallback(*_socket));
+    }
+};
+
+
+void up_inet::tcp::listener::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_inet::tcp::listener::listener(up::impl_ptr<impl, destroy> impl)
+    : _impl(std::move(impl))
+{ }
+
+auto up_inet::tcp::listener::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_inet::tcp::listener::accept(up::stream::patience& patience) -> connection
+{
+    return _accept(patience, nullptr);
+}
+
+auto up_inet::tcp::listener::accept(up::stream::patience& patience, up::uring& ring) -> connection
+{
+    return _accept(patience, &ring);
+}
+
+auto up_inet::tcp::listener::accept_basic(up::stream::patience& patience) -> basic_connection
+{
+    auto&& try_accept = [this] {
+        return try_accept_aux<basic_connection>(*_impl->_socket, accept_options(),
+            [](std::shared_ptr<socket::impl>&& socket, tcp::endpoint&& remote) {
+                return basic_connection(std::move(socket), std::move(remote));
+            });
+    };
+    if (auto&& result = try_accept()) {
+        return std::move(*result);
+    }
+    patience(get_native_handle(), up::stream::patience::operation::read);
+    if (auto&& result = try_accept()) {
+        return std::move(*result);
+    }
+    throw up::make_exception("tcp-listener-accept-error")
+        .with(_impl->_socket->_endpoint, up::errno_info(EAGAIN));
+}
+
+auto up_inet::tcp::listener::accept_many(up::stream::patience& patience, std::size_t max, const accept_options& options)
+    -> std::vector<connection>
+{
+    std::vector<connection> result;
+    auto&& drain = [&]() {
+        while (result.size() < max) {
+            up::optional<connection> connection;
+            try {
+                connection = try_accept_aux<tcp::connection>(*_impl->_socket, options,
+                    [](std::shared_ptr<socket::impl>&& socket, tcp::endpoint&& remote) {
+                        return make_connection(std::move(socket), std::move(remote), nullptr);
+                    });
+            } catch (...) {
+                /* The connections accepted so far are returned (e.g. on
+                 * EMFILE), and the error is raised by the next call. */
+                if (result.empty()) {
+                    throw;
+                }
+                break;
+            }
+            if (!connection) {
+                break;
+            }
+            result.push_back(std::move(*connection));
+        }
+    };
+    drain();
+    if (result.empty() && max) {
+        patience(get_native_handle(), up::stream::patience::operation::read);
+        drain();
+        if (result.empty()) {
+            throw up::make_exception("tcp-listener-accept-error")
+                .with(_impl->_socket->_endpoint, up::errno_info(EAGAIN));
+        }
+    }
+    return result;
+}
+
+auto up_inet::tcp::listener::try_accept() -> up::optional<connection>
+{
+    return _try_accept(nullptr);
+}
+
+auto up_inet::tcp::listener::get_native_handle() const -> up::stream::native_handle
+{
+    return _impl->_socket->get_native_handle();
+}
+
+void up_inet::tcp::listener::incoming_cpu(int cpu) const
+{
+    _impl->_socket->setsockopt(SOL_SOCKET, SO_INCOMING_CPU, cpu);
+}
+
+void up_inet::tcp::listener::steer_by_cpu(const std::vector<int>& cpus) const
+{
+    /* The program compares the CPU with each entry (two instructions per
+     * CPU), so it stays far below the limit of 4096 instructions. */
+    if (cpus.empty() || cpus.size() > 1024) {
+        throw up::make_exception("tcp-listener-invalid-steering-cpus").with(cpus.size());
+    }
+    auto insn = [](uint16_t code, uint8_t jt, uint8_t jf, uint32_t k) {
+        return sock_filter{code, jt, jf, k};
+    };
+    std::vector<sock_filter> program;
+    program.push_back(insn(BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t(SKF_AD_OFF + SKF_AD_CPU)));
+    for (std::size_t i = 0; i != cpus.size(); ++i) {
+        program.push_back(insn(BPF_JMP | BPF_JEQ | BPF_K, 0, 1, up::ints::cast<uint32_t>(cpus[i])));
+        program.push_back(insn(BPF_RET | BPF_K, 0, 0, up::ints::cast<uint32_t>(i)));
+    }
+    program.push_back(insn(BPF_ALU | BPF_MOD | BPF_K, 0, 0, up::ints::cast<uint32_t>(cpus.size())));
+    program.push_back(insn(BPF_RET | BPF_A, 0, 0, 0));
+    sock_fprog fprog{up::ints::cast<unsigned short>(program.size()), program.data()};
+    _impl->_socket->setsockopt(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, fprog);
+}
+
+auto up_inet::tcp::listener::_accept(up::stream::patience& patience, up::uring* ring) -> connection
+{
+    if (auto&& result = _try_accept(ring)) {
+        return std::move(*result);
+    }
+    patience(get_native_handle(), up::stream::patience::operation::read);
+    if (auto&& result = _try_accept(ring)) {
+        return std::move(*result);
+    }
+    throw up::make_exception("tcp-listener-accept-error")
+        .with(_impl->_socket->_endpoint, up::errno_info(EAGAIN));
+}
+
+auto up_inet::tcp::listener::_try_accept(up::uring* ring) -> up::optional<connection>
+{
+    return try_accept_aux<connection>(*_impl->_socket, accept_options(),
+        [ring](std::shared_ptr<socket::impl>&& socket, tcp::endpoint&& remote) {
+            return make_connection(std::move(socket), std::move(remote), ring);
+        });
 }
 
 
@@ -1149,6 +2064,10 @@ up_inet::tcp::socket::socket(const tcp::endpoint& endpoint, up::enum_set<option>
     if (options.all(option::freebind)) {
         _impl->setsockopt(IPPROTO_IP, IP_FREEBIND, int(1));
     }
+    if (options.all(option::fastopen)) {
+        // maximal number of pending connections with data in the SYN
+        _impl->setsockopt(IPPROTO_TCP, TCP_FASTOPEN, int(256));
+    }
     if (endpoint.address().version() == ip::version::v6) {
         _impl->setsockopt(IPPROTO_IPV6, IPV6_V6ONLY, int(1));
     }
@@ -1174,30 +2093,98 @@ auto up_inet::tcp::socket::endpoint() const -> const tcp::endpoint&
 auto up_inet::tcp::socket::connect(const tcp::endpoint& remote, up::stream::patience& patience) &&
     -> connection
 {
-    with_sockaddr(remote, [&](const sockaddr* addr, socklen_t addrlen) {
+    return std::move(*this)._connect(remote, patience, nullptr);
+}
+
+auto up_inet::tcp::socket::connect(const tcp::endpoint& remote, up::stream::patience& patience, up::uring& ring) &&
+    -> connection
+{
+    return std::move(*this)._connect(remote, patience, &ring);
+}
+
+auto up_inet::tcp::socket::connect_basic(const tcp::endpoint& remote, up::stream::patience& patience) &&
+    -> basic_connection
+{
+    _wait_connected(remote, patience);
+    return basic_connection(std::move(_impl), remote);
+}
+
+auto up_inet::tcp::socket::try_connect(const tcp::endpoint& remote) -> bool
+{
+    // a failed connection attempt is reported (only once) via SO_ERROR
+    if (auto error = _impl->getsockopt<int>(SOL_SOCKET, SO_ERROR)) {
+        throw up::make_exception("tcp-socket-connect-error")
+            .with(remote, up::errno_info(error));
+    }
+    return with_sockaddr(remote, [&](const sockaddr* addr, socklen_t addrlen) {
         for (;;) {
             int rv = ::connect(_impl->_fd, addr, addrlen);
-            if (rv == 0) {
+            if (rv == 0 || errno == EISCONN) {
                 // okay
-                return;
+                return true;
             } else if (errno == EINTR) {
                 // restart
-            } else if (errno == EINPROGRESS) {
-                patience(_impl->get_native_handle(), up::stream::patience::operation::write);
-                if (auto error = _impl->getsockopt<int>(SOL_SOCKET, SO_ERROR)) {
-                    throw up::make_exception("tcp-socket-connect-error")
-                        .with(remote, up::errno_info(error));
-                } else {
-                    return;
-                }
+            } else if (errno == EINPROGRESS || errno == EALREADY) {
+                return false;
             } else {
                 throw up::make_exception("tcp-socket-connect-failed")
                     .with(remote, up::errno_info(errno));
             }
         }
     });
+}
+
+auto up_inet::tcp::socket::connect_fastopen(const tcp::endpoint& remote, up::chunk::from data, up::stream::patience& patience) &&
+    -> connection
+{
+    int fd = _impl->_fd;
+    int enabled = 1;
+    // older kernels only support the regular connect
+    if (::setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enabled, sizeof(enabled)) != 0
+        && errno != ENOPROTOOPT) {
+        throw up::make_exception("network-socket-option-error")
+            .with(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, up::errno_info(errno));
+    }
+    // returns immediately, if the connection has been deferred (cookie available)
+    auto connection = std::move(*this)._connect(remote, patience, nullptr);
+    /* The first write of a deferred connection sends the SYN. It fails with
+     * EINPROGRESS, if the data could not be included. */
+    while (data.size()) {
+        ssize_t rv = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (rv != -1) {
+            data.drain(std::size_t(rv));
+            break;
+        } else if (errno == EINTR) {
+            // restart
+        } else if (errno == EINPROGRESS || errno == EAGAIN || errno == EWOULDBLOCK) {
+            patience(up::stream::native_handle(fd), up::stream::patience::operation::write);
+        } else {
+            throw up::make_exception("tcp-connection-fastopen-error")
+                .with(remote, data.size(), up::errno_info(errno));
+        }
+    }
+    connection.write_all(data, patience);
+    return connection;
+}
+
+auto up_inet::tcp::socket::get_native_handle() const -> up::stream::native_handle
+{
+    return _impl->get_native_handle();
+}
+
+auto up_inet::tcp::socket::_connect(const tcp::endpoint& remote, up::stream::patience& patience, up::uring* ring) &&
+    -> connection
+{
+    _wait_connected(remote, patience);
+    return make_connection(std::move(_impl), remote, ring);
+}
+
+void up_inet::tcp::socket::_wait_connected(const tcp::endpoint& remote, up::stream::patience& patience)
+{
+    while (!try_connect(remote)) {
+        patience(_impl->get_native_handle(), up::stream::patience::operation::write);
+    }
     _impl->setsockopt(IPPROTO_TCP, TCP_NODELAY, int(1));
-    return connection(std::make_unique<connection::engine>(std::move(_impl), remote));
 }
 
 auto up_inet::tcp::socket::listen(int backlog) && -> listener
@@ -1206,6 +2193,218 @@ auto up_inet::tcp::socket::listen(int backlog) && -> listener
 }
 
 
+namespace
+{
+
+    /* Orders the candidates as recommended by RFC 8305 (section 4), i.e.
+     * alternating between the address families, and starting with the
+     * family of the first endpoint (preferred by the resolver). */
+    auto interleave_families(const std::vector<up_inet::tcp::endpoint>& endpoints)
+    {
+        std::vector<up_inet::tcp::endpoint> preferred;
+        std::vector<up_inet::tcp::endpoint> other;
+        for (auto&& endpoint : endpoints) {
+            bool same = endpoint.address().version() == endpoints.front().address().version();
+            (same ? preferred : other).push_back(endpoint);
+        }
+        std::vector<up_inet::tcp::endpoint> result;
+        result.reserve(endpoints.size());
+        for (std::size_t i = 0; i < std::max(preferred.size(), other.size()); ++i) {
+            if (i < preferred.size()) {
+                result.push_back(std::move(preferred[i]));
+            }
+            if (i < other.size()) {
+                result.push_back(std::move(other[i]));
+            }
+        }
+        return result;
+    }
+
+
+    /* Concurrent connection attempts. The epoll instance contains the
+     * connecting sockets (writable on completion) and a timer for starting
+     * the next attempt. So the caller waits for all of them with a single
+     * native handle. */
+    class tcp_attempts final
+    {
+    public: // --- scope ---
+        using self = tcp_attempts;
+        using endpoint = up_inet::tcp::endpoint;
+        using socket = up_inet::tcp::socket;
+    private: // --- state ---
+        int _epoll_fd = -1;
+        int _timer_fd = -1;
+        std::vector<std::pair<socket, endpoint>> _pending;
+    public: // --- life ---
+        explicit tcp_attempts()
+        {
+            _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (_epoll_fd == -1) {
+                throw up::make_exception("tcp-connect-any-epoll-error").with(up::errno_info(errno));
+            }
+            _timer_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+            if (_timer_fd == -1) {
+                close_aux(_epoll_fd);
+                throw up::make_exception("tcp-connect-any-timer-error").with(up::errno_info(errno));
+            }
+            try {
+                _control(EPOLL_CTL_ADD, _timer_fd, EPOLLIN);
+            } catch (...) {
+                close_aux(_timer_fd);
+                close_aux(_epoll_fd);
+                throw;
+            }
+        }
+        tcp_attempts(const self& rhs) = delete;
+        tcp_attempts(self&& rhs) noexcept = delete;
+        ~tcp_attempts() noexcept
+        {
+            // the pending sockets are closed afterwards
+            close_aux(_timer_fd);
+            close_aux(_epoll_fd);
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto get_native_handle() const
+        {
+            return up::stream::native_handle(_epoll_fd);
+        }
+        auto size() const
+        {
+            return _pending.size();
+        }
+        // raises the error, if the attempt fails immediately
+        void start(const endpoint& remote)
+        {
+            auto connector = socket(remote.address().version());
+            connector.try_connect(remote);
+            int fd = up::to_underlying_type(connector.get_native_handle());
+            _control(EPOLL_CTL_ADD, fd, EPOLLOUT);
+            _pending.emplace_back(std::move(connector), remote);
+        }
+        void arm(std::chrono::milliseconds delay)
+        {
+            itimerspec its{};
+            its.it_value.tv_sec = up::ints::cast<time_t>(delay.count() / 1000);
+            its.it_value.tv_nsec = up::ints::cast<long>(delay.count() % 1000 * 1000000);
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+                its.it_value.tv_nsec = 1; // zero disarms the timer
+            }
+            if (::timerfd_settime(_timer_fd, 0, &its, nullptr) != 0) {
+                throw up::make_exception("tcp-connect-any-timer-error")
+                    .with(delay, up::errno_info(errno));
+            }
+        }
+        // returns true (and resets the timer), if the delay has elapsed
+        bool expired()
+        {
+            uint64_t count = 0;
+            ssize_t rv = ::read(_timer_fd, &count, sizeof(count));
+            if (rv == sizeof(count)) {
+                return true;
+            } else if (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                return false;
+            } else {
+                throw up::make_exception("tcp-connect-any-timer-error").with(up::errno_info(errno));
+            }
+        }
+        /* Checks the completed attempts (without waiting). Returns the
+         * connection of the first established attempt. Failed attempts are
+         * removed, and their errors are stored in failure. */
+        auto try_complete(up::stream::patience& patience, std::exception_ptr& failure)
+            -> up::optional<up_inet::tcp::connection>
+        {
+            epoll_event events[16];
+            int rv = ::epoll_wait(_epoll_fd, events, int(sizeof(events) / sizeof(*events)), 0);
+            if (rv == -1) {
+                if (errno == EINTR) {
+                    return {};
+                }
+                throw up::make_exception("tcp-connect-any-epoll-error").with(up::errno_info(errno));
+            }
+            for (int i = 0; i != rv; ++i) {
+                auto fd = events[i].data.fd;
+                if (fd == _timer_fd) {
+                    continue;
+                }
+                auto p = std::find_if(_pending.begin(), _pending.end(), [fd](auto&& attempt) {
+                        return up::to_underlying_type(attempt.first.get_native_handle()) == fd;
+                    });
+                if (p == _pending.end()) {
+                    continue;
+                }
+                try {
+                    if (p->first.try_connect(p->second)) {
+                        // completes immediately (and enables TCP_NODELAY)
+                        return std::move(p->first).connect(p->second, patience);
+                    }
+                } catch (...) {
+                    failure = std::current_exception();
+                    _control(EPOLL_CTL_DEL, fd, 0);
+                    _pending.erase(p);
+                }
+            }
+            return {};
+        }
+    private:
+        void _control(int op, int fd, uint32_t events)
+        {
+            epoll_event event{};
+            event.events = events;
+            event.data.fd = fd;
+            if (::epoll_ctl(_epoll_fd, op, fd, &event) != 0) {
+                throw up::make_exception("tcp-connect-any-epoll-error")
+                    .with(op, fd, events, up::errno_info(errno));
+            }
+        }
+    };
+
+}
+
+
+auto up_inet::tcp::connect_any(const std::vector<endpoint>& endpoints, up::stream::patience& patience,
+    std::chrono::milliseconds delay) -> connection
+{
+    if (endpoints.empty()) {
+        throw up::make_exception("tcp-connect-any-no-endpoints");
+    }
+    auto candidates = interleave_families(endpoints);
+    auto next = candidates.begin();
+    auto attempts = tcp_attempts();
+    std::exception_ptr failure;
+    // starts the next candidate, that does not fail immediately
+    auto start_next = [&] {
+        while (next != candidates.end()) {
+            try {
+                attempts.start(*next++);
+                break;
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        }
+        if (next != candidates.end()) {
+            attempts.arm(delay);
+        }
+    };
+    start_next();
+    for (;;) {
+        auto started = attempts.size();
+        if (auto connection = attempts.try_complete(patience, failure)) {
+            return std::move(*connection);
+        }
+        // a failed attempt does not wait for the delay
+        if (attempts.size() < started || attempts.expired()) {
+            start_next();
+        }
+        if (attempts.size() == 0) {
+            std::rethrow_exception(failure);
+        }
+        patience(attempts.get_native_handle(), up::stream::patience::operation::read);
+    }
+}
+
+
 auto up_inet::udp::resolve_name(port port) -> up::unique_string
 {
     return resolve_service_name<udp>(port);
@@ -1220,3 +2419,390 @@ auto up_inet::to_string(udp::port value) -> up::unique_string
 {
     return up::invoke_to_string(up::to_underlying_type(value));
 }
+
+
+const up_inet::udp::endpoint up_inet::udp::endpoint::any(ipv4::endpoint::any, udp::port::any);
+
+
+auto up_inet::udp::endpoint::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "udp-endpoint",
+        up::invoke_to_insight_with_fallback(_address),
+        up::invoke_to_insight_with_fallback(_port));
+}
+
+
+auto up_inet::udp::datagram::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "udp-datagram",
+        up::invoke_to_insight_with_fallback(_source),
+        up::invoke_to_insight_with_fallback(_size),
+        up::invoke_to_insight_with_fallback(_truncated));
+}
+
+
+namespace
+{
+
+    // the kernel processes at most UIO_MAXIOV messages per call
+    constexpr std::size_t udp_max_batch = 1024;
+    // limits of UDP_SEGMENT per call (UDP_MAX_SEGMENTS and maximal IPv4 payload)
+    constexpr std::size_t udp_max_segments = 64;
+    constexpr std::size_t udp_max_payload = 65507;
+
+    /* Message headers for recvmmsg and sendmmsg, that are reused for all
+     * transfers in one direction to avoid allocations. */
+    class udp_messages final
+    {
+    public: // --- scope ---
+        using self = udp_messages;
+        // ancillary data of received datagrams (only UDP_GRO)
+        struct control_buffer
+        {
+            alignas(cmsghdr) char data[CMSG_SPACE(sizeof(int))];
+        };
+    public: // --- state ---
+        std::vector<mmsghdr> _headers;
+        std::vector<iovec> _vectors;
+        std::vector<sockaddr_storage> _addresses;
+        std::vector<control_buffer> _controls;
+    public: // --- operations ---
+        auto prepare(std::size_t count) -> mmsghdr*
+        {
+            if (_headers.size() < count) {
+                _headers.resize(count);
+                _vectors.resize(count);
+                _addresses.resize(count);
+                _controls.resize(count);
+            }
+            return _headers.data();
+        }
+        template <typename Chunk>
+        void set(std::size_t index, const Chunk& chunk, const sockaddr* addr, socklen_t addrlen)
+        {
+            _vectors[index] = iovec{const_cast<char*>(chunk.data()), chunk.size()};
+            _headers[index].msg_hdr = msghdr{
+                const_cast<sockaddr*>(addr), addrlen, &_vectors[index], 1, nullptr, 0, 0};
+            _headers[index].msg_len = 0;
+        }
+    };
+
+}
+
+
+class up_inet::udp::socket::impl final
+{
+public: // --- scope ---
+    using self = impl;
+public: // --- state ---
+    // non-blocking (see tcp::socket::impl)
+    int _fd;
+    udp_messages _incoming;
+    udp_messages _outgoing;
+public: // --- life ---
+    explicit impl(ip::version version)
+        : _fd(-1)
+    {
+        int domain = 0;
+        if (version == ip::version::v4) {
+            domain = AF_INET;
+        } else if (version == ip::version::v6) {
+            domain = AF_INET6;
+        } else {
+            throw up::make_exception("unexpected-udp-endpoint-ip-address-version").with(version);
+        }
+        _fd = ::socket(domain, traits<udp>::sock_type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_fd == -1) {
+            throw up::make_exception("udp-socket-creation-error")
+                .with(version, up::errno_info(errno));
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        close_aux(_fd);
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    template <typename Type>
+    void setsockopt(int level, int option, Type&& value)
+    {
+        int rv = ::setsockopt(_fd, level, option, &value, sizeof(value));
+        if (rv != 0) {
+            throw up::make_exception("network-socket-option-error")
+                .with(_fd, level, option, up::errno_info(errno));
+        }
+    }
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "udp-socket-impl",
+            up::invoke_to_insight_with_fallback(_fd));
+    }
+    auto get_native_handle() const
+    {
+        return up::stream::native_handle(_fd);
+    }
+};
+
+
+namespace
+{
+
+    // returns the segment size of coalesced datagrams, or zero
+    auto udp_gro_segment_size(msghdr& msg) -> std::size_t
+    {
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int size;
+                std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+                return up::ints::cast<std::size_t>(size);
+            }
+        }
+        return 0;
+    }
+
+    auto udp_send_segmented(up_inet::udp::socket::impl& socket, const sockaddr* addr, socklen_t addrlen,
+        up::chunk::from chunk, std::size_t segment_size) -> std::size_t
+    {
+        if (segment_size == 0 || segment_size > udp_max_payload) {
+            throw up::make_exception("invalid-udp-segment-size").with(segment_size);
+        }
+        auto size = std::min(chunk.size(),
+            segment_size * std::min(udp_max_segments, udp_max_payload / segment_size));
+        if (size == 0) {
+            return 0;
+        }
+        iovec iov = {const_cast<char*>(chunk.data()), size};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))];
+        msghdr msg = {const_cast<sockaddr*>(addr), addrlen, &iov, 1, control, sizeof(control), 0};
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        auto gso_size = up::ints::cast<uint16_t>(segment_size);
+        std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        auto status = do_transfer(up::stream::patience::operation::write,
+            [&]() { return ::sendmsg(socket._fd, &msg, MSG_NOSIGNAL); },
+            "udp-socket-send-segmented-error", socket._fd, size, segment_size);
+        return status.done() ? status.count() : 0;
+    }
+
+    template <typename Send>
+    void udp_send_segmented_all(up_inet::udp::socket::impl& socket, up::chunk::from chunk,
+        up::stream::patience& patience, Send&& send)
+    {
+        while (chunk.size()) {
+            auto sent = send(chunk);
+            if (sent) {
+                chunk.drain(sent);
+            } else {
+                patience(socket.get_native_handle(), up::stream::patience::operation::write);
+            }
+        }
+    }
+
+    auto udp_send(up_inet::udp::socket::impl& socket, const sockaddr* addr, socklen_t addrlen,
+        const up::chunk::from* chunks, std::size_t count) -> std::size_t
+    {
+        count = std::min(count, udp_max_batch);
+        if (count == 0) {
+            return 0;
+        }
+        auto&& messages = socket._outgoing;
+        auto* headers = messages.prepare(count);
+        for (std::size_t i = 0; i != count; ++i) {
+            messages.set(i, chunks[i], addr, addrlen);
+        }
+        auto status = do_transfer(up::stream::patience::operation::write,
+            [&]() -> ssize_t { return ::sendmmsg(socket._fd, headers, unsigned(count), MSG_NOSIGNAL); },
+            "udp-socket-send-error", socket._fd, count);
+        return status.done() ? status.count() : 0;
+    }
+
+}
+
+
+void up_inet::udp::socket::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_inet::udp::socket::socket(ip::version version)
+    : _impl(up::impl_make(version))
+{ }
+
+up_inet::udp::socket::socket(const udp::endpoint& endpoint, options options)
+    : _impl(up::impl_make(endpoint.address().version()))
+{
+    if (options.all(option::reuseaddr)) {
+        _impl->setsockopt(SOL_SOCKET, SO_REUSEADDR, int(1));
+    }
+    if (options.all(option::reuseport)) {
+        _impl->setsockopt(SOL_SOCKET, SO_REUSEPORT, int(1));
+    }
+    if (options.all(option::freebind)) {
+        _impl->setsockopt(IPPROTO_IP, IP_FREEBIND, int(1));
+    }
+    if (endpoint.address().version() == ip::version::v6) {
+        _impl->setsockopt(IPPROTO_IPV6, IPV6_V6ONLY, int(1));
+    }
+    int rv = with_sockaddr(endpoint, [fd=_impl->_fd](const sockaddr* addr, socklen_t addrlen) {
+            return ::bind(fd, addr, addrlen);
+        });
+    if (rv != 0) {
+        throw up::make_exception("udp-socket-bind-error")
+            .with(endpoint, options, up::errno_info(errno));
+    }
+}
+
+auto up_inet::udp::socket::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_inet::udp::socket::local() const -> udp::endpoint
+{
+    return identify_endpoint<udp>(::getsockname, _impl->_fd);
+}
+
+void up_inet::udp::socket::connect(const udp::endpoint& remote) const
+{
+    int rv = with_sockaddr(remote, [fd=_impl->_fd](const sockaddr* addr, socklen_t addrlen) {
+            return ::connect(fd, addr, addrlen);
+        });
+    if (rv != 0) {
+        throw up::make_exception("udp-socket-connect-error")
+            .with(remote, up::errno_info(errno));
+    }
+}
+
+void up_inet::udp::socket::gro(bool enabled) const
+{
+    _impl->setsockopt(SOL_UDP, UDP_GRO, int(enabled));
+}
+
+auto up_inet::udp::socket::try_recv_many(const up::chunk::into* chunks, std::size_t count,
+    std::vector<datagram>& datagrams) const -> std::size_t
+{
+    datagrams.clear();
+    count = std::min(count, udp_max_batch);
+    if (count == 0) {
+        return 0;
+    }
+    auto&& messages = _impl->_incoming;
+    auto* headers = messages.prepare(count);
+    for (std::size_t i = 0; i != count; ++i) {
+        messages.set(i, chunks[i], reinterpret_cast<sockaddr*>(&messages._addresses[i]),
+            sizeof(sockaddr_storage));
+        headers[i].msg_hdr.msg_control = &messages._controls[i];
+        headers[i].msg_hdr.msg_controllen = sizeof(udp_messages::control_buffer);
+    }
+    auto status = do_transfer(up::stream::patience::operation::read,
+        [&]() -> ssize_t { return ::recvmmsg(_impl->_fd, headers, unsigned(count), 0, nullptr); },
+        "udp-socket-receive-error", _impl->_fd, count);
+    if (!status.done()) {
+        return 0;
+    }
+    for (std::size_t i = 0; i != status.count(); ++i) {
+        auto&& header = headers[i];
+        auto segment_size = udp_gro_segment_size(header.msg_hdr);
+        datagrams.emplace_back(
+            make_endpoint<udp>(&messages._addresses[i], header.msg_hdr.msg_namelen),
+            header.msg_len, segment_size ? segment_size : header.msg_len,
+            (header.msg_hdr.msg_flags & MSG_TRUNC) != 0);
+    }
+    return status.count();
+}
+
+auto up_inet::udp::socket::recv_many(const up::chunk::into* chunks, std::size_t count,
+    std::vector<datagram>& datagrams, up::stream::patience& patience) const -> std::size_t
+{
+    for (;;) {
+        auto received = try_recv_many(chunks, count, datagrams);
+        if (received || count == 0) {
+            return received;
+        }
+        patience(_impl->get_native_handle(), up::stream::patience::operation::read);
+    }
+}
+
+auto up_inet::udp::socket::try_send_many(const up::chunk::from* chunks, std::size_t count) const -> std::size_t
+{
+    return udp_send(*_impl, nullptr, 0, chunks, count);
+}
+
+auto up_inet::udp::socket::try_send_many(const udp::endpoint& destination,
+    const up::chunk::from* chunks, std::size_t count) const -> std::size_t
+{
+    return with_sockaddr(destination, [&](const sockaddr* addr, socklen_t addrlen) {
+            return udp_send(*_impl, addr, addrlen, chunks, count);
+        });
+}
+
+void up_inet::udp::socket::send_many(const up::chunk::from* chunks, std::size_t count,
+    up::stream::patience& patience) const
+{
+    while (count) {
+        auto sent = udp_send(*_impl, nullptr, 0, chunks, count);
+        if (sent) {
+            chunks += sent;
+            count -= sent;
+        } else {
+            patience(_impl->get_native_handle(), up::stream::patience::operation::write);
+        }
+    }
+}
+
+void up_inet::udp::socket::send_many(const udp::endpoint& destination,
+    const up::chunk::from* chunks, std::size_t count, up::stream::patience& patience) const
+{
+    with_sockaddr(destination, [&](const sockaddr* addr, socklen_t addrlen) {
+            while (count) {
+                auto sent = udp_send(*_impl, addr, addrlen, chunks, count);
+                if (sent) {
+                    chunks += sent;
+                    count -= sent;
+                } else {
+                    patience(_impl->get_native_handle(), up::stream::patience::operation::write);
+                }
+            }
+        });
+}
+
+auto up_inet::udp::socket::try_send_segmented(up::chunk::from chunk, std::size_t segment_size) const -> std::size_t
+{
+    return udp_send_segmented(*_impl, nullptr, 0, chunk, segment_size);
+}
+
+auto up_inet::udp::socket::try_send_segmented(const udp::endpoint& destination,
+    up::chunk::from chunk, std::size_t segment_size) const -> std::size_t
+{
+    return with_sockaddr(destination, [&](const sockaddr* addr, socklen_t addrlen) {
+            return udp_send_segmented(*_impl, addr, addrlen, chunk, segment_size);
+        });
+}
+
+void up_inet::udp::socket::send_segmented(up::chunk::from chunk, std::size_t segment_size,
+    up::stream::patience& patience) const
+{
+    udp_send_segmented_all(*_impl, chunk, patience, [&](up::chunk::from rest) {
+            return udp_send_segmented(*_impl, nullptr, 0, rest, segment_size);
+        });
+}
+
+void up_inet::udp::socket::send_segmented(const udp::endpoint& destination,
+    up::chunk::from chunk, std::size_t segment_size, up::stream::patience& patience) const
+{
+    with_sockaddr(destination, [&](const sockaddr* addr, socklen_t addrlen) {
+            udp_send_segmented_all(*_impl, chunk, patience, [&](up::chunk::from rest) {
+                    return udp_send_segmented(*_impl, addr, addrlen, rest, segment_size);
+                });
+        });
+}
+
+auto up_inet::udp::socket::get_native_handle() const -> up::stream::native_handle
+{
+    return _impl->get_native_handle();
+}
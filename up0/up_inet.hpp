@@ -1,9 +1,14 @@
 #pragma once
 
+#include <cerrno>
 #include <cstdint>
 
+#include <sys/socket.h>
+
 #include "up_impl_ptr.hpp"
+#include "up_optional.hpp"
 #include "up_stream.hpp"
+#include "up_uring.hpp"
 #include "up_utility.hpp"
 
 namespace up_inet
@@ -144,12 +149,28 @@ namespace up_inet
         class endpoint;
         class invalid_service;
         class connection;
+        class basic_engine;
+        // connection without virtual dispatch (see up::basic_stream)
+        using basic_connection = up::basic_stream<basic_engine>;
+        class relay;
         class listener;
         class socket;
         // raises invalid_service
         static auto resolve_name(port port) -> up::unique_string;
         // raises invalid_service
         static auto resolve_port(const up::string_view& name) -> port;
+        /* Connects to the first reachable endpoint (Happy Eyeballs, see RFC
+         * 8305). The candidates alternate between the address families,
+         * starting with the family of the first endpoint. The next attempt
+         * is started after the delay (or as soon as an attempt has failed),
+         * while the earlier attempts continue. The first established
+         * connection is returned, and the other attempts are aborted. If
+         * all attempts fail, the error of the last one is raised. */
+        static auto connect_any(const std::vector<endpoint>& endpoints, up::stream::patience& patience,
+            std::chrono::milliseconds delay = std::chrono::milliseconds(250)) -> connection;
+        // defined below (connection is still incomplete at this point)
+        static inline auto connect_any(const std::vector<endpoint>& endpoints, up::stream::patience&& patience,
+            std::chrono::milliseconds delay = std::chrono::milliseconds(250)) -> connection;
     };
 
     auto to_string(tcp::port value) -> up::unique_string;
@@ -186,8 +207,14 @@ namespace up_inet
         enum class qos_priority : uint8_t { class1, class2, class3, class4, };
         enum class qos_drop : uint8_t { low, med, high, };
         class engine;
+        friend relay;
     public: // --- life ---
         explicit connection(std::unique_ptr<engine> engine);
+        // e.g. for upgrading a basic_connection (obtained with release)
+        explicit connection(basic_engine&& engine);
+        /* Takes over a connected socket, e.g. received from another process
+         * (see local::connection). The descriptor is closed on failure. */
+        static auto adopt(int fd) -> connection;
     public: // --- operations ---
         auto to_insight() const -> up::insight;
         auto local() const -> tcp::endpoint;
@@ -195,6 +222,38 @@ namespace up_inet
         void qos(qos_priority priority, qos_drop drop) const;
         void keepalive(std::chrono::seconds idle, std::size_t probes, std::chrono::seconds interval) const;
         auto incoming_cpu() const -> int;
+        // data in the SYN has been acknowledged (i.e. TCP Fast Open was used)
+        auto fastopen_used() const -> bool;
+        /* Holds back partial segments while enabled (TCP_CORK). Disabling it
+         * sends all pending data immediately. */
+        void cork(bool enabled) const;
+        /* Polls the device queue for the given time on blocking receives and
+         * polls (SO_BUSY_POLL), instead of waiting for the interrupt. It is
+         * most useful together with stream::spinning_patience. Increasing
+         * the value requires CAP_NET_ADMIN. */
+        void busy_poll(std::chrono::microseconds duration) const;
+        /* Enables MSG_ZEROCOPY for writes of at least threshold bytes. The
+         * kernel pins the pages instead of copying them, so the data must
+         * neither be modified nor freed until the send has been completed.
+         * Smaller writes are still copied, because pinning and completion
+         * tracking are more expensive than copying a few KB. The regular
+         * path is used if the connection was obtained with io_uring. */
+        void zerocopy(std::size_t threshold = 1 << 14) const;
+        /* Number of zero-copy sends so far. A caller records it after writing
+         * a buffer, and the buffer can be reused as soon as the completed
+         * count has reached the recorded value. */
+        auto zerocopy_sent() const -> uint32_t;
+        // reaps notifications from the error queue (never blocks)
+        auto zerocopy_completed() const -> uint32_t;
+        /* Waits until the completed count has reached the given value.
+         * Unread data does not wake up the wait (the notifications are
+         * watched with a separate epoll instance, that is created by
+         * zerocopy and reused by all waits). */
+        void zerocopy_wait(uint32_t sent, up::stream::patience& patience) const;
+        void zerocopy_wait(uint32_t sent, up::stream::patience&& patience) const
+        {
+            zerocopy_wait(sent, patience);
+        }
     private:
         // classes with vtables should have at least one out-of-line virtual method definition
         __attribute__((unused))
@@ -202,10 +261,76 @@ namespace up_inet
     };
 
 
+    inline auto tcp::connect_any(const std::vector<endpoint>& endpoints, up::stream::patience&& patience,
+        std::chrono::milliseconds delay) -> connection
+    {
+        return connect_any(endpoints, patience, delay);
+    }
+
+
+    /**
+     * Bidirectional relay between two TCP connections (e.g. for a layer 4
+     * proxy). The bytes are moved with splice through one pipe per
+     * direction, so that the payload is never copied into user space.
+     *
+     * End-of-stream on one side is forwarded as shutdown to the other side,
+     * after all pending bytes of this direction have been transferred. The
+     * other direction continues until it is finished as well (half-close).
+     *
+     * The native handle is an epoll instance, that is readable whenever
+     * the relay can make progress. So the relay can be driven with any
+     * patience (including up::reactor::patience), or with try_pump by an
+     * event loop. The connections must neither be upgraded (e.g. with TLS)
+     * nor use io_uring, and they must not be used while the relay is
+     * active. Data already read by the application is not forwarded.
+     * Errors of the connections (e.g. a reset peer) are raised by the pump
+     * operations, and SIGPIPE is suppressed.
+     */
+    class tcp::relay final
+    {
+    public: // --- scope ---
+        using self = relay;
+        enum class direction : uint8_t { forward, backward, };
+        class impl;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        // forward: from first to second, backward: from second to first
+        explicit relay(const connection& first, const connection& second, std::size_t pipe_size = 1 << 16);
+        relay(const self& rhs) = delete;
+        relay(self&& rhs) noexcept = default;
+        ~relay() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto get_native_handle() const -> up::stream::native_handle;
+        // returns true if both directions are finished (never blocks)
+        bool try_pump();
+        // pumps until both directions are finished
+        void pump(up::stream::patience& patience);
+        void pump(up::stream::patience&& patience)
+        {
+            pump(patience);
+        }
+        auto transferred(direction direction) const -> uint64_t;
+    };
+
+
     class tcp::listener final
     {
     public: // --- scope ---
         using self = listener;
+        class accept_options;
         class impl;
         static void destroy(impl* ptr);
     private: // --- state ---
@@ -232,6 +357,83 @@ namespace up_inet
         {
             return accept(patience);
         }
+        // transfers through the ring (see uring::open regarding fallback)
+        auto accept(up::stream::patience& patience, up::uring& ring) -> connection;
+        auto accept(up::stream::patience&& patience, up::uring& ring) -> connection
+        {
+            return accept(patience, ring);
+        }
+        auto accept_basic(up::stream::patience& patience) -> basic_connection;
+        // defined below (basic_engine is still incomplete at this point)
+        inline auto accept_basic(up::stream::patience&& patience) -> basic_connection;
+        /* Accepts all pending connections (up to max) after a single
+         * readiness notification, i.e. it waits only if no connection is
+         * pending. The options are applied to each connection while
+         * accepting. If an accept fails after some connections have been
+         * accepted, these connections are returned. */
+        auto accept_many(up::stream::patience& patience, std::size_t max, const accept_options& options)
+            -> std::vector<connection>;
+        auto accept_many(up::stream::patience&& patience, std::size_t max, const accept_options& options)
+            -> std::vector<connection>
+        {
+            return accept_many(patience, max, options);
+        }
+        // returns nothing if no connection is pending (never waits)
+        auto try_accept() -> up::optional<connection>;
+        auto get_native_handle() const -> up::stream::native_handle;
+        // prefers this listener for connections received on the CPU (SO_INCOMING_CPU)
+        void incoming_cpu(int cpu) const;
+        /* Attaches a classic BPF program to the reuseport group of the
+         * listener, that selects the listener for each connection by the CPU
+         * receiving its packets: The listener at position i in the group
+         * (i.e. in the order of listen) handles the CPU cpus[i]. Other CPUs
+         * are mapped with modulo. */
+        void steer_by_cpu(const std::vector<int>& cpus) const;
+    private:
+        auto _accept(up::stream::patience& patience, up::uring* ring) -> connection;
+        auto _try_accept(up::uring* ring) -> up::optional<connection>;
+    };
+
+
+    // socket options for accepted connections (see listener::accept_many)
+    class tcp::listener::accept_options final
+    {
+    public: // --- scope ---
+        using self = accept_options;
+        struct keepalive_settings
+        {
+            std::chrono::seconds idle;
+            std::size_t probes;
+            std::chrono::seconds interval;
+        };
+    private: // --- state ---
+        bool _nodelay = true;
+        up::optional<std::pair<connection::qos_priority, connection::qos_drop>> _qos;
+        up::optional<keepalive_settings> _keepalive;
+    public: // --- operations ---
+        auto nodelay(bool enabled) & -> self& { _nodelay = enabled; return *this; }
+        auto nodelay(bool enabled) && -> self&& { return std::move(nodelay(enabled)); }
+        auto qos(connection::qos_priority priority, connection::qos_drop drop) & -> self&
+        {
+            _qos.emplace(priority, drop);
+            return *this;
+        }
+        auto qos(connection::qos_priority priority, connection::qos_drop drop) && -> self&&
+        {
+            return std::move(qos(priority, drop));
+        }
+        auto keepalive(std::chrono::seconds idle, std::size_t probes, std::chrono::seconds interval) & -> self&
+        {
+            _keepalive = keepalive_settings{idle, probes, interval};
+            return *this;
+        }
+        auto keepalive(std::chrono::seconds idle, std::size_t probes, std::chrono::seconds interval) && -> self&&
+        {
+            return std::move(keepalive(idle, probes, interval));
+        }
+        bool get_nodelay() const { return _nodelay; }
+        auto get_qos() const -> auto& { return _qos; }
+        auto get_keepalive() const -> auto& { return _keepalive; }
     };
 
 
@@ -239,7 +441,10 @@ namespace up_inet
     {
     public: // --- scope ---
         using self = socket;
-        enum class option : uint8_t { reuseaddr, reuseport, freebind, };
+        /* fastopen: accepts data in the SYN of incoming connections
+         * (TCP_FASTOPEN), which requires the server bit of the sysctl
+         * net.ipv4.tcp_fastopen. */
+        enum class option : uint8_t { reuseaddr, reuseport, freebind, fastopen, };
         using options = up::enum_set<option>;
         class impl;
         static void destroy(impl* ptr);
@@ -269,15 +474,162 @@ namespace up_inet
         {
             return std::move(*this).connect(remote, patience);
         }
+        // transfers through the ring (see uring::open regarding fallback)
+        auto connect(const tcp::endpoint& remote, up::stream::patience& patience, up::uring& ring) && -> connection;
+        auto connect(const tcp::endpoint& remote, up::stream::patience&& patience, up::uring& ring) && -> connection
+        {
+            return std::move(*this).connect(remote, patience, ring);
+        }
+        /* Connects and sends the data. If the client has a Fast Open cookie
+         * of the server, the connection is established on the first write,
+         * and the data is sent within the SYN. Otherwise, a cookie is
+         * requested, and the data is sent after the handshake. */
+        auto connect_fastopen(const tcp::endpoint& remote, up::chunk::from data, up::stream::patience& patience) &&
+            -> connection;
+        auto connect_fastopen(const tcp::endpoint& remote, up::chunk::from data, up::stream::patience&& patience) &&
+            -> connection
+        {
+            return std::move(*this).connect_fastopen(remote, data, patience);
+        }
+        auto connect_basic(const tcp::endpoint& remote, up::stream::patience& patience) && -> basic_connection;
+        // defined below (basic_engine is still incomplete at this point)
+        inline auto connect_basic(const tcp::endpoint& remote, up::stream::patience&& patience) && -> basic_connection;
+        /* Starts or continues the connection establishment without waiting.
+         * Returns false while the connection is in progress. In this case,
+         * the caller should wait until the native handle becomes writable,
+         * and invoke the function again. Once it has returned true, connect
+         * completes immediately. */
+        auto try_connect(const tcp::endpoint& remote) -> bool;
+        auto get_native_handle() const -> up::stream::native_handle;
         auto listen(int backlog) && -> listener;
+    private:
+        auto _connect(const tcp::endpoint& remote, up::stream::patience& patience, up::uring* ring) && -> connection;
+        void _wait_connected(const tcp::endpoint& remote, up::stream::patience& patience);
+    };
+
+
+    /**
+     * Engine of basic_connection with the same transfers as the engine of
+     * tcp::connection (without io_uring and zero-copy). The operations are
+     * not virtual, and the transfers are defined inline, so that the whole
+     * call chain from basic_stream down to the system call can be inlined.
+     * Only the error handling is out of line.
+     */
+    class tcp::basic_engine final
+    {
+    public: // --- scope ---
+        using self = basic_engine;
+        using status = up::stream::engine::status;
+        using operation = up::stream::patience::operation;
+        enum class transfer : uint8_t { read, write, readv, writev, };
+        friend connection;
+    private: // --- state ---
+        std::shared_ptr<socket::impl> _socket; // nullptr if moved-from
+        const int* _fd; // descriptor of the socket (-1 after hard_close)
+        tcp::endpoint _remote;
+    public: // --- life ---
+        explicit basic_engine(std::shared_ptr<socket::impl> socket, tcp::endpoint remote);
+        basic_engine(const self& rhs) = delete;
+        basic_engine(self&& rhs) noexcept = default;
+        ~basic_engine() noexcept;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_socket, rhs._socket);
+            up::swap_noexcept(_fd, rhs._fd);
+            up::swap_noexcept(_remote, rhs._remote);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto local() const -> tcp::endpoint;
+        auto remote() const -> const tcp::endpoint& { return _remote; }
+        // see connection::cork
+        void cork(bool enabled) const;
+        auto try_shutdown() const -> status;
+        void hard_close() const;
+        auto try_read_some(up::chunk::into chunk) const -> status
+        {
+            return _transfer(operation::read, transfer::read, chunk.size(), chunk.size(),
+                [&]() { return ::recv(*_fd, chunk.data(), chunk.size(), 0); });
+        }
+        auto try_write_some(up::chunk::from chunk) const -> status
+        {
+            return _transfer(operation::write, transfer::write, chunk.size(), chunk.size(),
+                [&]() { return ::send(*_fd, chunk.data(), chunk.size(), MSG_NOSIGNAL); });
+        }
+        auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status
+        {
+            return _transfer(operation::read, transfer::readv, chunks.count(), chunks.total(),
+                [&]() {
+                    msghdr msg{};
+                    msg.msg_iov = chunks.as<iovec>();
+                    msg.msg_iovlen = chunks.count();
+                    return ::recvmsg(*_fd, &msg, 0);
+                });
+        }
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status
+        {
+            return _transfer(operation::write, transfer::writev, chunks.count(), chunks.total(),
+                [&]() {
+                    msghdr msg{};
+                    msg.msg_iov = chunks.as<iovec>();
+                    msg.msg_iovlen = chunks.count();
+                    return ::sendmsg(*_fd, &msg, MSG_NOSIGNAL);
+                });
+        }
+        auto get_native_handle() const -> up::stream::native_handle
+        {
+            return up::stream::native_handle(*_fd);
+        }
+    private:
+        // see do_transfer in the implementation file
+        template <typename Operation>
+        auto _transfer(operation op, transfer kind, std::size_t count, std::size_t total, Operation&& call) const
+            -> status
+        {
+            bool restarted = false;
+            for (;;) {
+                ssize_t rv = call();
+                if (rv != -1) {
+                    return std::size_t(rv);
+                } else if (errno == EINTR && !restarted) {
+                    restarted = true;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return status::would_block(op);
+                } else {
+                    _raise(kind, errno, count, total);
+                }
+            }
+        }
+        [[noreturn]]
+        void _raise(transfer kind, int error, std::size_t count, std::size_t total) const;
     };
 
 
+    inline auto tcp::listener::accept_basic(up::stream::patience&& patience) -> basic_connection
+    {
+        return accept_basic(patience);
+    }
+
+    inline auto tcp::socket::connect_basic(const tcp::endpoint& remote, up::stream::patience&& patience) && -> basic_connection
+    {
+        return std::move(*this).connect_basic(remote, patience);
+    }
+
+
     class udp final
     {
     public: // --- scope ---
         enum class port : uint16_t { any = 0, };
+        class endpoint;
         class invalid_service;
+        class datagram;
+        class socket;
         // raises invalid_service
         static auto resolve_name(port port) -> up::unique_string;
         // raises invalid_service
@@ -287,8 +639,152 @@ namespace up_inet
     auto to_string(udp::port value) -> up::unique_string;
 
 
+    // value class for UDP endpoints (consisting of IP address and port)
+    class udp::endpoint final
+    {
+    public: // --- scope ---
+        using self = endpoint;
+        static const self any;
+    private: // --- state ---
+        ip::endpoint _address;
+        udp::port _port;
+    public: // --- life ---
+        // implicit constructor
+        endpoint(ip::endpoint address, udp::port port)
+            : _address(std::move(address)), _port(std::move(port))
+        { }
+    public: // --- operations ---
+        auto to_insight() const -> up::insight;
+        auto address() const -> const ip::endpoint& { return _address; }
+        auto port() const -> udp::port { return _port; }
+    };
+
+
     class udp::invalid_service { };
 
+
+    // value class for the metadata of a received datagram
+    class udp::datagram final
+    {
+    public: // --- scope ---
+        using self = datagram;
+    private: // --- state ---
+        udp::endpoint _source;
+        std::size_t _size;
+        std::size_t _segment_size;
+        bool _truncated;
+    public: // --- life ---
+        explicit datagram(udp::endpoint source, std::size_t size, std::size_t segment_size, bool truncated)
+            : _source(std::move(source)), _size(size), _segment_size(segment_size), _truncated(truncated)
+        { }
+    public: // --- operations ---
+        auto to_insight() const -> up::insight;
+        auto source() const -> const udp::endpoint& { return _source; }
+        // number of bytes stored in the chunk
+        auto size() const -> std::size_t { return _size; }
+        /* Size of the coalesced datagrams (see socket::gro), except for the
+         * last one, which may be shorter. Equal to size otherwise. */
+        auto segment_size() const -> std::size_t { return _segment_size; }
+        // the datagram was larger than the chunk (the rest was discarded)
+        auto truncated() const -> bool { return _truncated; }
+    };
+
+
+    /**
+     * Non-blocking UDP socket with batched transfers: Each call transfers
+     * multiple datagrams with a single syscall (recvmmsg and sendmmsg),
+     * where each chunk corresponds to one datagram. The try_ functions
+     * return the number of transferred datagrams, or zero if they would
+     * block. The other functions wait with the given patience until at
+     * least one datagram has been received, or until all datagrams have
+     * been sent, respectively.
+     */
+    class udp::socket final
+    {
+    public: // --- scope ---
+        using self = socket;
+        enum class option : uint8_t { reuseaddr, reuseport, freebind, };
+        using options = up::enum_set<option>;
+        class impl;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        explicit socket(ip::version version); // unbound socket
+        explicit socket(const udp::endpoint& endpoint, options options); // bound socket
+        socket(const self& rhs) = delete;
+        socket(self&& rhs) noexcept = default;
+        ~socket() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto local() const -> udp::endpoint;
+        /* Sets the default destination for sends without destination, and
+         * discards datagrams from all other sources. */
+        void connect(const udp::endpoint& remote) const;
+        /* Enables the coalescing of consecutive datagrams of the same flow
+         * into a single received datagram (UDP_GRO), that is split at
+         * datagram::segment_size. The chunks should be large enough for
+         * 64 KB. */
+        void gro(bool enabled) const;
+        // replaces the content of datagrams (one entry per received datagram)
+        auto try_recv_many(const up::chunk::into* chunks, std::size_t count,
+            std::vector<datagram>& datagrams) const -> std::size_t;
+        auto recv_many(const up::chunk::into* chunks, std::size_t count,
+            std::vector<datagram>& datagrams, up::stream::patience& patience) const -> std::size_t;
+        auto recv_many(const up::chunk::into* chunks, std::size_t count,
+            std::vector<datagram>& datagrams, up::stream::patience&& patience) const -> std::size_t
+        {
+            return recv_many(chunks, count, datagrams, patience);
+        }
+        // to the connected remote
+        auto try_send_many(const up::chunk::from* chunks, std::size_t count) const -> std::size_t;
+        auto try_send_many(const udp::endpoint& destination,
+            const up::chunk::from* chunks, std::size_t count) const -> std::size_t;
+        void send_many(const up::chunk::from* chunks, std::size_t count, up::stream::patience& patience) const;
+        void send_many(const up::chunk::from* chunks, std::size_t count, up::stream::patience&& patience) const
+        {
+            send_many(chunks, count, patience);
+        }
+        void send_many(const udp::endpoint& destination,
+            const up::chunk::from* chunks, std::size_t count, up::stream::patience& patience) const;
+        void send_many(const udp::endpoint& destination,
+            const up::chunk::from* chunks, std::size_t count, up::stream::patience&& patience) const
+        {
+            send_many(destination, chunks, count, patience);
+        }
+        /* Sends the chunk as datagrams of segment_size bytes (the last one
+         * may be shorter), that are split by the kernel or the NIC
+         * (UDP_SEGMENT). Each syscall covers up to 64 datagrams, so the
+         * try_ functions return the number of sent bytes, or zero if they
+         * would block. */
+        auto try_send_segmented(up::chunk::from chunk, std::size_t segment_size) const -> std::size_t;
+        auto try_send_segmented(const udp::endpoint& destination,
+            up::chunk::from chunk, std::size_t segment_size) const -> std::size_t;
+        void send_segmented(up::chunk::from chunk, std::size_t segment_size, up::stream::patience& patience) const;
+        void send_segmented(up::chunk::from chunk, std::size_t segment_size, up::stream::patience&& patience) const
+        {
+            send_segmented(chunk, segment_size, patience);
+        }
+        void send_segmented(const udp::endpoint& destination,
+            up::chunk::from chunk, std::size_t segment_size, up::stream::patience& patience) const;
+        void send_segmented(const udp::endpoint& destination,
+            up::chunk::from chunk, std::size_t segment_size, up::stream::patience&& patience) const
+        {
+            send_segmented(destination, chunk, segment_size, patience);
+        }
+        auto get_native_handle() const -> up::stream::native_handle;
+    };
+
 }
 
 namespace up
@@ -0,0 +1,613 @@
+#include "up_local.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "up_defer.hpp"
+#include "up_exception.hpp"
+#include "up_ints.hpp"
+#include "up_nts.hpp"
+#include "up_string_literal.hpp"
+#include "up_terminate.hpp"
+
+
+namespace
+{
+
+    using operation = up::stream::patience::operation;
+    using status = up::stream::engine::status;
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+    auto make_endpoint(const sockaddr_un& addr, socklen_t length) -> up_local::local::endpoint
+    {
+        constexpr auto offset = offsetof(sockaddr_un, sun_path);
+        if (length > sizeof(addr)) {
+            throw up::make_exception("invalid-local-endpoint-address-size").with(length, sizeof(addr));
+        } else if (length <= offset) {
+            return up_local::local::endpoint::make_unnamed();
+        } else if (addr.sun_path[0] == '\0') {
+            return up_local::local::endpoint::make_abstract(
+                up::shared_string(addr.sun_path + 1, length - offset - 1));
+        } else {
+            // the pathname might be null-terminated (or not)
+            auto size = ::strnlen(addr.sun_path, length - offset);
+            return up_local::local::endpoint(up::shared_string(addr.sun_path, size));
+        }
+    }
+
+    template <typename Callable>
+    auto identify_endpoint(Callable&& callable, int fd)
+    {
+        sockaddr_un addr;
+        socklen_t length = sizeof(addr);
+        int rv = callable(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+        if (rv == 0) {
+            return make_endpoint(addr, length);
+        } else {
+            throw up::make_exception("endpoint-identification-error").with(up::errno_info(errno));
+        }
+    }
+
+    template <typename Callable>
+    auto with_sockaddr(const up_local::local::endpoint& endpoint, Callable&& callable)
+    {
+        using kind = up_local::local::endpoint::kind;
+        auto&& name = endpoint.name();
+        sockaddr_un sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        // abstract names start with a null character, and pathnames end with one
+        if (endpoint.get_kind() == kind::unnamed || name.size() + 1 > sizeof(sa.sun_path)) {
+            throw up::make_exception("invalid-local-endpoint").with(endpoint);
+        } else if (endpoint.get_kind() == kind::abstract) {
+            std::memcpy(sa.sun_path + 1, name.data(), name.size());
+        } else {
+            std::memcpy(sa.sun_path, name.data(), name.size());
+        }
+        auto length = offsetof(sockaddr_un, sun_path) + name.size() + 1;
+        return std::forward<Callable>(callable)(
+            reinterpret_cast<const sockaddr*>(&sa), up::ints::cast<socklen_t>(length));
+    }
+
+    template <typename Operation, typename... Args>
+    auto do_transfer(operation op, Operation&& operation, up::source&& source, Args&&... args) -> status
+    {
+        for (;;) {
+            ssize_t rv = operation();
+            if (rv != -1) {
+                return std::size_t(rv);
+            } else if (errno == EINTR) {
+                // restart
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return status::would_block(op);
+            } else {
+                throw up::make_exception(std::move(source))
+                    .with(std::forward<Args>(args)..., up::errno_info(errno));
+            }
+        }
+    }
+
+}
+
+
+auto up_local::local::endpoint::make_abstract(up::shared_string name) -> self
+{
+    return self(kind::abstract, std::move(name));
+}
+
+auto up_local::local::endpoint::make_unnamed() -> self
+{
+    return self(kind::unnamed, up::shared_string());
+}
+
+up_local::local::endpoint::endpoint(up::shared_string pathname)
+    : self(kind::pathname, std::move(pathname))
+{ }
+
+up_local::local::endpoint::endpoint(local::endpoint::kind type, up::shared_string name)
+    : _kind(type), _name(std::move(name))
+{
+    if ((_kind == kind::unnamed) != _name.empty()) {
+        throw up::make_exception("invalid-local-endpoint-name").with(_kind, _name);
+    }
+}
+
+auto up_local::local::endpoint::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "local-endpoint",
+        up::invoke_to_insight_with_fallback(_kind),
+        up::invoke_to_insight_with_fallback(_name));
+}
+
+auto up_local::to_string(local::endpoint::kind value) -> up::unique_string
+{
+    using namespace up::literals;
+    using kind = local::endpoint::kind;
+    switch (value) {
+    case kind::unnamed:
+        return up::invoke_to_string("unnamed"_sl);
+    case kind::pathname:
+        return up::invoke_to_string("pathname"_sl);
+    case kind::abstract:
+        return up::invoke_to_string("abstract"_sl);
+    }
+    throw up::make_exception("invalid-local-endpoint-kind").with(up::to_underlying_type(value));
+}
+
+
+up_local::local::descriptor::~descriptor() noexcept
+{
+    close_aux(_fd);
+}
+
+
+class up_local::local::socket::impl final
+{
+public: // --- scope ---
+    using self = impl;
+public: // --- state ---
+    local::endpoint _endpoint;
+    // non-blocking (see tcp::socket::impl)
+    int _fd;
+public: // --- life ---
+    explicit impl(const local::endpoint& endpoint)
+        : _endpoint(endpoint), _fd(-1)
+    {
+        _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_fd == -1) {
+            throw up::make_exception("local-socket-creation-error").with(up::errno_info(errno));
+        }
+    }
+    explicit impl(const local::endpoint& endpoint, int fd)
+        : _endpoint(endpoint), _fd(fd)
+    { }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        close_aux(_fd);
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    template <typename Result>
+    auto getsockopt(int level, int option) -> Result
+    {
+        Result result;
+        socklen_t length = sizeof(result);
+        int rv = ::getsockopt(_fd, level, option, &result, &length);
+        if (rv != 0) {
+            throw up::make_exception("query-local-socket-option-error")
+                .with(_fd, level, option, up::errno_info(errno));
+        } else if (length != sizeof(result)) {
+            throw up::make_exception("query-local-socket-option-size-mismatch")
+                .with(_fd, level, option, sizeof(result), length);
+        } else {
+            return result;
+        }
+    }
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "local-socket-impl",
+            up::invoke_to_insight_with_fallback(_endpoint),
+            up::invoke_to_insight_with_fallback(_fd));
+    }
+    void hard_close()
+    {
+        if (_fd == -1) {
+            throw up::make_exception("invalid-socket-state");
+        }
+        close_aux(_fd);
+    }
+    auto get_native_handle() const
+    {
+        return up::stream::native_handle(_fd);
+    }
+};
+
+
+class up_local::local::connection::engine final : public up::stream::engine
+{
+public: // --- scope ---
+    using self = engine;
+public: // --- state ---
+    std::shared_ptr<socket::impl> _socket;
+    local::endpoint _remote;
+public: // --- life ---
+    explicit engine(std::shared_ptr<socket::impl>&& socket, local::endpoint remote)
+        : _socket(std::move(socket)), _remote(std::move(remote))
+    { }
+    engine(const self& rhs) = delete;
+    engine(self&& rhs) noexcept = delete;
+    ~engine() noexcept override = default;
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "local-connection-engine",
+            up::invoke_to_insight_with_fallback(*_socket),
+            up::invoke_to_insight_with_fallback(_remote));
+    }
+private:
+    auto try_shutdown() const -> status override
+    {
+        int rv = ::shutdown(_socket->_fd, SHUT_WR);
+        if (rv != 0) {
+            throw up::make_exception("local-connection-shutdown-error")
+                .with(_remote, up::errno_info(errno));
+        }
+        return 0;
+    }
+    void hard_close() const override
+    {
+        _socket->hard_close();
+    }
+    auto try_read_some(up::chunk::into chunk) const -> status override
+    {
+        return do_transfer(operation::read,
+            [&]() { return ::recv(_socket->_fd, chunk.data(), chunk.size(), 0); },
+            "local-connection-read-error", _remote, chunk.size());
+    }
+    auto try_write_some(up::chunk::from chunk) const -> status override
+    {
+        return do_transfer(operation::write,
+            [&]() { return ::send(_socket->_fd, chunk.data(), chunk.size(), MSG_NOSIGNAL); },
+            "local-connection-write-error", _remote, chunk.size());
+    }
+    auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status override
+    {
+        return do_transfer(operation::read,
+            [&]() {
+                msghdr msg = {
+                    .msg_name = nullptr,
+                    .msg_namelen = 0,
+                    .msg_iov = chunks.as<iovec>(),
+                    .msg_iovlen = up::ints::caster(chunks.count()),
+                    .msg_control = nullptr,
+                    .msg_controllen = 0,
+                    .msg_flags = 0,
+                };
+                return ::recvmsg(_socket->_fd, &msg, 0);
+            },
+            "local-connection-readv-error", _remote, chunks.count(), chunks.total());
+    }
+    auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status override
+    {
+        return do_transfer(operation::write,
+            [&]() {
+                msghdr msg = {
+                    .msg_name = nullptr,
+                    .msg_namelen = 0,
+                    .msg_iov = chunks.as<iovec>(),
+                    .msg_iovlen = up::ints::caster(chunks.count()),
+                    .msg_control = nullptr,
+                    .msg_controllen = 0,
+                    .msg_flags = 0,
+                };
+                return ::sendmsg(_socket->_fd, &msg, MSG_NOSIGNAL);
+            },
+            "local-connection-writev-error", _remote, chunks.count(), chunks.total());
+    }
+    auto downgrade() -> std::unique_ptr<up::stream::engine> override
+    {
+        throw up::make_exception("local-bad-downgrade-error");
+    }
+    auto get_underlying_engine() const -> const engine* override
+    {
+        return this;
+    }
+    auto get_native_handle() const -> up::stream::native_handle override
+    {
+        return _socket->get_native_handle();
+    }
+};
+
+
+up_local::local::connection::connection(std::unique_ptr<engine> engine)
+    : stream(std::move(engine))
+{ }
+
+auto up_local::local::connection::to_insight() const -> up::insight
+{
+    auto&& insight = static_cast<const engine*>(get_underlying_engine())->to_insight();
+    if (auto&& counters = get_counters()) {
+        return up::insight(typeid(*this), "local-connection", std::move(insight), counters->to_insight());
+    } else {
+        return std::move(insight);
+    }
+}
+
+auto up_local::local::connection::local() const -> local::endpoint
+{
+    return identify_endpoint(::getsockname, static_cast<const engine*>(get_underlying_engine())->_socket->_fd);
+}
+
+auto up_local::local::connection::remote() const -> const local::endpoint&
+{
+    return static_cast<const engine*>(get_underlying_engine())->_remote;
+}
+
+auto up_local::local::connection::peer_credentials() const -> ucred
+{
+    return static_cast<const engine*>(get_underlying_engine())->_socket->getsockopt<ucred>(SOL_SOCKET, SO_PEERCRED);
+}
+
+auto up_local::local::connection::try_send_descriptors(up::chunk::from chunk, const std::vector<int>& descriptors) const
+    -> std::size_t
+{
+    if (chunk.size() == 0 || descriptors.size() > max_descriptors) {
+        throw up::make_exception("invalid-local-connection-descriptors")
+            .with(remote(), chunk.size(), descriptors.size());
+    }
+    auto size = sizeof(int) * descriptors.size();
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_descriptors)];
+    iovec iov = {const_cast<char*>(chunk.data()), chunk.size()};
+    msghdr msg = {nullptr, 0, &iov, 1, control, CMSG_SPACE(size), 0};
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(size);
+    std::memcpy(CMSG_DATA(cmsg), descriptors.data(), size);
+    auto result = do_transfer(operation::write,
+        [&]() { return ::sendmsg(_fd(), &msg, MSG_NOSIGNAL); },
+        "local-connection-send-descriptors-error", remote(), descriptors.size());
+    return result.done() ? result.count() : 0;
+}
+
+void up_local::local::connection::send_descriptors(up::chunk::from chunk, const std::vector<int>& descriptors,
+    up::stream::patience& patience) const
+{
+    for (;;) {
+        if (auto count = try_send_descriptors(chunk, descriptors)) {
+            chunk.drain(count);
+            break;
+        }
+        patience(get_native_handle(), operation::write);
+    }
+    write_all(chunk, patience);
+}
+
+auto up_local::local::connection::try_receive_descriptors(up::chunk::into chunk, std::vector<descriptor>& descriptors) const
+    -> up::stream::engine::status
+{
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_descriptors)];
+    iovec iov = {chunk.data(), chunk.size()};
+    msghdr msg = {nullptr, 0, &iov, 1, control, sizeof(control), 0};
+    auto result = do_transfer(operation::read,
+        [&]() { return ::recvmsg(_fd(), &msg, MSG_CMSG_CLOEXEC); },
+        "local-connection-receive-descriptors-error", remote(), chunk.size());
+    if (!result.done()) {
+        return result;
+    }
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t i = 0; i != count; ++i) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+                descriptors.emplace_back(fd);
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        throw up::make_exception("local-connection-descriptors-truncated").with(remote());
+    }
+    return result;
+}
+
+auto up_local::local::connection::receive_descriptors(up::chunk::into chunk, std::vector<descriptor>& descriptors,
+    up::stream::patience& patience) const -> std::size_t
+{
+    for (;;) {
+        auto result = try_receive_descriptors(chunk, descriptors);
+        if (result.done()) {
+            return result.count();
+        }
+        patience(get_native_handle(), result.blocked_on());
+    }
+}
+
+auto up_local::local::connection::_fd() const -> int
+{
+    if (is_upgraded()) {
+        throw up::make_exception("local-connection-upgraded").with(remote());
+    }
+    return static_cast<const engine*>(get_underlying_engine())->_socket->_fd;
+}
+
+void up_local::local::connection::_vtable_dummy() const { }
+
+
+class up_local::local::listener::impl final
+{
+public: // --- scope ---
+    using self = impl;
+public: // --- state ---
+    up::impl_ptr<socket::impl, socket::destroy> _socket;
+public: // --- life ---
+    explicit impl(up::impl_ptr<socket::impl, socket::destroy>&& socket, int backlog)
+        : _socket(std::move(socket))
+    {
+        int rv = ::listen(_socket->_fd, backlog);
+        if (rv != 0) {
+            throw up::make_exception("local-socket-listen-error")
+                .with(_socket->_endpoint, backlog, up::errno_info(errno));
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept = default;
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "local-listener-impl",
+            up::invoke_to_insight_with_fallback(*_socket));
+    }
+};
+
+
+void up_local::local::listener::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_local::local::listener::listener(up::impl_ptr<impl, destroy> impl)
+    : _impl(std::move(impl))
+{ }
+
+auto up_local::local::listener::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_local::local::listener::accept(up::stream::patience& patience) -> connection
+{
+    for (;;) {
+        if (auto&& result = try_accept()) {
+            return std::move(*result);
+        }
+        patience(get_native_handle(), operation::read);
+    }
+}
+
+auto up_local::local::listener::try_accept() -> up::optional<connection>
+{
+    auto&& listener = *_impl->_socket;
+    for (;;) {
+        sockaddr_un addr;
+        socklen_t length = sizeof(addr);
+        int fd = ::accept4(listener._fd, reinterpret_cast<sockaddr*>(&addr), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd != -1) {
+            auto&& socket = [&]() {
+                try {
+                    return std::make_shared<socket::impl>(listener._endpoint, fd);
+                } catch (...) {
+                    close_aux(fd);
+                    throw;
+                }
+            }();
+            return connection(std::make_unique<connection::engine>(std::move(socket), make_endpoint(addr, length)));
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return { };
+        } else if (errno == EINTR) {
+            // restart
+        } else {
+            throw up::make_exception("local-listener-accept-error")
+                .with(listener._endpoint, up::errno_info(errno));
+        }
+    }
+}
+
+auto up_local::local::listener::get_native_handle() const -> up::stream::native_handle
+{
+    return _impl->_socket->get_native_handle();
+}
+
+
+void up_local::local::socket::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_local::local::socket::socket()
+    : _impl(up::impl_make(local::endpoint::make_unnamed()))
+{ }
+
+up_local::local::socket::socket(const local::endpoint& endpoint, options options)
+    : _impl(up::impl_make(endpoint))
+{
+    if (options.all(option::unlink) && endpoint.get_kind() == local::endpoint::kind::pathname) {
+        struct stat buffer;
+        auto&& pathname = up::nts(endpoint.name());
+        // only socket files are removed
+        if (::lstat(pathname, &buffer) == 0 && S_ISSOCK(buffer.st_mode) && ::unlink(pathname) != 0) {
+            throw up::make_exception("local-socket-unlink-error")
+                .with(endpoint, up::errno_info(errno));
+        }
+    }
+    int rv = with_sockaddr(endpoint, [fd=_impl->_fd](const sockaddr* addr, socklen_t addrlen) {
+            return ::bind(fd, addr, addrlen);
+        });
+    if (rv != 0) {
+        throw up::make_exception("local-socket-bind-error")
+            .with(endpoint, options, up::errno_info(errno));
+    }
+}
+
+auto up_local::local::socket::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_local::local::socket::endpoint() const -> const local::endpoint&
+{
+    return _impl->_endpoint;
+}
+
+auto up_local::local::socket::connect(const local::endpoint& remote, up::stream::patience& patience) && -> connection
+{
+    with_sockaddr(remote, [&](const sockaddr* addr, socklen_t addrlen) {
+            /* An unconnected socket is always writable, so there is nothing
+             * to wait for if the backlog of the listener is full. Instead,
+             * the attempts are repeated with an increasing delay. */
+            int timer_fd = -1;
+            UP_DEFER { close_aux(timer_fd); };
+            auto delay = std::chrono::milliseconds(1);
+            for (;;) {
+                int rv = ::connect(_impl->_fd, addr, addrlen);
+                if (rv == 0) {
+                    break;
+                } else if (errno == EINTR) {
+                    // restart
+                } else if (errno == EAGAIN) {
+                    if (timer_fd == -1) {
+                        timer_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+                        if (timer_fd == -1) {
+                            throw up::make_exception("local-socket-connect-timer-error")
+                                .with(remote, up::errno_info(errno));
+                        }
+                    }
+                    itimerspec its{};
+                    its.it_value.tv_nsec = up::ints::cast<long>(delay.count() * 1000000);
+                    if (::timerfd_settime(timer_fd, 0, &its, nullptr) != 0) {
+                        throw up::make_exception("local-socket-connect-timer-error")
+                            .with(remote, up::errno_info(errno));
+                    }
+                    patience(up::stream::native_handle(timer_fd), operation::read);
+                    delay = std::min(delay * 2, std::chrono::milliseconds(100));
+                } else {
+                    throw up::make_exception("local-socket-connect-error")
+                        .with(remote, up::errno_info(errno));
+                }
+            }
+        });
+    return connection(std::make_unique<connection::engine>(std::move(_impl), remote));
+}
+
+auto up_local::local::socket::get_native_handle() const -> up::stream::native_handle
+{
+    return _impl->get_native_handle();
+}
+
+auto up_local::local::socket::listen(int backlog) && -> listener
+{
+    return listener(up::impl_make(std::move(_impl), backlog));
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include "up_impl_ptr.hpp"
+#include "up_optional.hpp"
+#include "up_stream.hpp"
+#include "up_utility.hpp"
+
+namespace up_local
+{
+
+    /**
+     * Unix domain stream sockets (AF_UNIX). The scope is named local,
+     * because unix is a predefined macro on most platforms.
+     */
+    class local final
+    {
+    public: // --- scope ---
+        class endpoint;
+        class descriptor;
+        class connection;
+        class listener;
+        class socket;
+    };
+
+
+    /**
+     * Value class for unix domain socket addresses. Pathnames refer to
+     * socket files in the file system. Abstract names are Linux specific,
+     * and they disappear with the last socket. Unnamed endpoints are used
+     * for unbound sockets (e.g. the remote of accepted connections).
+     */
+    class local::endpoint final
+    {
+    public: // --- scope ---
+        using self = endpoint;
+        enum class kind : uint8_t { unnamed, pathname, abstract, };
+        static auto make_abstract(up::shared_string name) -> self;
+        static auto make_unnamed() -> self;
+    private: // --- state ---
+        local::endpoint::kind _kind;
+        up::shared_string _name;
+    public: // --- life ---
+        explicit endpoint(up::shared_string pathname);
+    private:
+        explicit endpoint(local::endpoint::kind type, up::shared_string name);
+    public: // --- operations ---
+        auto to_insight() const -> up::insight;
+        auto get_kind() const -> local::endpoint::kind { return _kind; }
+        // pathname or abstract name (without the leading null character)
+        auto name() const -> const up::shared_string& { return _name; }
+    };
+
+    auto to_string(local::endpoint::kind value) -> up::unique_string;
+
+
+    // owner of a file descriptor received from a peer (see connection)
+    class local::descriptor final
+    {
+    public: // --- scope ---
+        using self = descriptor;
+    private: // --- state ---
+        int _fd;
+    public: // --- life ---
+        explicit descriptor(int fd) noexcept
+            : _fd(fd)
+        { }
+        descriptor(const self& rhs) = delete;
+        descriptor(self&& rhs) noexcept
+            : _fd(std::exchange(rhs._fd, -1))
+        { }
+        ~descriptor() noexcept;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self&
+        {
+            self(std::move(rhs)).swap(*this);
+            return *this;
+        }
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_fd, rhs._fd);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto get() const -> int { return _fd; }
+        // the caller takes over the ownership
+        auto release() -> int { return std::exchange(_fd, -1); }
+    };
+
+
+    /**
+     * Stream over a connected unix domain socket. Besides the regular
+     * transfers, a connection can pass file descriptors (e.g. accepted
+     * TCP connections or open files) to the peer process (SCM_RIGHTS).
+     * The descriptors are attached to the first byte of the given chunk,
+     * and the receiver gets them together with this byte. The descriptor
+     * transfers are not available on upgraded connections.
+     */
+    class local::connection final : public up::stream
+    {
+    public: // --- scope ---
+        using self = connection;
+        class engine;
+        // SCM_MAX_FD of the kernel
+        static constexpr const std::size_t max_descriptors = 253;
+    public: // --- life ---
+        explicit connection(std::unique_ptr<engine> engine);
+    public: // --- operations ---
+        auto to_insight() const -> up::insight;
+        auto local() const -> local::endpoint;
+        auto remote() const -> const local::endpoint&;
+        // process, user and group of the peer at connection time (SO_PEERCRED)
+        auto peer_credentials() const -> ucred;
+        // returns the number of bytes sent (zero if it would block), chunk must not be empty
+        auto try_send_descriptors(up::chunk::from chunk, const std::vector<int>& descriptors) const -> std::size_t;
+        // sends the whole chunk
+        void send_descriptors(up::chunk::from chunk, const std::vector<int>& descriptors,
+            up::stream::patience& patience) const;
+        void send_descriptors(up::chunk::from chunk, const std::vector<int>& descriptors,
+            up::stream::patience&& patience) const
+        {
+            send_descriptors(chunk, descriptors, patience);
+        }
+        // appends the received descriptors (with close-on-exec)
+        auto try_receive_descriptors(up::chunk::into chunk, std::vector<descriptor>& descriptors) const
+            -> up::stream::engine::status;
+        // returns zero at the end of the stream
+        auto receive_descriptors(up::chunk::into chunk, std::vector<descriptor>& descriptors,
+            up::stream::patience& patience) const -> std::size_t;
+        auto receive_descriptors(up::chunk::into chunk, std::vector<descriptor>& descriptors,
+            up::stream::patience&& patience) const -> std::size_t
+        {
+            return receive_descriptors(chunk, descriptors, patience);
+        }
+    private:
+        auto _fd() const -> int;
+        // classes with vtables should have at least one out-of-line virtual method definition
+        __attribute__((unused))
+        void _vtable_dummy() const override;
+    };
+
+
+    class local::listener final
+    {
+    public: // --- scope ---
+        using self = listener;
+        class impl;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        explicit listener(up::impl_ptr<impl, destroy> impl);
+        listener(const self& rhs) = delete;
+        listener(self&& rhs) noexcept = default;
+        ~listener() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto accept(up::stream::patience& patience) -> connection;
+        auto accept(up::stream::patience&& patience) -> connection
+        {
+            return accept(patience);
+        }
+        // returns nothing if no connection is pending (never waits)
+        auto try_accept() -> up::optional<connection>;
+        auto get_native_handle() const -> up::stream::native_handle;
+    };
+
+
+    class local::socket final
+    {
+    public: // --- scope ---
+        using self = socket;
+        // unlink: removes an existing (stale) socket file before binding
+        enum class option : uint8_t { unlink, };
+        using options = up::enum_set<option>;
+        class impl;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        explicit socket(); // unbound socket
+        explicit socket(const local::endpoint& endpoint, options options); // bound socket
+        socket(const self& rhs) = delete;
+        socket(self&& rhs) noexcept = default;
+        ~socket() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto endpoint() const -> const local::endpoint&;
+        /* Connects immediately, or it waits while the backlog of the
+         * listener is full. */
+        auto connect(const local::endpoint& remote, up::stream::patience& patience) && -> connection;
+        auto connect(const local::endpoint& remote, up::stream::patience&& patience) && -> connection
+        {
+            return std::move(*this).connect(remote, patience);
+        }
+        auto get_native_handle() const -> up::stream::native_handle;
+        auto listen(int backlog) && -> listener;
+    };
+
+}
+
+namespace up
+{
+
+    using up_local::local;
+
+}
@@ -0,0 +1,115 @@
+#include "up_loopback.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "up_exception.hpp"
+#include "up_ring_engine.hpp"
+#include "up_terminate.hpp"
+
+
+namespace
+{
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+}
+
+
+// storage of both directions on the heap (shared by the two engines)
+class up_loopback::loopback::impl final
+{
+public: // --- scope ---
+    using self = impl;
+    static constexpr const char engine_label[] = "loopback-engine";
+    static constexpr const char closed_label[] = "loopback-engine-closed";
+    static constexpr const char write_after_shutdown_label[] = "loopback-engine-write-after-shutdown";
+    static constexpr const char broken_pipe_label[] = "loopback-engine-broken-pipe";
+    static constexpr const char bad_downgrade_label[] = "loopback-bad-downgrade-error";
+    static constexpr const char destructor_label[] = "loopback-engine-destructor";
+private: // --- state ---
+    std::size_t _capacity;
+    std::unique_ptr<char[]> _data;
+    up_ring_engine::ring_control _controls[2] = {};
+    std::atomic<uint32_t> _armed[2] = {};
+    int _event_fds[2] = {-1, -1};
+public: // --- life ---
+    explicit impl(std::size_t capacity)
+        : _capacity(capacity), _data(std::make_unique<char[]>(2 * capacity))
+    {
+        try {
+            for (auto&& fd : _event_fds) {
+                fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (fd == -1) {
+                    throw up::make_exception("loopback-eventfd-error").with(up::errno_info(errno));
+                }
+            }
+        } catch (...) {
+            _release();
+            throw;
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        _release();
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "loopback-impl",
+            up::invoke_to_insight_with_fallback(_capacity),
+            up::invoke_to_insight_with_fallback(_event_fds[0]),
+            up::invoke_to_insight_with_fallback(_event_fds[1]));
+    }
+    auto ring(std::size_t index) -> up_ring_engine::ring
+    {
+        return up_ring_engine::ring(&_controls[index], _data.get() + index * _capacity, _capacity);
+    }
+    auto wakeup(std::size_t index) -> up_ring_engine::wakeup
+    {
+        return up_ring_engine::wakeup(_event_fds[index], &_armed[index]);
+    }
+private:
+    void _release() noexcept
+    {
+        for (auto&& fd : _event_fds) {
+            close_aux(fd);
+        }
+    }
+};
+
+
+class up_loopback::loopback::engine final : public up_ring_engine::basic_engine<impl>
+{
+public: // --- life ---
+    using basic_engine::basic_engine;
+};
+
+
+auto up_loopback::loopback::make_engines(std::size_t capacity) -> engines
+{
+    if (capacity == 0) {
+        throw up::make_exception("invalid-loopback-capacity").with(capacity);
+    }
+    auto&& shared = std::make_shared<impl>(capacity);
+    return {std::make_unique<engine>(shared, 0), std::make_unique<engine>(shared, 1)};
+}
+
+auto up_loopback::loopback::make_streams(std::size_t capacity) -> streams
+{
+    auto&& engines = make_engines(capacity);
+    return {up::stream(std::move(engines.first)), up::stream(std::move(engines.second))};
+}
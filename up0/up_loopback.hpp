@@ -0,0 +1,40 @@
+#pragma once
+
+#include "up_stream.hpp"
+
+namespace up_loopback
+{
+
+    /**
+     * Pair of in-process stream engines, that are connected through two ring
+     * buffers (one per direction), e.g. for testing and benchmarking
+     * protocols, parsers and engine adapters (like TLS) without sockets.
+     *
+     * The transfers copy between the caller and the ring buffers without
+     * syscalls. Reads from an empty buffer and writes to a full buffer would
+     * block like on a non-blocking socket, so that the capacity can be used
+     * to simulate backpressure. The native handle of each engine is an
+     * eventfd, that is signaled by the peer only if the engine is waiting.
+     * So all patiences (including up::reactor) work as usual, and the two
+     * engines can be used from different threads.
+     */
+    class loopback final
+    {
+    public: // --- scope ---
+        class impl;
+        class engine;
+        using engines = std::pair<std::unique_ptr<up::stream::engine>, std::unique_ptr<up::stream::engine>>;
+        using streams = std::pair<up::stream, up::stream>;
+        // capacity of each direction in bytes
+        static auto make_engines(std::size_t capacity = 1 << 16) -> engines;
+        static auto make_streams(std::size_t capacity = 1 << 16) -> streams;
+    };
+
+}
+
+namespace up
+{
+
+    using up_loopback::loopback;
+
+}
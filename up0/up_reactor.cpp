@@ -0,0 +1,661 @@
+#include "up_reactor.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <list>
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "up_exception.hpp"
+#include "up_ints.hpp"
+#include "up_terminate.hpp"
+#include "up_utility.hpp"
+
+/*
+ * The fibers are implemented with the ucontext functions. They are slower
+ * than hand-written context switches, because swapcontext also saves and
+ * restores the signal mask. However, they are portable across all
+ * architectures supported by glibc, and the overhead is small compared to a
+ * blocking ppoll with a thread wakeup.
+ */
+
+namespace
+{
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+
+    /* Stack for a fiber. The memory is reserved with mmap, so that it is
+     * only committed on use, and the lowest page is protected to detect
+     * stack overflows. */
+    class fiber_stack final
+    {
+    private: // --- scope ---
+        using self = fiber_stack;
+    private: // --- state ---
+        void* _base = nullptr;
+        std::size_t _size = 0;
+    public: // --- life ---
+        explicit fiber_stack(std::size_t size)
+        {
+            auto page = up::ints::cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            _size = (size + page - 1) / page * page + page;
+            _base = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+            if (_base == MAP_FAILED) {
+                _base = nullptr;
+                throw up::make_exception("reactor-stack-allocation-error")
+                    .with(_size, up::errno_info(errno));
+            } else if (::mprotect(_base, page, PROT_NONE) != 0) {
+                int error = errno;
+                ::munmap(_base, _size);
+                _base = nullptr;
+                throw up::make_exception("reactor-stack-protection-error")
+                    .with(_size, up::errno_info(error));
+            }
+        }
+        fiber_stack(const self& rhs) = delete;
+        fiber_stack(self&& rhs) noexcept
+            : _base(std::exchange(rhs._base, nullptr)), _size(std::exchange(rhs._size, 0))
+        { }
+        ~fiber_stack() noexcept
+        {
+            if (_base && ::munmap(_base, _size) != 0) {
+                up::terminate("reactor-stack-release-error", _size);
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self&
+        {
+            fiber_stack temp(std::move(rhs));
+            std::swap(_base, temp._base);
+            std::swap(_size, temp._size);
+            return *this;
+        }
+        auto base() const { return _base; }
+        auto size() const { return _size; }
+    };
+
+}
+
+
+class up_reactor::reactor::impl final
+{
+public: // --- scope ---
+    using self = impl;
+    class waiter
+    {
+    public: // --- state ---
+        int _fd = -1;
+        operation _op = operation::read;
+        up::timer_wheel::timer _timer;
+    protected: // --- life ---
+        explicit waiter(impl& owner)
+            : _timer([this, &owner]() { owner._expire(*this); })
+        { }
+        waiter(const waiter& rhs) = delete;
+        waiter(waiter&& rhs) noexcept = delete;
+        ~waiter() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const waiter& rhs) & -> waiter& = delete;
+        auto operator=(waiter&& rhs) & noexcept -> waiter& = delete;
+        virtual void notify(impl& impl, bool expired) = 0;
+    };
+    class fiber;
+    class watcher;
+    struct registration
+    {
+        waiter* _read = nullptr;
+        waiter* _write = nullptr;
+        bool _added = false;
+    };
+private: // --- state ---
+    std::size_t _stack_size;
+    int _fd;
+    ucontext_t _scheduler;
+    std::list<fiber> _fibers;
+    std::list<watcher> _watchers;
+    std::deque<fiber*> _runnable;
+    std::vector<registration> _registrations;
+    std::vector<fiber_stack> _stacks; // for reuse
+    up::timer_wheel _timers;
+    std::vector<waiter*> _expired; // filled while advancing the timers
+    fiber* _current = nullptr;
+    std::exception_ptr _exception;
+public: // --- life ---
+    explicit impl(std::size_t stack_size);
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept;
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "reactor-impl",
+            up::invoke_to_insight_with_fallback(_fd),
+            up::invoke_to_insight_with_fallback(_fibers.size()),
+            up::invoke_to_insight_with_fallback(_watchers.size()),
+            up::invoke_to_insight_with_fallback(_timers));
+    }
+    auto timers() -> up::timer_wheel& { return _timers; }
+    void spawn(std::function<void()>&& work);
+    void watch(native_handle handle, operation op, const up::steady_time_point& expires_at, callback&& callback);
+    void forget(native_handle handle);
+    void park(native_handle handle, operation op, const up::steady_time_point& expires_at);
+    void run();
+    auto run_once(const up::duration& timeout) -> std::size_t;
+private:
+    static void _entry(unsigned int high, unsigned int low);
+    auto _registration(int fd) -> registration&;
+    void _attach(waiter& waiter, native_handle handle, operation op, const up::steady_time_point& expires_at);
+    void _detach(waiter& waiter);
+    void _expire(waiter& waiter);
+    void _forget(int fd);
+    void _arm(int fd, registration& registration);
+    auto _resume_runnable() -> std::size_t;
+    void _resume(fiber& fiber);
+    void _wait_and_dispatch(int timeout, std::vector<waiter*>& ready);
+    void _store_current_exception()
+    {
+        if (!_exception) {
+            _exception = std::current_exception();
+        } else {
+            up::suppress_current_exception("reactor-secondary-exception");
+        }
+    }
+};
+
+
+class up_reactor::reactor::impl::fiber final : public waiter
+{
+public: // --- state ---
+    std::function<void()> _work;
+    fiber_stack _stack;
+    ucontext_t _context;
+    std::list<fiber>::iterator _self;
+    std::exception_ptr _exception;
+    bool _started = false;
+    bool _finished = false;
+    bool _expired = false;
+    bool _cancelled = false;
+public: // --- life ---
+    explicit fiber(impl& owner, std::function<void()>&& work, fiber_stack&& stack)
+        : waiter(owner), _work(std::move(work)), _stack(std::move(stack))
+    { }
+public: // --- operations ---
+    void notify(impl& impl, bool expired) override
+    {
+        _expired = expired;
+        impl._runnable.push_back(this);
+    }
+};
+
+
+class up_reactor::reactor::impl::watcher final : public waiter
+{
+public: // --- state ---
+    callback _callback;
+    std::list<watcher>::iterator _self;
+public: // --- life ---
+    explicit watcher(impl& owner, callback&& callback)
+        : waiter(owner), _callback(std::move(callback))
+    { }
+public: // --- operations ---
+    void notify(impl& impl, bool expired) override
+    {
+        /* The watcher is removed before the callback is invoked, so that the
+         * callback can register a new watcher for the same handle. */
+        auto callback = std::move(_callback);
+        impl._watchers.erase(_self);
+        callback(expired);
+    }
+};
+
+
+up_reactor::reactor::impl::impl(std::size_t stack_size)
+    : _stack_size(stack_size), _fd(::epoll_create1(EPOLL_CLOEXEC))
+{
+    if (_fd == -1) {
+        throw up::make_exception("reactor-epoll-creation-error").with(up::errno_info(errno));
+    }
+}
+
+up_reactor::reactor::impl::~impl() noexcept
+{
+    /* Parked fibers are cancelled, i.e. they are resumed and the patience
+     * raises an exception, so that their stacks are unwound. The number of
+     * rounds is limited to guard against fibers that swallow the
+     * cancellation. */
+    _runnable.clear();
+    for (std::size_t round = 0; round != 8 && !_fibers.empty(); ++round) {
+        std::vector<fiber*> fibers;
+        for (auto&& fiber : _fibers) {
+            fibers.push_back(&fiber);
+        }
+        for (auto* fiber : fibers) {
+            _detach(*fiber);
+            if (!fiber->_started) {
+                // nothing to unwind
+                _fibers.erase(fiber->_self);
+                continue;
+            }
+            fiber->_cancelled = true;
+            try {
+                _resume(*fiber);
+            } catch (...) {
+                up::suppress_current_exception("reactor-fiber-cancellation");
+            }
+        }
+    }
+    _exception = nullptr;
+    close_aux(_fd);
+}
+
+void up_reactor::reactor::impl::spawn(std::function<void()>&& work)
+{
+    fiber_stack stack = [&]() {
+        if (_stacks.empty()) {
+            return fiber_stack(_stack_size);
+        } else {
+            auto result = std::move(_stacks.back());
+            _stacks.pop_back();
+            return result;
+        }
+    }();
+    _fibers.emplace_back(*this, std::move(work), std::move(stack));
+    auto& fiber = _fibers.back();
+    fiber._self = std::prev(_fibers.end());
+    if (::getcontext(&fiber._context) != 0) {
+        auto error = errno;
+        _fibers.pop_back();
+        throw up::make_exception("reactor-fiber-context-error").with(up::errno_info(error));
+    }
+    fiber._context.uc_stack.ss_sp = fiber._stack.base();
+    fiber._context.uc_stack.ss_size = fiber._stack.size();
+    fiber._context.uc_link = &_scheduler;
+    auto address = reinterpret_cast<uintptr_t>(&fiber);
+    ::makecontext(&fiber._context, reinterpret_cast<void (*)()>(&_entry), 2,
+        static_cast<unsigned int>(address >> 32), static_cast<unsigned int>(address));
+    _runnable.push_back(&fiber);
+}
+
+void up_reactor::reactor::impl::watch(
+    native_handle handle, operation op, const up::steady_time_point& expires_at, callback&& callback)
+{
+    _watchers.emplace_back(*this, std::move(callback));
+    auto& watcher = _watchers.back();
+    watcher._self = std::prev(_watchers.end());
+    try {
+        _attach(watcher, handle, op, expires_at);
+    } catch (...) {
+        _watchers.pop_back();
+        throw;
+    }
+}
+
+void up_reactor::reactor::impl::forget(native_handle handle)
+{
+    auto fd = up::to_underlying_type(handle);
+    auto& registration = _registration(fd);
+    if (registration._read || registration._write) {
+        throw up::make_exception("reactor-handle-still-watched").with(fd);
+    }
+    _forget(fd);
+}
+
+void up_reactor::reactor::impl::park(native_handle handle, operation op, const up::steady_time_point& expires_at)
+{
+    if (_current == nullptr) {
+        throw up::make_exception("reactor-patience-outside-fiber").with(op);
+    }
+    auto& fiber = *_current;
+    if (fiber._cancelled) {
+        throw up::make_exception("reactor-fiber-cancelled").with(op);
+    }
+    _attach(fiber, handle, op, expires_at);
+    if (::swapcontext(&fiber._context, &_scheduler) != 0) {
+        up::terminate("reactor-context-switch-error", errno);
+    }
+    if (fiber._cancelled) {
+        throw up::make_exception("reactor-fiber-cancelled").with(op);
+    } else if (fiber._expired) {
+        throw up::make_exception("reactor-patience-timeout", up::stream::timeout())
+            .with(op, expires_at);
+    } // else: ready
+}
+
+void up_reactor::reactor::impl::run()
+{
+    while (!_fibers.empty() || !_watchers.empty() || !_timers.empty()) {
+        run_once(up::duration::max());
+    }
+}
+
+auto up_reactor::reactor::impl::run_once(const up::duration& timeout) -> std::size_t
+{
+    std::size_t count = _resume_runnable();
+    int ms = -1;
+    if (!_runnable.empty()) {
+        ms = 0;
+    } else {
+        auto remaining = timeout;
+        if (!_timers.empty()) {
+            remaining = std::min(remaining, _timers.next_expiry() - up::steady_clock::now());
+        }
+        if (remaining <= up::duration::zero()) {
+            ms = 0;
+        } else if (remaining != up::duration::max()) {
+            // round up, so that the timers have expired after the wait
+            auto value = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+            ms = up::ints::cast<int>(std::min<decltype(value)>(value, std::numeric_limits<int>::max()));
+        } // else: infinite
+    }
+    std::vector<waiter*> ready;
+    _wait_and_dispatch(ms, ready);
+    /* The timers of waiters only collect the expired waiters, so that they
+     * are notified after the ready waiters (see _expire). Other timers
+     * (e.g. for idle expiry) invoke their callbacks directly. */
+    try {
+        count += _timers.advance(up::steady_clock::now());
+    } catch (...) {
+        _store_current_exception();
+    }
+    auto expired = std::exchange(_expired, { });
+    for (auto* waiter : ready) {
+        try {
+            waiter->notify(*this, false);
+            ++count;
+        } catch (...) {
+            _store_current_exception();
+        }
+    }
+    for (auto* waiter : expired) {
+        try {
+            waiter->notify(*this, true);
+        } catch (...) {
+            _store_current_exception();
+        }
+    }
+    count += _resume_runnable();
+    if (_exception) {
+        std::rethrow_exception(std::exchange(_exception, nullptr));
+    }
+    return count;
+}
+
+void up_reactor::reactor::impl::_entry(unsigned int high, unsigned int low)
+{
+    auto address = (static_cast<uintptr_t>(high) << 32) | static_cast<uintptr_t>(low);
+    auto& fiber = *reinterpret_cast<impl::fiber*>(address);
+    try {
+        fiber._work();
+    } catch (...) {
+        fiber._exception = std::current_exception();
+    }
+    fiber._work = nullptr;
+    fiber._finished = true;
+    // return to scheduler via uc_link
+}
+
+auto up_reactor::reactor::impl::_registration(int fd) -> registration&
+{
+    if (fd < 0) {
+        throw up::make_exception("reactor-invalid-handle").with(fd);
+    }
+    auto index = static_cast<std::size_t>(fd);
+    if (index >= _registrations.size()) {
+        _registrations.resize(index + 1);
+    }
+    return _registrations[index];
+}
+
+void up_reactor::reactor::impl::_attach(
+    waiter& waiter, native_handle handle, operation op, const up::steady_time_point& expires_at)
+{
+    auto fd = up::to_underlying_type(handle);
+    auto& registration = _registration(fd);
+    auto& slot = (op == operation::read) ? registration._read : registration._write;
+    if (slot) {
+        throw up::make_exception("reactor-handle-already-watched").with(fd, op);
+    }
+    slot = &waiter;
+    try {
+        _arm(fd, registration);
+    } catch (...) {
+        slot = nullptr;
+        throw;
+    }
+    if (expires_at != up::steady_time_point::max()) {
+        waiter._timer.arm(_timers, expires_at);
+    }
+    waiter._fd = fd;
+    waiter._op = op;
+}
+
+void up_reactor::reactor::impl::_detach(waiter& waiter)
+{
+    if (waiter._fd != -1) {
+        auto& registration = _registrations[static_cast<std::size_t>(waiter._fd)];
+        auto& slot = (waiter._op == operation::read) ? registration._read : registration._write;
+        if (slot == &waiter) {
+            slot = nullptr;
+        }
+        waiter._fd = -1;
+    }
+    waiter._timer.cancel();
+}
+
+void up_reactor::reactor::impl::_expire(waiter& waiter)
+{
+    _detach(waiter);
+    _expired.push_back(&waiter);
+}
+
+void up_reactor::reactor::impl::_forget(int fd)
+{
+    auto& registration = _registration(fd);
+    if (registration._added) {
+        registration._added = false;
+        /* Errors are ignored, because the handle might already have been
+         * closed (which implicitly removes it from the epoll set). */
+        ::epoll_ctl(_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+void up_reactor::reactor::impl::_arm(int fd, registration& registration)
+{
+    /* The handles are registered one-shot for the operations, that are
+     * waited for, and they are re-armed on each wait. So the registration
+     * never outlives a wait, and a handle with a reused number (after the
+     * previous one has been closed) is simply added again. */
+    epoll_event event;
+    event.events = EPOLLONESHOT;
+    if (registration._read) {
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (registration._write) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.u64 = 0;
+    event.data.fd = fd;
+    int rv = ::epoll_ctl(_fd, registration._added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+    if (rv != 0 && registration._added && errno == ENOENT) {
+        rv = ::epoll_ctl(_fd, EPOLL_CTL_ADD, fd, &event);
+    } else if (rv != 0 && !registration._added && errno == EEXIST) {
+        rv = ::epoll_ctl(_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+    if (rv != 0) {
+        throw up::make_exception("reactor-epoll-registration-error").with(fd, up::errno_info(errno));
+    }
+    registration._added = true;
+}
+
+auto up_reactor::reactor::impl::_resume_runnable() -> std::size_t
+{
+    /* Only the fibers that are runnable at the beginning are resumed, so
+     * that fibers which are continuously spawning other fibers can not
+     * starve the event processing. */
+    std::size_t count = 0;
+    for (auto n = _runnable.size(); n; --n) {
+        auto* fiber = _runnable.front();
+        _runnable.pop_front();
+        try {
+            _resume(*fiber);
+        } catch (...) {
+            _store_current_exception();
+        }
+        ++count;
+    }
+    return count;
+}
+
+void up_reactor::reactor::impl::_resume(fiber& fiber)
+{
+    _current = &fiber;
+    fiber._started = true;
+    if (::swapcontext(&_scheduler, &fiber._context) != 0) {
+        up::terminate("reactor-context-switch-error", errno);
+    }
+    _current = nullptr;
+    if (fiber._finished) {
+        auto exception = std::exchange(fiber._exception, nullptr);
+        if (_stacks.size() < 64) {
+            _stacks.push_back(std::move(fiber._stack));
+        }
+        _fibers.erase(fiber._self);
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+}
+
+void up_reactor::reactor::impl::_wait_and_dispatch(int timeout, std::vector<waiter*>& ready)
+{
+    epoll_event events[256];
+    int rv = ::epoll_wait(_fd, events, std::extent<decltype(events)>::value, timeout);
+    if (rv == -1 && errno == EINTR) {
+        return; // nothing (the caller will restart)
+    } else if (rv == -1) {
+        throw up::make_exception("reactor-epoll-wait-error").with(timeout, up::errno_info(errno));
+    }
+    for (int i = 0; i != rv; ++i) {
+        auto fd = events[i].data.fd;
+        auto flags = events[i].events;
+        auto& registration = _registration(fd);
+        if (registration._read && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+            auto* waiter = registration._read;
+            _detach(*waiter);
+            ready.push_back(waiter);
+        }
+        if (registration._write && (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+            auto* waiter = registration._write;
+            _detach(*waiter);
+            ready.push_back(waiter);
+        }
+        if (registration._read || registration._write) {
+            // the other operation is still waited for
+            try {
+                _arm(fd, registration);
+            } catch (...) {
+                _store_current_exception();
+            }
+        }
+    }
+}
+
+
+void up_reactor::reactor::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_reactor::reactor::reactor(std::size_t stack_size)
+    : _impl(up::impl_make(stack_size))
+{ }
+
+auto up_reactor::reactor::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+void up_reactor::reactor::spawn(std::function<void()> work)
+{
+    _impl->spawn(std::move(work));
+}
+
+void up_reactor::reactor::watch(native_handle handle, operation op, callback callback)
+{
+    _impl->watch(handle, op, up::steady_time_point::max(), std::move(callback));
+}
+
+void up_reactor::reactor::watch(
+    native_handle handle, operation op, const up::steady_time_point& expires_at, callback callback)
+{
+    _impl->watch(handle, op, expires_at, std::move(callback));
+}
+
+void up_reactor::reactor::forget(native_handle handle)
+{
+    _impl->forget(handle);
+}
+
+auto up_reactor::reactor::timers() -> up::timer_wheel&
+{
+    return _impl->timers();
+}
+
+void up_reactor::reactor::run()
+{
+    _impl->run();
+}
+
+auto up_reactor::reactor::run_once(const up::duration& timeout) -> std::size_t
+{
+    return _impl->run_once(timeout);
+}
+
+
+up_reactor::reactor::patience::patience(reactor& reactor)
+    : _reactor(&reactor), _expires_at(up::steady_time_point::max())
+{ }
+
+up_reactor::reactor::patience::patience(reactor& reactor, const up::steady_time_point& expires_at)
+    : _reactor(&reactor), _expires_at(expires_at)
+{ }
+
+up_reactor::reactor::patience::patience(reactor& reactor, const up::duration& expires_from_now)
+    : _reactor(&reactor), _expires_at(up::steady_clock::now() + expires_from_now)
+{ }
+
+auto up_reactor::reactor::patience::operator=(const up::steady_time_point& expires_at) & -> self&
+{
+    _expires_at = expires_at;
+    return *this;
+}
+
+auto up_reactor::reactor::patience::operator=(const up::duration& expires_from_now) & -> self&
+{
+    _expires_at = up::steady_clock::now() + expires_from_now;
+    return *this;
+}
+
+void up_reactor::reactor::patience::_wait(native_handle handle, operation op)
+{
+    _reactor->_impl->park(handle, op, _expires_at);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <functional>
+
+#include "up_chrono.hpp"
+#include "up_impl_ptr.hpp"
+#include "up_stream.hpp"
+#include "up_swap.hpp"
+#include "up_timer_wheel.hpp"
+
+namespace up_reactor
+{
+
+    /**
+     * The reactor multiplexes the I/O of many streams on a single thread. It
+     * is built on epoll, and the native handles are registered one-shot,
+     * i.e. they are re-armed for each wait.
+     *
+     * Work is executed in fibers, i.e. in lightweight execution contexts with
+     * their own (small and lazily committed) stacks. A fiber waits for a
+     * native handle with reactor::patience. Instead of blocking the thread,
+     * the patience parks the fiber on the reactor, and the reactor continues
+     * with other fibers until the handle becomes ready. That means the
+     * regular, sequential stream code can be used unchanged to serve many
+     * connections per thread.
+     *
+     * Alternatively, watch can be used to register a one-shot callback for a
+     * native handle. This is the building block for code that does not run
+     * in fibers.
+     *
+     * A registration never outlives its wait, so native handles can be
+     * closed at any time when they are not waited for (even if the kernel
+     * reuses the number for another handle). Nevertheless, forget removes
+     * the registration of a native handle immediately.
+     *
+     * The reactor is not thread-safe. All member functions must be called
+     * from the thread that runs the reactor.
+     */
+    class reactor final
+    {
+    public: // --- scope ---
+        using self = reactor;
+        using native_handle = up::stream::native_handle;
+        using operation = up::stream::patience::operation;
+        // the argument is true if the deadline has expired
+        using callback = std::function<void(bool expired)>;
+        class impl;
+        class patience;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        explicit reactor(std::size_t stack_size = std::size_t(1) << 16);
+        reactor(const self& rhs) = delete;
+        reactor(self&& rhs) noexcept = default;
+        ~reactor() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        /* The work is started on the next invocation of run or run_once.
+         * Exceptions escaping from the work are rethrown from run and
+         * run_once after the fiber has been terminated. */
+        void spawn(std::function<void()> work);
+        void watch(native_handle handle, operation op, callback callback);
+        void watch(native_handle handle, operation op, const up::steady_time_point& expires_at, callback callback);
+        void forget(native_handle handle);
+        /* The timer wheel of the reactor. It can be used for additional
+         * timers, e.g. for the idle expiry of connections. Their callbacks
+         * are invoked from run and run_once. */
+        auto timers() -> up::timer_wheel&;
+        // run until there are neither fibers nor watches nor timers left
+        void run();
+        // returns the number of resumed fibers and invoked callbacks
+        auto run_once(const up::duration& timeout) -> std::size_t;
+    };
+
+
+    /**
+     * The patience must only be used from fibers running on the given
+     * reactor. Like stream::deadline_patience, the deadline is shared by all
+     * waits, and it raises stream::timeout when the deadline has expired.
+     */
+    class reactor::patience final : public up::stream::patience
+    {
+    public: // --- scope ---
+        using self = patience;
+    private: // --- state ---
+        reactor* _reactor;
+        up::steady_time_point _expires_at;
+    public: // --- life ---
+        explicit patience(reactor& reactor);
+        explicit patience(reactor& reactor, const up::steady_time_point& expires_at);
+        explicit patience(reactor& reactor, const up::duration& expires_from_now);
+        patience(const self& rhs) = delete;
+        patience(self&& rhs) noexcept = default;
+        ~patience() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        auto operator=(const up::steady_time_point& expires_at) & -> self&;
+        auto operator=(const up::duration& expires_from_now) & -> self&;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_reactor, rhs._reactor);
+            up::swap_noexcept(_expires_at, rhs._expires_at);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+    private:
+        void _wait(native_handle handle, operation op) override;
+    };
+
+}
+
+namespace up
+{
+
+    using up_reactor::reactor;
+
+}
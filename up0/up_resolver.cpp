@@ -0,0 +1,379 @@
+#include "up_resolver.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "up_exception.hpp"
+#include "up_linked_map.hpp"
+#include "up_terminate.hpp"
+
+
+namespace
+{
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+}
+
+
+// completed lookup (shared by the cache and the queries)
+class up_resolver::resolver::entry final
+{
+public: // --- state ---
+    const up::shared_string _name;
+    const std::vector<up::ip::endpoint> _endpoints;
+    const std::exception_ptr _error; // nullptr on success
+    const up::steady_time_point _expires_at;
+public: // --- life ---
+    explicit entry(up::shared_string name, std::vector<up::ip::endpoint> endpoints,
+        std::exception_ptr error, const up::steady_time_point& expires_at)
+        : _name(std::move(name)), _endpoints(std::move(endpoints))
+        , _error(std::move(error)), _expires_at(expires_at)
+    { }
+};
+
+
+/* Pending lookup, that is shared by all queries of the same name. Each
+ * waiting query has its own eventfd, so that the queries can be waited
+ * for independently (e.g. by several fibers of the same reactor). */
+class up_resolver::resolver::request final
+{
+public: // --- scope ---
+    using self = request;
+private: // --- state ---
+    up::shared_string _name;
+    mutable std::mutex _mutex;
+    std::shared_ptr<const entry> _entry;
+    std::vector<int> _event_fds;
+public: // --- life ---
+    explicit request(up::shared_string name)
+        : _name(std::move(name))
+    { }
+    request(const self& rhs) = delete;
+    request(self&& rhs) noexcept = delete;
+    ~request() noexcept = default;
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto name() const -> const up::shared_string&
+    {
+        return _name;
+    }
+    // returns the entry if completed, otherwise the eventfd is registered
+    auto subscribe(int& event_fd) -> std::shared_ptr<const entry>
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_entry) {
+            return _entry;
+        }
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd == -1) {
+            throw up::make_exception("resolver-eventfd-error").with(_name, up::errno_info(errno));
+        }
+        try {
+            _event_fds.push_back(fd);
+        } catch (...) {
+            close_aux(fd);
+            throw;
+        }
+        event_fd = fd;
+        return nullptr;
+    }
+    void unsubscribe(int event_fd) noexcept
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _event_fds.erase(std::remove(_event_fds.begin(), _event_fds.end(), event_fd), _event_fds.end());
+    }
+    auto completed() const -> std::shared_ptr<const entry>
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entry;
+    }
+    void complete(std::shared_ptr<const entry> result) noexcept
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entry = std::move(result);
+        for (int fd : std::exchange(_event_fds, {})) {
+            uint64_t value = 1;
+            if (::write(fd, &value, sizeof(value)) != sizeof(value)) {
+                up::terminate("resolver-eventfd-write-error", errno);
+            }
+        }
+    }
+};
+
+
+class up_resolver::resolver::impl final
+{
+public: // --- scope ---
+    using self = impl;
+private: // --- state ---
+    const std::size_t _capacity;
+    const std::chrono::seconds _ttl;
+    const std::chrono::seconds _negative_ttl;
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    bool _stopping = false;
+    // cached names in the order of their last use
+    up::linked_map<up::shared_string, std::shared_ptr<const entry>> _cache;
+    std::unordered_map<up::shared_string, std::shared_ptr<request>> _pending;
+    std::deque<std::shared_ptr<request>> _queue;
+    std::vector<std::thread> _threads;
+public: // --- life ---
+    explicit impl(std::size_t threads, std::size_t capacity,
+        std::chrono::seconds ttl, std::chrono::seconds negative_ttl)
+        : _capacity(capacity), _ttl(ttl), _negative_ttl(negative_ttl)
+    {
+        if (threads == 0) {
+            throw up::make_exception("resolver-bad-threads").with(threads);
+        }
+        try {
+            for (std::size_t i = 0; i != threads; ++i) {
+                _threads.emplace_back([this]() noexcept { _work(); });
+            }
+        } catch (...) {
+            _stop();
+            throw;
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        _stop();
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "resolver-impl",
+            up::invoke_to_insight_with_fallback(_threads.size()),
+            up::invoke_to_insight_with_fallback(_capacity),
+            up::invoke_to_insight_with_fallback(size()));
+    }
+    auto lookup(const up::string_view& name) -> query
+    {
+        auto key = up::shared_string(name.data(), name.size());
+        std::shared_ptr<request> pending;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto p = _cache.find(key);
+            if (p != _cache.end()) {
+                if (up::steady_clock::now() < p->second->_expires_at) {
+                    _cache.splice(_cache.end(), _cache, p);
+                    return query(p->second);
+                }
+                _cache.erase(p);
+            }
+            auto& slot = _pending[key];
+            if (slot) {
+                // joins the lookup of another caller
+                pending = slot;
+            } else {
+                try {
+                    slot = std::make_shared<request>(key);
+                    _queue.push_back(slot);
+                } catch (...) {
+                    _pending.erase(key);
+                    throw;
+                }
+                pending = slot;
+                _condition.notify_one();
+            }
+        }
+        return query(std::move(pending));
+    }
+    auto size() const -> std::size_t
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _cache.size();
+    }
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cache.clear();
+    }
+private:
+    void _work()
+    {
+        for (;;) {
+            std::shared_ptr<request> next;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return _stopping || !_queue.empty(); });
+                if (_stopping) {
+                    return;
+                }
+                next = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            _complete(*next, _resolve(next->name()));
+        }
+    }
+    auto _resolve(const up::shared_string& name) -> std::shared_ptr<const entry>
+    {
+        try {
+            auto endpoints = up::ip::resolve_endpoints(name);
+            return std::make_shared<const entry>(
+                name, std::move(endpoints), nullptr, up::steady_clock::now() + _ttl);
+        } catch (...) {
+            return std::make_shared<const entry>(
+                name, std::vector<up::ip::endpoint>(), std::current_exception(),
+                up::steady_clock::now() + _negative_ttl);
+        }
+    }
+    void _complete(request& pending, std::shared_ptr<const entry> result)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending.erase(pending.name());
+            if (_capacity) {
+                _cache.erase(pending.name());
+                _cache.emplace(pending.name(), result);
+                while (_cache.size() > _capacity) {
+                    _cache.pop_front();
+                }
+            }
+        }
+        pending.complete(std::move(result));
+    }
+    void _stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _condition.notify_all();
+        for (auto&& thread : _threads) {
+            thread.join();
+        }
+        // the remaining lookups fail (the queries might still be waiting)
+        for (auto&& pending : std::exchange(_queue, {})) {
+            std::exception_ptr error;
+            try {
+                throw up::make_exception("resolver-stopped").with(pending->name());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            _complete(*pending, std::make_shared<const entry>(
+                    pending->name(), std::vector<up::ip::endpoint>(), error, up::steady_clock::now()));
+        }
+    }
+};
+
+
+up_resolver::resolver::resolver(
+    std::size_t threads, std::size_t capacity, std::chrono::seconds ttl, std::chrono::seconds negative_ttl)
+    : _impl(up::impl_make(threads, capacity, ttl, negative_ttl))
+{ }
+
+void up_resolver::resolver::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+auto up_resolver::resolver::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_resolver::resolver::lookup(const up::string_view& name) -> query
+{
+    return _impl->lookup(name);
+}
+
+auto up_resolver::resolver::resolve_endpoints(const up::string_view& name, up::stream::patience& patience)
+    -> std::vector<up::ip::endpoint>
+{
+    return lookup(name).wait(patience);
+}
+
+auto up_resolver::resolver::size() const -> std::size_t
+{
+    return _impl->size();
+}
+
+void up_resolver::resolver::clear()
+{
+    _impl->clear();
+}
+
+
+up_resolver::resolver::query::query(std::shared_ptr<const entry> completed)
+    : _entry(std::move(completed))
+{ }
+
+up_resolver::resolver::query::query(std::shared_ptr<request> pending)
+    : _request(std::move(pending))
+{
+    _entry = _request->subscribe(_event_fd);
+}
+
+up_resolver::resolver::query::~query() noexcept
+{
+    if (_event_fd != -1) {
+        _request->unsubscribe(_event_fd);
+        close_aux(_event_fd);
+    }
+}
+
+auto up_resolver::resolver::query::to_insight() const -> up::insight
+{
+    auto&& completed = _completed();
+    return up::insight(typeid(*this), "resolver-query",
+        up::invoke_to_insight_with_fallback(completed ? completed->_name : _request->name()),
+        up::invoke_to_insight_with_fallback(bool(completed)),
+        up::invoke_to_insight_with_fallback(_event_fd));
+}
+
+auto up_resolver::resolver::query::done() const -> bool
+{
+    return bool(_completed());
+}
+
+auto up_resolver::resolver::query::get_native_handle() const -> up::stream::native_handle
+{
+    return up::stream::native_handle(_event_fd);
+}
+
+auto up_resolver::resolver::query::result() const -> std::vector<up::ip::endpoint>
+{
+    auto&& completed = _completed();
+    if (!completed) {
+        throw up::make_exception("resolver-query-pending").with(_request->name());
+    } else if (completed->_error) {
+        std::rethrow_exception(completed->_error);
+    } else {
+        return completed->_endpoints;
+    }
+}
+
+auto up_resolver::resolver::query::wait(up::stream::patience& patience) const -> std::vector<up::ip::endpoint>
+{
+    while (!done()) {
+        patience(get_native_handle(), up::stream::patience::operation::read);
+    }
+    return result();
+}
+
+auto up_resolver::resolver::query::_completed() const -> std::shared_ptr<const entry>
+{
+    return _entry ? _entry : _request->completed();
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "up_chrono.hpp"
+#include "up_impl_ptr.hpp"
+#include "up_inet.hpp"
+
+namespace up_resolver
+{
+
+    /**
+     * Caching resolver for host names (see ip::resolve_endpoints). The
+     * lookups run on a small pool of worker threads, so that the callers
+     * are not blocked by getaddrinfo, and concurrent lookups of the same
+     * name are merged into one. A query signals its completion through its
+     * native handle, i.e. it can be waited for with any patience (including
+     * reactor::patience) or with async::resolve_endpoints.
+     *
+     * Successful lookups are cached for a fixed duration (getaddrinfo
+     * provides no TTLs), and failed lookups for a shorter one (negative
+     * caching). The number of cached names is bounded, and the least
+     * recently used names are evicted first. All operations are
+     * thread-safe. The destructor waits for the running lookups, and the
+     * queued lookups fail.
+     */
+    class resolver final
+    {
+    public: // --- scope ---
+        using self = resolver;
+        class query;
+        class entry;
+        class request;
+        class impl;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        explicit resolver(
+            std::size_t threads = 2,
+            std::size_t capacity = 1024,
+            std::chrono::seconds ttl = std::chrono::seconds(60),
+            std::chrono::seconds negative_ttl = std::chrono::seconds(5));
+        resolver(const self& rhs) = delete;
+        resolver(self&& rhs) noexcept = default;
+        ~resolver() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        // never waits (the query is completed if the name is cached)
+        auto lookup(const up::string_view& name) -> query;
+        auto resolve_endpoints(const up::string_view& name, up::stream::patience& patience)
+            -> std::vector<up::ip::endpoint>;
+        auto resolve_endpoints(const up::string_view& name, up::stream::patience&& patience)
+            -> std::vector<up::ip::endpoint>
+        {
+            return resolve_endpoints(name, patience);
+        }
+        // number of cached names
+        auto size() const -> std::size_t;
+        // drops the cached names (pending lookups are not affected)
+        void clear();
+    };
+
+
+    /**
+     * Result of resolver::lookup. The native handle of a pending query
+     * becomes readable when the lookup has completed. It is closed with the
+     * query.
+     */
+    class resolver::query final
+    {
+    public: // --- scope ---
+        using self = query;
+    private: // --- state ---
+        std::shared_ptr<const entry> _entry; // nullptr while pending
+        std::shared_ptr<request> _request;
+        int _event_fd = -1;
+    public: // --- life ---
+        explicit query(std::shared_ptr<const entry> completed);
+        explicit query(std::shared_ptr<request> pending);
+        query(const self& rhs) = delete;
+        query(self&& rhs) noexcept
+            : _entry(std::move(rhs._entry))
+            , _request(std::move(rhs._request))
+            , _event_fd(std::exchange(rhs._event_fd, -1))
+        { }
+        ~query() noexcept;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self&
+        {
+            self(std::move(rhs)).swap(*this);
+            return *this;
+        }
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_entry, rhs._entry);
+            up::swap_noexcept(_request, rhs._request);
+            up::swap_noexcept(_event_fd, rhs._event_fd);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto done() const -> bool;
+        // only valid while the query is pending
+        auto get_native_handle() const -> up::stream::native_handle;
+        // raises the error of a failed lookup (the query must be done)
+        auto result() const -> std::vector<up::ip::endpoint>;
+        auto wait(up::stream::patience& patience) const -> std::vector<up::ip::endpoint>;
+        auto wait(up::stream::patience&& patience) const -> std::vector<up::ip::endpoint>
+        {
+            return wait(patience);
+        }
+    private:
+        auto _completed() const -> std::shared_ptr<const entry>;
+    };
+
+}
+
+namespace up
+{
+
+    using up_resolver::resolver;
+
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "up_exception.hpp"
+#include "up_stream.hpp"
+
+namespace up_ring_engine
+{
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+    /* Control block of one direction. The layout is fixed, because it might
+     * be placed in a shared memory mapping (see up::shm), and it has to be
+     * zero-initialized. */
+    struct ring_control final
+    {
+        alignas(64) std::atomic<uint64_t> head; // consumer
+        alignas(64) std::atomic<uint64_t> tail; // producer
+        alignas(64) std::atomic<uint32_t> shutdown; // no more writes
+        std::atomic<uint32_t> abandoned; // no more reads
+    };
+
+
+    /* Single-producer single-consumer ring buffer for one direction. The
+     * positions are increased monotonically, and the producer and the
+     * consumer update only their own position. The ring refers to the
+     * control block and the data, which are owned by the storage (on the
+     * heap or in a shared memory mapping), so the operations are const. */
+    class ring final
+    {
+    public: // --- scope ---
+        using self = ring;
+    private: // --- state ---
+        ring_control* _control;
+        char* _data;
+        std::size_t _capacity;
+    public: // --- life ---
+        explicit ring(ring_control* control, char* data, std::size_t capacity)
+            : _control(control), _data(data), _capacity(capacity)
+        { }
+    public: // --- operations ---
+        auto buffered() const -> std::size_t
+        {
+            return _control->tail.load(std::memory_order_acquire) - _control->head.load(std::memory_order_acquire);
+        }
+        auto write(const char* data, std::size_t size) const -> std::size_t
+        {
+            auto tail = _control->tail.load(std::memory_order_relaxed);
+            auto head = _control->head.load(std::memory_order_acquire);
+            auto n = std::min(size, _capacity - _used(head, tail));
+            auto offset = tail % _capacity;
+            auto first = std::min(n, _capacity - offset);
+            std::memcpy(_data + offset, data, first);
+            std::memcpy(_data, data + first, n - first);
+            _control->tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+        auto read(char* data, std::size_t size) const -> std::size_t
+        {
+            auto head = _control->head.load(std::memory_order_relaxed);
+            auto tail = _control->tail.load(std::memory_order_acquire);
+            auto n = std::min(size, _used(head, tail));
+            auto offset = head % _capacity;
+            auto first = std::min(n, _capacity - offset);
+            std::memcpy(data, _data + offset, first);
+            std::memcpy(data + first, _data, n - first);
+            _control->head.store(head + n, std::memory_order_release);
+            return n;
+        }
+        void shutdown() const { _control->shutdown.store(1, std::memory_order_release); }
+        bool is_shutdown() const { return _control->shutdown.load(std::memory_order_acquire); }
+        void abandon() const { _control->abandoned.store(1, std::memory_order_release); }
+        bool is_abandoned() const { return _control->abandoned.load(std::memory_order_acquire); }
+    private:
+        // one of the positions might be written by a peer process
+        auto _used(uint64_t head, uint64_t tail) const -> std::size_t
+        {
+            auto used = tail - head;
+            if (used > _capacity) {
+                throw up::make_exception("ring-engine-corrupted").with(head, tail, _capacity);
+            }
+            return used;
+        }
+    };
+
+
+    /* Wakeup of one engine. The engine arms the wakeup before it returns
+     * would block, and the peer signals the eventfd only if it is armed. The
+     * fences make sure, that either the engine sees the progress of the
+     * peer on its retry, or the peer sees the armed wakeup. */
+    class wakeup final
+    {
+    public: // --- scope ---
+        using self = wakeup;
+    private: // --- state ---
+        int _event_fd;
+        std::atomic<uint32_t>* _armed;
+    public: // --- life ---
+        explicit wakeup(int event_fd, std::atomic<uint32_t>* armed)
+            : _event_fd(event_fd), _armed(armed)
+        { }
+    public: // --- operations ---
+        auto get_native_handle() const { return up::stream::native_handle(_event_fd); }
+        void arm() const
+        {
+            uint64_t value;
+            if (::read(_event_fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+                throw up::make_exception("ring-engine-eventfd-read-error").with(up::errno_info(errno));
+            }
+            _armed->store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        void signal() const
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_armed->load(std::memory_order_relaxed) && _armed->exchange(0, std::memory_order_relaxed)) {
+                uint64_t value = 1;
+                if (::write(_event_fd, &value, sizeof(value)) != sizeof(value)) {
+                    throw up::make_exception("ring-engine-eventfd-write-error").with(up::errno_info(errno));
+                }
+            }
+        }
+    };
+
+
+    /**
+     * Engine on one side of two rings (one per direction). The storage owns
+     * the control blocks, the data and the eventfds, and it is shared by
+     * both engines. It provides ring(index), wakeup(index), to_insight()
+     * and the labels of the engine. Engine i reads from ring i and writes
+     * to ring 1 - i, and it waits for the readability of its own eventfd in
+     * both directions.
+     */
+    template <typename Storage>
+    class basic_engine : public up::stream::engine
+    {
+    public: // --- scope ---
+        using self = basic_engine;
+        using operation = up::stream::patience::operation;
+    private: // --- state ---
+        std::shared_ptr<Storage> _storage;
+        std::size_t _index;
+        ring _input;
+        ring _output;
+        wakeup _own;
+        wakeup _peer;
+    public: // --- life ---
+        explicit basic_engine(std::shared_ptr<Storage> storage, std::size_t index)
+            : _storage(std::move(storage)), _index(index),
+              _input(_storage->ring(index)), _output(_storage->ring(1 - index)),
+              _own(_storage->wakeup(index)), _peer(_storage->wakeup(1 - index))
+        { }
+        basic_engine(const self& rhs) = delete;
+        basic_engine(self&& rhs) noexcept = delete;
+        ~basic_engine() noexcept override
+        {
+            if (!_input.is_abandoned()) {
+                try {
+                    _close();
+                } catch (...) {
+                    up::suppress_current_exception(Storage::destructor_label);
+                }
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto to_insight() const -> up::insight
+        {
+            return up::insight(typeid(*this), Storage::engine_label,
+                up::invoke_to_insight_with_fallback(*_storage),
+                up::invoke_to_insight_with_fallback(_index),
+                up::invoke_to_insight_with_fallback(_input.buffered()),
+                up::invoke_to_insight_with_fallback(_output.buffered()));
+        }
+    private:
+        void _check_open() const
+        {
+            if (_input.is_abandoned()) {
+                throw up::make_exception(Storage::closed_label).with(_index);
+            }
+        }
+        void _close() const
+        {
+            _input.abandon();
+            _output.shutdown();
+            _peer.signal();
+        }
+        /* Retries the transfer once after arming the wakeup, so that a
+         * concurrent transfer of the peer can not be missed. */
+        template <typename Transfer>
+        auto _transfer(Transfer&& transfer) const -> status
+        {
+            auto result = transfer();
+            if (result.done()) {
+                return result;
+            }
+            _own.arm();
+            return transfer();
+        }
+        auto _read(char* data, std::size_t size) const -> status
+        {
+            bool eof = _input.is_shutdown();
+            auto n = _input.read(data, size);
+            if (n) {
+                _peer.signal();
+                return n;
+            } else if (eof || size == 0) {
+                return 0;
+            } else {
+                return status::would_block(operation::read);
+            }
+        }
+        auto _write(const char* data, std::size_t size) const -> status
+        {
+            if (_output.is_shutdown()) {
+                throw up::make_exception(Storage::write_after_shutdown_label).with(_index);
+            } else if (_output.is_abandoned()) {
+                throw up::make_exception(Storage::broken_pipe_label).with(_index);
+            }
+            auto n = _output.write(data, size);
+            if (n) {
+                _peer.signal();
+                return n;
+            } else if (size == 0) {
+                return 0;
+            } else {
+                return status::would_block(operation::read);
+            }
+        }
+        auto try_shutdown() const -> status override
+        {
+            _check_open();
+            _output.shutdown();
+            _peer.signal();
+            return 0;
+        }
+        void hard_close() const override
+        {
+            _check_open();
+            _close();
+        }
+        auto try_read_some(up::chunk::into chunk) const -> status override
+        {
+            _check_open();
+            return _transfer([&] { return _read(chunk.data(), chunk.size()); });
+        }
+        auto try_write_some(up::chunk::from chunk) const -> status override
+        {
+            _check_open();
+            return _transfer([&] { return _write(chunk.data(), chunk.size()); });
+        }
+        auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status override
+        {
+            _check_open();
+            return _transfer([&]() -> status {
+                    // empty chunks are skipped by as, so the total limits the iteration
+                    auto total = chunks.total();
+                    auto iov = chunks.as<iovec>();
+                    std::size_t count = 0;
+                    for (std::size_t i = 0; count != total; ++i) {
+                        auto rv = _read(static_cast<char*>(iov[i].iov_base), iov[i].iov_len);
+                        if (!rv.done()) {
+                            return count ? status(count) : rv;
+                        } else if (rv.count() == 0) {
+                            break;
+                        }
+                        count += rv.count();
+                        if (rv.count() != iov[i].iov_len) {
+                            break;
+                        }
+                    }
+                    return count;
+                });
+        }
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status override
+        {
+            _check_open();
+            return _transfer([&]() -> status {
+                    auto total = chunks.total();
+                    auto iov = chunks.as<iovec>();
+                    std::size_t count = 0;
+                    for (std::size_t i = 0; count != total; ++i) {
+                        auto rv = _write(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+                        if (!rv.done()) {
+                            return count ? status(count) : rv;
+                        }
+                        count += rv.count();
+                        if (rv.count() != iov[i].iov_len) {
+                            break;
+                        }
+                    }
+                    return count;
+                });
+        }
+        auto downgrade() -> std::unique_ptr<up::stream::engine> override
+        {
+            throw up::make_exception(Storage::bad_downgrade_label);
+        }
+        auto get_underlying_engine() const -> const up::stream::engine* override
+        {
+            return this;
+        }
+        auto get_native_handle() const -> up::stream::native_handle override
+        {
+            return _own.get_native_handle();
+        }
+    };
+
+}
@@ -0,0 +1,318 @@
+#include "up_sharded_server.hpp"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "up_exception.hpp"
+#include "up_terminate.hpp"
+
+
+namespace
+{
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+    // CPUs in the affinity mask of the process
+    auto available_cpus() -> std::vector<int>
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof(set), &set) != 0) {
+            throw up::make_exception("sharded-server-affinity-error").with(up::errno_info(errno));
+        }
+        std::vector<int> result;
+        for (int cpu = 0; cpu != CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                result.push_back(cpu);
+            }
+        }
+        if (result.empty()) {
+            throw up::make_exception("sharded-server-no-cpus");
+        }
+        return result;
+    }
+
+    void pin_current_thread(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int rv = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+        if (rv != 0) {
+            throw up::make_exception("sharded-server-pin-error").with(cpu, up::errno_info(rv));
+        }
+    }
+
+}
+
+
+class up_sharded_server::sharded_server::impl final
+{
+public: // --- scope ---
+    using self = impl;
+    using operation = up::stream::patience::operation;
+    class shard;
+private: // --- state ---
+    handler _handler;
+    up::steady_time_point _started;
+    std::vector<std::unique_ptr<shard>> _shards;
+public: // --- life ---
+    explicit impl(const up::tcp::endpoint& endpoint, handler&& handler, std::size_t shards, int backlog, steering steering);
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        stop();
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight;
+    auto shards() const { return _shards.size(); }
+    auto get_shard(std::size_t index) const -> shard&
+    {
+        if (index >= _shards.size()) {
+            throw up::make_exception("sharded-server-invalid-shard").with(index, _shards.size());
+        }
+        return *_shards[index];
+    }
+    auto uptime() const -> up::duration { return up::steady_clock::now() - _started; }
+    void stop() noexcept;
+private:
+    void _run(shard& shard, std::promise<void>& started);
+    void _accept(shard& shard, up::reactor& reactor, up::timer_wheel::timer& retry);
+};
+
+
+class up_sharded_server::sharded_server::impl::shard final
+{
+public: // --- scope ---
+    using self = shard;
+public: // --- state ---
+    std::size_t _index;
+    int _cpu;
+    up::tcp::listener _listener;
+    int _event_fd = -1; // signaled by stop
+    std::atomic<uint64_t> _accepted{0};
+    std::thread _thread;
+public: // --- life ---
+    explicit shard(std::size_t index, int cpu, up::tcp::listener&& listener)
+        : _index(index), _cpu(cpu), _listener(std::move(listener))
+    {
+        _event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_event_fd == -1) {
+            throw up::make_exception("sharded-server-eventfd-error").with(_index, up::errno_info(errno));
+        }
+    }
+    shard(const self& rhs) = delete;
+    shard(self&& rhs) noexcept = delete;
+    ~shard() noexcept
+    {
+        close_aux(_event_fd);
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "sharded-server-shard",
+            up::invoke_to_insight_with_fallback(_index),
+            up::invoke_to_insight_with_fallback(_cpu),
+            up::invoke_to_insight_with_fallback(_accepted.load(std::memory_order_relaxed)));
+    }
+    void signal() noexcept
+    {
+        uint64_t value = 1;
+        if (::write(_event_fd, &value, sizeof(value)) != sizeof(value)) {
+            up::terminate("sharded-server-signal-error", _index, errno);
+        }
+    }
+};
+
+
+up_sharded_server::sharded_server::impl::impl(
+    const up::tcp::endpoint& endpoint, handler&& handler, std::size_t shards, int backlog, steering steering)
+    : _handler(std::move(handler)), _started(up::steady_clock::now())
+{
+    using o = up::tcp::socket::option;
+    auto&& cpus = available_cpus();
+    if (shards == 0) {
+        shards = cpus.size();
+    } else if (steering == steering::incoming_cpu && shards != cpus.size()) {
+        throw up::make_exception("sharded-server-steering-requires-shard-per-cpu").with(shards, cpus.size());
+    }
+    /* All listeners are created before the first worker is started, so that
+     * errors (e.g. the endpoint is already in use) are raised from here. The
+     * position of a listener in the reuseport group is the order of listen,
+     * i.e. the index of its shard. */
+    for (std::size_t i = 0; i != shards; ++i) {
+        auto listener = up::tcp::socket(endpoint, {o::reuseaddr, o::reuseport}).listen(backlog);
+        if (steering == steering::incoming_cpu) {
+            listener.incoming_cpu(cpus[i]);
+        }
+        _shards.push_back(std::make_unique<shard>(i, cpus[i % cpus.size()], std::move(listener)));
+    }
+    if (steering == steering::incoming_cpu) {
+        // the program applies to the whole group
+        _shards.front()->_listener.steer_by_cpu(cpus);
+    }
+    /* The workers are started one after the other, and errors of their
+     * startup (e.g. pinning fails) are raised from here as well. The
+     * promise is owned by the thread, because the worker might still be
+     * within set_value when the future becomes ready. */
+    for (auto&& shard : _shards) {
+        try {
+            std::promise<void> started;
+            auto&& future = started.get_future();
+            shard->_thread = std::thread([this, &shard=*shard, started=std::move(started)]() mutable {
+                    _run(shard, started);
+                });
+            future.get();
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+}
+
+auto up_sharded_server::sharded_server::impl::to_insight() const -> up::insight
+{
+    up::insights shards;
+    for (auto&& shard : _shards) {
+        shards.push_back(shard->to_insight());
+    }
+    return up::insight(typeid(*this), "sharded-server-impl",
+        up::invoke_to_insight_with_fallback(uptime()),
+        up::insight(typeid(shards), "shards", std::move(shards)));
+}
+
+void up_sharded_server::sharded_server::impl::stop() noexcept
+{
+    for (auto&& shard : _shards) {
+        if (shard->_thread.joinable()) {
+            shard->signal();
+        }
+    }
+    for (auto&& shard : _shards) {
+        if (shard->_thread.joinable()) {
+            shard->_thread.join();
+        }
+    }
+}
+
+void up_sharded_server::sharded_server::impl::_run(shard& shard, std::promise<void>& started)
+{
+    bool running = false;
+    try {
+        pin_current_thread(shard._cpu);
+        up::reactor reactor;
+        bool stopping = false;
+        reactor.watch(up::stream::native_handle(shard._event_fd), operation::read,
+            [&stopping](bool expired __attribute__((unused))) noexcept { stopping = true; });
+        up::timer_wheel::timer retry([this, &shard, &reactor, &retry]() { _accept(shard, reactor, retry); });
+        _accept(shard, reactor, retry);
+        // the promise must not be used afterwards
+        started.set_value();
+        running = true;
+        while (!stopping) {
+            try {
+                reactor.run_once(up::duration::max());
+            } catch (...) {
+                up::suppress_current_exception("sharded-server-handler");
+            }
+        }
+        // the destructor of the reactor cancels the remaining connections
+    } catch (...) {
+        if (running) {
+            up::suppress_current_exception("sharded-server-worker");
+        } else {
+            started.set_exception(std::current_exception());
+        }
+    }
+}
+
+void up_sharded_server::sharded_server::impl::_accept(
+    shard& shard, up::reactor& reactor, up::timer_wheel::timer& retry)
+{
+    /* The accept queue is drained completely, so that a burst of
+     * connections is served with a single wakeup. If an accept fails (e.g. with EMFILE), the
+     * remaining connections stay queued, and the shard tries again after a
+     * short delay (instead of spinning on the readable handle). */
+    for (;;) {
+        try {
+            auto&& connection = shard._listener.try_accept();
+            if (!connection) {
+                break;
+            }
+            shard._accepted.store(shard._accepted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            // std::function requires copyable work
+            auto&& shared = std::make_shared<up::tcp::connection>(std::move(*connection));
+            reactor.spawn([this, &shard, &reactor, shared]() {
+                    _handler(std::move(*shared), reactor, shard._index);
+                });
+        } catch (...) {
+            up::suppress_current_exception("sharded-server-accept");
+            retry.arm(reactor.timers(), up::steady_clock::now() + std::chrono::milliseconds(10));
+            return;
+        }
+    }
+    reactor.watch(shard._listener.get_native_handle(), operation::read,
+        [this, &shard, &reactor, &retry](bool expired __attribute__((unused))) { _accept(shard, reactor, retry); });
+}
+
+
+void up_sharded_server::sharded_server::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_sharded_server::sharded_server::sharded_server(
+    const up::tcp::endpoint& endpoint, handler handler, std::size_t shards, int backlog, steering steering)
+    : _impl(up::impl_make(endpoint, std::move(handler), shards, backlog, steering))
+{ }
+
+auto up_sharded_server::sharded_server::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_sharded_server::sharded_server::shards() const -> std::size_t
+{
+    return _impl->shards();
+}
+
+auto up_sharded_server::sharded_server::cpu(std::size_t shard) const -> int
+{
+    return _impl->get_shard(shard)._cpu;
+}
+
+auto up_sharded_server::sharded_server::accepted(std::size_t shard) const -> uint64_t
+{
+    return _impl->get_shard(shard)._accepted.load(std::memory_order_relaxed);
+}
+
+auto up_sharded_server::sharded_server::accept_rate(std::size_t shard) const -> double
+{
+    auto seconds = std::chrono::duration<double>(_impl->uptime()).count();
+    return seconds > 0 ? double(accepted(shard)) / seconds : 0.0;
+}
+
+void up_sharded_server::sharded_server::stop()
+{
+    _impl->stop();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "up_inet.hpp"
+#include "up_reactor.hpp"
+
+namespace up_sharded_server
+{
+
+    /**
+     * Multi-threaded TCP server with one listener per shard. All listeners
+     * are bound to the same endpoint with SO_REUSEPORT, so that the kernel
+     * distributes incoming connections among them, instead of several
+     * threads competing for the same accept queue. Each shard has a worker
+     * thread, that is pinned to one CPU and runs a reactor. The handler is
+     * invoked in a new fiber on this reactor for each accepted connection,
+     * so that it can use reactor::patience to serve many connections per
+     * shard.
+     *
+     * With steering::incoming_cpu, there is exactly one shard per CPU, and
+     * a reuseport BPF program selects the shard, whose worker runs on the
+     * CPU that has received the packets of the connection (i.e. the CPU
+     * handling the RX queue of the NIC). So the interrupt, the socket and
+     * the handler stay on the same core. This works best if the RX queues
+     * (or RPS) are configured to spread the traffic over the same CPUs.
+     *
+     * The server is started by the constructor, and it is stopped by stop
+     * or by the destructor. The constructor fails, if a worker can not be
+     * started. Exceptions escaping from the handler are suppressed, and
+     * they do not affect other connections. If accept fails (e.g. with
+     * EMFILE), the shard tries again after a short delay.
+     */
+    class sharded_server final
+    {
+    public: // --- scope ---
+        using self = sharded_server;
+        using handler = std::function<void(up::tcp::connection connection, up::reactor& reactor, std::size_t shard)>;
+        // hash: distribution by the kernel (hash of the addresses and ports)
+        enum class steering : uint8_t { hash, incoming_cpu, };
+        class impl;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        /* With zero shards, there is one shard for each CPU in the affinity
+         * mask of the process (required for steering::incoming_cpu). */
+        explicit sharded_server(const up::tcp::endpoint& endpoint, handler handler,
+            std::size_t shards = 0, int backlog = 1024, steering steering = steering::hash);
+        sharded_server(const self& rhs) = delete;
+        sharded_server(self&& rhs) noexcept = default;
+        ~sharded_server() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto shards() const -> std::size_t;
+        // CPU of the worker thread of the shard
+        auto cpu(std::size_t shard) const -> int;
+        // number of accepted connections (can be called from any thread)
+        auto accepted(std::size_t shard) const -> uint64_t;
+        // average number of accepted connections per second since start
+        auto accept_rate(std::size_t shard) const -> double;
+        // stops accepting and joins all workers (open connections are cancelled)
+        void stop();
+    };
+
+}
+
+namespace up
+{
+
+    using up_sharded_server::sharded_server;
+
+}
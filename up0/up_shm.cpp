@@ -0,0 +1,260 @@
+#include "up_shm.hpp"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/memfd.h>
+
+#include "up_exception.hpp"
+#include "up_ints.hpp"
+#include "up_ring_engine.hpp"
+#include "up_string_literal.hpp"
+#include "up_terminate.hpp"
+
+
+namespace
+{
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+    auto syscall_memfd_create(const char* name, unsigned int flags)
+    {
+        return int(::syscall(SYS_memfd_create, name, flags));
+    }
+
+    // "up-shm" and the version of the layout
+    constexpr uint64_t shm_magic = 0x75702d73686d0001;
+
+    // layout of the beginning of the memory file (zero-initialized)
+    struct shm_header final
+    {
+        uint64_t magic;
+        uint64_t capacity;
+        up_ring_engine::ring_control rings[2];
+        // wakeup of each side
+        alignas(64) std::atomic<uint32_t> armed[2];
+    };
+
+    // the ring buffers start at the next page
+    constexpr std::size_t shm_data_offset = (sizeof(shm_header) + 4095) / 4096 * 4096;
+
+}
+
+
+auto up_shm::to_string(shm::side value) -> up::unique_string
+{
+    using namespace up::literals;
+    switch (value) {
+    case shm::side::first:
+        return up::invoke_to_string("first"_sl);
+    case shm::side::second:
+        return up::invoke_to_string("second"_sl);
+    }
+    throw up::make_exception("invalid-shm-side").with(up::to_underlying_type(value));
+}
+
+
+class up_shm::shm::channel::impl final
+{
+public: // --- scope ---
+    using self = impl;
+    struct adopt_t { };
+    static constexpr const char engine_label[] = "shm-engine";
+    static constexpr const char closed_label[] = "shm-engine-closed";
+    static constexpr const char write_after_shutdown_label[] = "shm-engine-write-after-shutdown";
+    static constexpr const char broken_pipe_label[] = "shm-engine-broken-pipe";
+    static constexpr const char bad_downgrade_label[] = "shm-bad-downgrade-error";
+    static constexpr const char destructor_label[] = "shm-engine-destructor";
+public: // --- state ---
+    int _memfd = -1;
+    int _event_fds[2] = {-1, -1};
+    void* _mapping = MAP_FAILED;
+    std::size_t _size = 0;
+    // validated copy (the header can be modified by the peer at any time)
+    std::size_t _capacity = 0;
+    shm_header* _header = nullptr;
+public: // --- life ---
+    explicit impl(std::size_t capacity)
+    {
+        try {
+            if (capacity == 0 || capacity > (std::size_t(1) << 40)) {
+                throw up::make_exception("invalid-shm-capacity").with(capacity);
+            }
+            _memfd = syscall_memfd_create("up-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (_memfd == -1) {
+                throw up::make_exception("shm-memfd-create-error").with(up::errno_info(errno));
+            }
+            _size = shm_data_offset + 2 * capacity;
+            if (::ftruncate(_memfd, up::ints::cast<off_t>(_size)) != 0) {
+                throw up::make_exception("shm-memfd-truncate-error").with(_size, up::errno_info(errno));
+            }
+            // the peer can not cause SIGBUS by shrinking the file
+            if (::fcntl(_memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+                throw up::make_exception("shm-memfd-seal-error").with(up::errno_info(errno));
+            }
+            _open_events();
+            _map();
+            _header = new (_mapping) shm_header();
+            _header->magic = shm_magic;
+            _header->capacity = capacity;
+            _capacity = capacity;
+        } catch (...) {
+            _release();
+            throw;
+        }
+    }
+    explicit impl(adopt_t, const std::vector<int>& descriptors)
+    {
+        try {
+            if (descriptors.size() != 3) {
+                for (int fd : descriptors) {
+                    close_aux(fd);
+                }
+                throw up::make_exception("invalid-shm-descriptors").with(descriptors.size());
+            }
+            _memfd = descriptors[0];
+            _event_fds[0] = descriptors[1];
+            _event_fds[1] = descriptors[2];
+            int seals = ::fcntl(_memfd, F_GET_SEALS);
+            if (seals == -1 || (seals & F_SEAL_SHRINK) == 0) {
+                throw up::make_exception("shm-memfd-not-sealed").with(seals, up::errno_info(errno));
+            }
+            struct stat stats;
+            if (::fstat(_memfd, &stats) != 0) {
+                throw up::make_exception("shm-memfd-stat-error").with(up::errno_info(errno));
+            }
+            _size = up::ints::cast<std::size_t>(stats.st_size);
+            if (_size <= shm_data_offset) {
+                throw up::make_exception("invalid-shm-size").with(_size);
+            }
+            _map();
+            _header = static_cast<shm_header*>(_mapping);
+            // the header is read only once
+            uint64_t magic = _header->magic;
+            uint64_t capacity = _header->capacity;
+            if (magic != shm_magic || capacity != (_size - shm_data_offset) / 2
+                || _size != shm_data_offset + 2 * capacity) {
+                throw up::make_exception("invalid-shm-header").with(magic, capacity, _size);
+            }
+            _capacity = up::ints::cast<std::size_t>(capacity);
+        } catch (...) {
+            _release();
+            throw;
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        _release();
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "shm-channel-impl",
+            up::invoke_to_insight_with_fallback(_memfd),
+            up::invoke_to_insight_with_fallback(_event_fds[0]),
+            up::invoke_to_insight_with_fallback(_event_fds[1]),
+            up::invoke_to_insight_with_fallback(_size));
+    }
+    auto ring(std::size_t index) const -> up_ring_engine::ring
+    {
+        auto data = static_cast<char*>(_mapping) + shm_data_offset + index * _capacity;
+        return up_ring_engine::ring(&_header->rings[index], data, _capacity);
+    }
+    auto wakeup(std::size_t index) const -> up_ring_engine::wakeup
+    {
+        return up_ring_engine::wakeup(_event_fds[index], &_header->armed[index]);
+    }
+private:
+    void _open_events()
+    {
+        for (auto&& fd : _event_fds) {
+            fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd == -1) {
+                throw up::make_exception("shm-eventfd-error").with(up::errno_info(errno));
+            }
+        }
+    }
+    void _map()
+    {
+        _mapping = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _memfd, 0);
+        if (_mapping == MAP_FAILED) {
+            throw up::make_exception("shm-mmap-error").with(_size, up::errno_info(errno));
+        }
+    }
+    void _release() noexcept
+    {
+        if (_mapping != MAP_FAILED) {
+            if (::munmap(_mapping, _size) != 0) {
+                up::terminate("bad-munmap", _size);
+            }
+            _mapping = MAP_FAILED;
+        }
+        for (auto&& fd : _event_fds) {
+            close_aux(fd);
+        }
+        close_aux(_memfd);
+    }
+};
+
+
+class up_shm::shm::engine final : public up_ring_engine::basic_engine<channel::impl>
+{
+public: // --- life ---
+    using basic_engine::basic_engine;
+};
+
+
+void up_shm::shm::channel::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+auto up_shm::shm::channel::adopt(const std::vector<int>& descriptors) -> self
+{
+    return self(up::impl_make(impl::adopt_t(), descriptors));
+}
+
+up_shm::shm::channel::channel(std::size_t capacity)
+    : _impl(up::impl_make(capacity))
+{ }
+
+up_shm::shm::channel::channel(up::impl_ptr<impl, destroy> impl)
+    : _impl(std::move(impl))
+{ }
+
+auto up_shm::shm::channel::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_shm::shm::channel::descriptors() const -> std::vector<int>
+{
+    return {_impl->_memfd, _impl->_event_fds[0], _impl->_event_fds[1]};
+}
+
+auto up_shm::shm::channel::make_engine(shm::side side) && -> std::unique_ptr<up::stream::engine>
+{
+    auto index = side == shm::side::first ? 0 : 1;
+    return std::make_unique<engine>(std::shared_ptr<impl>(std::move(_impl)), index);
+}
+
+auto up_shm::shm::channel::make_stream(shm::side side) && -> up::stream
+{
+    return up::stream(std::move(*this).make_engine(side));
+}
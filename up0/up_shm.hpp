@@ -0,0 +1,79 @@
+#pragma once
+
+#include "up_impl_ptr.hpp"
+#include "up_stream.hpp"
+
+namespace up_shm
+{
+
+    /**
+     * Stream engines between two processes, that are connected through two
+     * ring buffers (one per direction) in a shared memory file (memfd). It
+     * works like up::loopback, i.e. the transfers copy between the caller
+     * and the shared memory without syscalls, and each side has an eventfd,
+     * that is signaled by the peer only if the side is waiting.
+     *
+     * One process creates the channel, and it passes the descriptors to the
+     * other process (e.g. with local::connection::send_descriptors). Then
+     * each process makes the engine for its own side. The size of the
+     * memory file is sealed, and the positions of the peer are validated.
+     * However, the peer is able to modify the payload at any time, so the
+     * processes have to trust each other. The termination of the peer is
+     * not detected (e.g. use a local connection for that).
+     */
+    class shm final
+    {
+    public: // --- scope ---
+        enum class side : uint8_t { first, second, };
+        class channel;
+        class engine;
+    };
+
+    auto to_string(shm::side value) -> up::unique_string;
+
+
+    class shm::channel final
+    {
+    public: // --- scope ---
+        using self = channel;
+        class impl;
+        static void destroy(impl* ptr);
+        // takes over the descriptors (closed on failure)
+        static auto adopt(const std::vector<int>& descriptors) -> self;
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        // capacity of each direction in bytes
+        explicit channel(std::size_t capacity = 1 << 20);
+    private:
+        explicit channel(up::impl_ptr<impl, destroy> impl);
+    public:
+        channel(const self& rhs) = delete;
+        channel(self&& rhs) noexcept = default;
+        ~channel() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        // memory file and eventfds for the peer process (owned by the channel)
+        auto descriptors() const -> std::vector<int>;
+        auto make_engine(shm::side side) && -> std::unique_ptr<up::stream::engine>;
+        auto make_stream(shm::side side) && -> up::stream;
+    };
+
+}
+
+namespace up
+{
+
+    using up_shm::shm;
+
+}
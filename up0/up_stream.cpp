@@ -4,7 +4,9 @@
 #include <sys/timerfd.h>
 #include <unistd.h>
 
+#include "up_defer.hpp"
 #include "up_exception.hpp"
+#include "up_fs.hpp"
 #include "up_ints.hpp"
 #include "up_utility.hpp"
 #include "up_string_literal.hpp"
@@ -25,17 +27,37 @@ namespace
     {
         using engine = up_stream::stream::engine;
         using patience = up_stream::stream::patience;
-        template <typename Result, typename... Params, typename... Args>
+        using counters = up_stream::stream::counters;
+        template <typename... Params, typename... Args>
         auto operator()(const engine& engine, patience& patience,
-            Result (engine::* fn)(Params...) const, Args&&... args) -> Result
+            engine::status (engine::* fn)(Params...) const, Args&&... args) -> std::size_t
         {
             for (;;) {
-                try {
-                    return (engine.*fn)(args...);
-                } catch (const engine::unreadable&) {
-                    patience(engine.get_native_handle(), patience::operation::read);
-                } catch (const engine::unwritable&) {
-                    patience(engine.get_native_handle(), patience::operation::write);
+                auto status = (engine.*fn)(args...);
+                if (status.done()) {
+                    return status.count();
+                } else {
+                    patience(engine.get_native_handle(), status.blocked_on());
+                }
+            }
+        }
+        // same as above, but updates the counters (op is the direction of fn)
+        template <typename... Params, typename... Args>
+        auto operator()(const engine& engine, patience& patience, counters* counters, patience::operation op,
+            engine::status (engine::* fn)(Params...) const, Args&&... args) -> std::size_t
+        {
+            if (!counters) {
+                return (*this)(engine, patience, fn, std::forward<Args>(args)...);
+            }
+            for (;;) {
+                auto status = (engine.*fn)(args...);
+                counters->record(op, status);
+                if (status.done()) {
+                    return status.count();
+                } else {
+                    auto start = up::steady_clock::now();
+                    UP_DEFER { counters->record_wait(up::steady_clock::now() - start); };
+                    patience(engine.get_native_handle(), status.blocked_on());
                 }
             }
         }
@@ -43,6 +65,8 @@ namespace
         auto operator()(engine& engine, patience& patience,
             Result (engine::* fn)(Params...), Args&&... args) -> Result
         {
+            /* Only used for rare operations (i.e. downgrade), which still
+             * signal would block conditions with exceptions. */
             for (;;) {
                 try {
                     return (engine.*fn)(args...);
@@ -115,6 +139,39 @@ namespace
         }
     }
 
+    // returns false if the deadline has expired
+    bool do_poll_until(
+        up_stream::stream::patience::operation op,
+        up_stream::stream::native_handle handle,
+        const up::steady_time_point& expires_at)
+    {
+        pollfd fds{up::to_underlying_type(handle), make_poll_events(op), 0};
+        for (;;) {
+            auto remaining = std::max(expires_at - up::steady_clock::now(), up::duration::zero());
+            auto s = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - s);
+            timespec ts{up::ints::caster(s.count()), up::ints::caster(ns.count())};
+            int rv = ::ppoll(&fds, 1, &ts, nullptr);
+            if (rv > 0) {
+                constexpr auto valid = POLLIN | POLLOUT | POLLHUP | POLLERR;
+                if (fds.revents & ~valid) {
+                    throw up::make_exception("invalid-stream-poll-events")
+                        .with(op, fds.events, fds.revents);
+                } else if (fds.revents & valid) {
+                    return true;
+                } else {
+                    throw up::make_exception("unexpected-stream-poll-status").with(op);
+                }
+            } else if (rv == 0) {
+                return false;
+            } else if (errno == EINTR) {
+                // restart
+            } else {
+                throw up::make_exception("stream-poll-error").with(op, up::errno_info(errno));
+            }
+        }
+    }
+
 }
 
 
@@ -127,27 +184,17 @@ up_stream::stream::stream(std::unique_ptr<engine> engine)
 void up_stream::stream::shutdown(patience& patience) const
 {
     check_state(_engine);
-    return blocking(*_engine, patience, &engine::shutdown);
+    // not counted, so that calls(write) matches the transfers
+    blocking(*_engine, patience, &engine::try_shutdown);
 }
 
 void up_stream::stream::graceful_close(patience& patience) const
 {
     check_state(_engine);
     shutdown(patience);
-    for (;;) {
-        try {
-            char c;
-            if (_engine->read_some({&c, 1})) {
-                throw up::make_exception("stream-graceful-close-error")
-                    .with(up::to_underlying_type(_engine->get_native_handle()));
-            } else {
-                break;
-            }
-        } catch (const engine::unreadable&) {
-            patience(_engine->get_native_handle(), patience::operation::read);
-        } catch (const engine::unwritable&) {
-            patience(_engine->get_native_handle(), patience::operation::write);
-        }
+    char c;
+    if (blocking(*_engine, patience, _counters.get(), patience::operation::read, &engine::try_read_some, up::chunk::into{&c, 1})) {
+        stream_graceful_close_error(_engine->get_native_handle());
     }
     _engine->hard_close();
 }
@@ -155,25 +202,25 @@ void up_stream::stream::graceful_close(patience& patience) const
 auto up_stream::stream::read_some(up::chunk::into chunk, patience& patience) const -> std::size_t
 {
     check_state(_engine);
-    return blocking(*_engine, patience, &engine::read_some, std::move(chunk));
+    return blocking(*_engine, patience, _counters.get(), patience::operation::read, &engine::try_read_some, std::move(chunk));
 }
 
 auto up_stream::stream::write_some(up::chunk::from chunk, patience& patience) const -> std::size_t
 {
     check_state(_engine);
-    return blocking(*_engine, patience, &engine::write_some, std::move(chunk));
+    return blocking(*_engine, patience, _counters.get(), patience::operation::write, &engine::try_write_some, std::move(chunk));
 }
 
 auto up_stream::stream::read_some(up::chunk::into_bulk_t&& chunks, patience& patience) const -> std::size_t
 {
     check_state(_engine);
-    return blocking(*_engine, patience, &engine::read_some_bulk, std::move(chunks));
+    return blocking(*_engine, patience, _counters.get(), patience::operation::read, &engine::try_read_some_bulk, std::move(chunks));
 }
 
 auto up_stream::stream::write_some(up::chunk::from_bulk_t&& chunks, patience& patience) const -> std::size_t
 {
     check_state(_engine);
-    return blocking(*_engine, patience, &engine::write_some_bulk, std::move(chunks));
+    return blocking(*_engine, patience, _counters.get(), patience::operation::write, &engine::try_write_some_bulk, std::move(chunks));
 }
 
 void up_stream::stream::write_all(up::chunk::from chunk, patience& patience) const
@@ -183,17 +230,32 @@ void up_stream::stream::write_all(up::chunk::from chunk, patience& patience) con
      * implementation is similar to write_some. */
     check_state(_engine);
     do {
-        auto n = blocking(*_engine, patience, &engine::write_some, chunk);
+        auto n = blocking(*_engine, patience, _counters.get(), patience::operation::write, &engine::try_write_some, chunk);
         chunk.drain(n);
     } while (chunk.size());
 }
 
+void up_stream::stream::send_file(const up::fs::file& file, off_t offset, std::size_t length, patience& patience) const
+{
+    check_state(_engine);
+    auto handle = native_handle(file.get_native_handle());
+    while (length) {
+        auto n = blocking(*_engine, patience, _counters.get(), patience::operation::write,
+            &engine::try_send_file, handle, offset, length);
+        if (n == 0) {
+            throw up::make_exception("stream-send-file-truncated").with(offset, length);
+        }
+        offset += up::ints::cast<off_t>(n);
+        length -= n;
+    }
+}
+
 void up_stream::stream::write_all(up::chunk::from_bulk_t&& chunks, patience& patience) const
 {
     /* See above regarding the use of a do-while loop. */
     check_state(_engine);
     do {
-        auto n = blocking(*_engine, patience, &engine::write_some_bulk, chunks);
+        auto n = blocking(*_engine, patience, _counters.get(), patience::operation::write, &engine::try_write_some_bulk, chunks);
         chunks.drain(n);
     } while (chunks.total());
 }
@@ -216,6 +278,23 @@ auto up_stream::stream::get_underlying_engine() const -> const engine*
     return _engine->get_underlying_engine();
 }
 
+bool up_stream::stream::is_upgraded() const
+{
+    check_state(_engine);
+    return _engine->get_underlying_engine() != _engine.get();
+}
+
+auto up_stream::stream::get_native_handle() const -> native_handle
+{
+    return _checked_engine().get_native_handle();
+}
+
+auto up_stream::stream::_checked_engine() const -> const engine&
+{
+    check_state(_engine);
+    return *_engine;
+}
+
 void up_stream::stream::_vtable_dummy() const { }
 
 
@@ -233,6 +312,25 @@ auto up_stream::to_string(stream::patience::operation op) -> up::unique_string
     throw up::make_exception("unexpected-stream-patience-operation").with(op);
 }
 
+auto up_stream::stream::counters::to_insight() const -> up::insight
+{
+    using o = patience::operation;
+    return up::insight(typeid(*this), "stream-counters",
+        up::invoke_to_insight_with_fallback(bytes(o::read)),
+        up::invoke_to_insight_with_fallback(bytes(o::write)),
+        up::invoke_to_insight_with_fallback(calls(o::read)),
+        up::invoke_to_insight_with_fallback(calls(o::write)),
+        up::invoke_to_insight_with_fallback(would_block(o::read)),
+        up::invoke_to_insight_with_fallback(would_block(o::write)),
+        up::invoke_to_insight_with_fallback(wait_time()));
+}
+
+void up_stream::stream_graceful_close_error(stream::native_handle handle)
+{
+    throw up::make_exception("stream-graceful-close-error")
+        .with(up::to_underlying_type(handle));
+}
+
 
 void up_stream::stream::steady_patience::_wait(native_handle handle, operation op)
 {
@@ -348,36 +446,40 @@ void up_stream::stream::deadline_patience::destroy(impl* ptr)
 }
 
 up_stream::stream::deadline_patience::deadline_patience()
-    : _impl()
+    : _expires_at(up::steady_time_point::max()), _impl()
 { }
 
 up_stream::stream::deadline_patience::deadline_patience(const up::system_time_point& expires_at)
-    : _impl(up::impl_make(CLOCK_REALTIME, expires_at.time_since_epoch(), true))
+    : _expires_at(up::steady_time_point::max())
+    , _impl(up::impl_make(CLOCK_REALTIME, expires_at.time_since_epoch(), true))
 { }
 
 up_stream::stream::deadline_patience::deadline_patience(const up::steady_time_point& expires_at)
-    : _impl(up::impl_make(CLOCK_MONOTONIC, expires_at.time_since_epoch(), true))
+    : _expires_at(expires_at), _impl()
 { }
 
 up_stream::stream::deadline_patience::deadline_patience(const up::duration& expires_from_now)
-    : _impl(up::impl_make(CLOCK_MONOTONIC, expires_from_now, false))
+    : _expires_at(up::steady_clock::now() + expires_from_now), _impl()
 { }
 
 auto up_stream::stream::deadline_patience::operator=(const up::system_time_point& expires_at) & -> self&
 {
     _impl = impl::make(std::move(_impl), CLOCK_REALTIME, expires_at.time_since_epoch(), true);
+    _expires_at = up::steady_time_point::max();
     return *this;
 }
 
 auto up_stream::stream::deadline_patience::operator=(const up::steady_time_point& expires_at) & -> self&
 {
-    _impl = impl::make(std::move(_impl), CLOCK_MONOTONIC, expires_at.time_since_epoch(), true);
+    _impl.reset();
+    _expires_at = expires_at;
     return *this;
 }
 
 auto up_stream::stream::deadline_patience::operator=(const up::duration& expires_from_now) & -> self&
 {
-    _impl = impl::make(std::move(_impl), CLOCK_MONOTONIC, expires_from_now, false);
+    _impl.reset();
+    _expires_at = up::steady_clock::now() + expires_from_now;
     return *this;
 }
 
@@ -385,8 +487,11 @@ void up_stream::stream::deadline_patience::_wait(native_handle handle, operation
 {
     if (_impl) {
         _impl->wait(handle, op);
-    } else {
+    } else if (_expires_at == up::steady_time_point::max()) {
         do_poll(op, handle);
+    } else if (!do_poll_until(op, handle, _expires_at)) {
+        throw up::make_exception("stream-deadline-patience-timeout", timeout())
+            .with(op, _expires_at);
     }
 }
 
@@ -397,4 +502,121 @@ void up_stream::stream::infinite_patience::_wait(native_handle handle, operation
 }
 
 
+up_stream::stream::spinning_patience::spinning_patience(const up::duration& max_budget)
+    : self(up::steady_time_point::max(), max_budget)
+{ }
+
+up_stream::stream::spinning_patience::spinning_patience(const up::steady_time_point& expires_at, const up::duration& max_budget)
+    : _expires_at(expires_at), _max_budget(max_budget), _budget(max_budget)
+{
+    if (_max_budget <= up::duration::zero()) {
+        throw up::make_exception("invalid-stream-spinning-patience-budget").with(_max_budget);
+    }
+}
+
+auto up_stream::stream::spinning_patience::operator=(const up::steady_time_point& expires_at) & -> self&
+{
+    _expires_at = expires_at;
+    return *this;
+}
+
+auto up_stream::stream::spinning_patience::operator=(const up::duration& expires_from_now) & -> self&
+{
+    _expires_at = up::steady_clock::now() + expires_from_now;
+    return *this;
+}
+
+auto up_stream::stream::spinning_patience::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "stream-spinning-patience",
+        up::invoke_to_insight_with_fallback(_expires_at),
+        up::invoke_to_insight_with_fallback(_max_budget),
+        up::invoke_to_insight_with_fallback(_budget),
+        up::invoke_to_insight_with_fallback(_spun),
+        up::invoke_to_insight_with_fallback(_slept));
+}
+
+void up_stream::stream::spinning_patience::_wait(native_handle handle, operation op)
+{
+    auto start = up::steady_clock::now();
+    auto spin_until = std::min(start + _budget, _expires_at);
+    for (auto now = start; now < spin_until; now = up::steady_clock::now()) {
+        // zero timeout, i.e. the thread is never put to sleep
+        if (do_poll_until(op, handle, now)) {
+            ++_spun;
+            return;
+        }
+    }
+    if (_expires_at == up::steady_time_point::max()) {
+        do_poll(op, handle);
+    } else if (!do_poll_until(op, handle, _expires_at)) {
+        throw up::make_exception("stream-spinning-patience-timeout", timeout())
+            .with(op, _expires_at);
+    }
+    ++_slept;
+    if (up::steady_clock::now() - start <= _max_budget) {
+        _budget = std::min(_budget * 2, _max_budget);
+    } else {
+        // the minimum keeps the budget adaptable
+        _budget = std::max(_budget / 2, _max_budget / 64);
+    }
+}
+
+
+auto up_stream::stream::engine::try_send_file(native_handle file, off_t offset, std::size_t size) const -> status
+{
+    /* The buffer is small enough for the stacks of fibers, and it fits into
+     * a single TLS record. Only the written part is consumed, i.e. if the
+     * write would block, the data is read again by the next call. */
+    char buffer[1 << 14];
+    ssize_t rv;
+    do {
+        rv = ::pread(up::to_underlying_type(file), buffer, std::min(size, sizeof(buffer)), offset);
+    } while (rv == -1 && errno == EINTR);
+    if (rv == -1) {
+        throw up::make_exception("stream-send-file-read-error").with(file, offset, size, up::errno_info(errno));
+    } else if (rv == 0) {
+        return 0;
+    }
+    return try_write_some({buffer, std::size_t(rv)});
+}
+
+void up_stream::stream::engine::shutdown() const
+{
+    try_shutdown().get();
+}
+
+auto up_stream::stream::engine::read_some(up::chunk::into chunk) const -> std::size_t
+{
+    return try_read_some(std::move(chunk)).get();
+}
+
+auto up_stream::stream::engine::write_some(up::chunk::from chunk) const -> std::size_t
+{
+    return try_write_some(std::move(chunk)).get();
+}
+
+auto up_stream::stream::engine::read_some_bulk(up::chunk::into_bulk_t& chunks) const -> std::size_t
+{
+    return try_read_some_bulk(chunks).get();
+}
+
+auto up_stream::stream::engine::write_some_bulk(up::chunk::from_bulk_t& chunks) const -> std::size_t
+{
+    return try_write_some_bulk(chunks).get();
+}
+
 void up_stream::stream::engine::_vtable_dummy() const { }
+
+
+void up_stream::stream::engine::status::_raise() const
+{
+    if (_kind == kind::unreadable) {
+        throw up::make_exception("unreadable-stream-engine", unreadable());
+    } else if (_kind == kind::unwritable) {
+        throw up::make_exception("unwritable-stream-engine", unwritable());
+    } else {
+        throw up::make_exception("unexpected-stream-engine-status")
+            .with(up::to_underlying_type(_kind), _count);
+    }
+}
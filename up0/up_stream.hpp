@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 #include "up_chrono.hpp"
 #include "up_chunk.hpp"
+#include "up_fs_fwd.hpp"
 #include "up_impl_ptr.hpp"
+#include "up_insight.hpp"
 #include "up_swap.hpp"
 #include "up_utility.hpp"
 
@@ -20,9 +25,12 @@ namespace up_stream
         class steady_patience;
         class deadline_patience;
         class infinite_patience;
+        class spinning_patience;
         class engine;
+        class counters;
     private: // --- state ---
         std::unique_ptr<engine> _engine;
+        std::shared_ptr<counters> _counters; // optional
     public: // --- life ---
         explicit stream(std::unique_ptr<engine> engine);
         stream(const self& rhs) = delete;
@@ -34,11 +42,20 @@ namespace up_stream
         void swap(self& rhs) noexcept
         {
             up::swap_noexcept(_engine, rhs._engine);
+            up::swap_noexcept(_counters, rhs._counters);
         }
         friend void swap(self& lhs, self& rhs) noexcept
         {
             lhs.swap(rhs);
         }
+        /* Attaches counters to the stream (or detaches them with nullptr).
+         * The same counters can be shared by several streams of the same
+         * thread, e.g. to aggregate them per listener. */
+        void set_counters(std::shared_ptr<counters> counters)
+        {
+            _counters = std::move(counters);
+        }
+        auto get_counters() const -> const std::shared_ptr<counters>& { return _counters; }
         void shutdown(patience& patience) const;
         void shutdown(patience&& patience) const
         {
@@ -79,6 +96,23 @@ namespace up_stream
         {
             write_all(std::move(chunks), patience);
         }
+        /* Sends length bytes of the file starting at offset (e.g. static
+         * content). Plain TCP connections use sendfile, so that the data does
+         * not pass through user space. Other engines (e.g. TLS) copy it
+         * through a small buffer. Raises an exception if the file ends
+         * before. */
+        void send_file(const up::fs::file& file, off_t offset, std::size_t length, patience& patience) const;
+        void send_file(const up::fs::file& file, off_t offset, std::size_t length, patience&& patience) const
+        {
+            send_file(file, offset, length, patience);
+        }
+        /* Non-blocking variants, which never invoke a patience. They are
+         * intended for event-driven code, which waits for the native handle
+         * by itself. They return engine::status (deduced, because the engine
+         * is still incomplete at this point). */
+        inline auto try_read_some(up::chunk::into chunk) const;
+        inline auto try_write_some(up::chunk::from chunk) const;
+        auto get_native_handle() const -> native_handle;
         void upgrade(std::function<std::unique_ptr<engine>(std::unique_ptr<engine>)> transform);
         void downgrade(patience& patience);
         void downgrade(patience&& patience)
@@ -87,7 +121,10 @@ namespace up_stream
         }
     protected:
         auto get_underlying_engine() const -> const engine*;
+        // true if the engine has been replaced by upgrade (e.g. with TLS)
+        bool is_upgraded() const;
     private:
+        auto _checked_engine() const -> const engine&;
         // classes with vtables should have at least one out-of-line virtual method definition
         __attribute__((unused))
         virtual void _vtable_dummy() const;
@@ -114,6 +151,10 @@ namespace up_stream
 
     auto to_string(stream::patience::operation op) -> up::unique_string;
 
+    // raised by graceful_close, if there is still data to read
+    [[noreturn]]
+    void stream_graceful_close_error(stream::native_handle handle);
+
 
     class stream::steady_patience final : public stream::patience
     {
@@ -138,6 +179,12 @@ namespace up_stream
     };
 
 
+    /**
+     * Steady deadlines are plain time points. Arming and re-arming them
+     * requires neither a syscall nor a file descriptor, and each wait is a
+     * single ppoll with a relative timeout. Only deadlines for the system
+     * clock use a timerfd, so that they follow adjustments of the clock.
+     */
     class stream::deadline_patience final : public stream::patience
     {
     public: // --- scope ---
@@ -145,7 +192,8 @@ namespace up_stream
         class impl;
         static void destroy(impl* ptr);
     private: // --- state ---
-        up::impl_ptr<impl, destroy> _impl;
+        up::steady_time_point _expires_at; // max if none (or system clock)
+        up::impl_ptr<impl, destroy> _impl; // only for the system clock
     public: // --- life ---
         explicit deadline_patience();
         explicit deadline_patience(const up::system_time_point& expires_at);
@@ -162,6 +210,7 @@ namespace up_stream
         auto operator=(const up::duration& expires_from_now) & -> self&;
         void swap(self& rhs) noexcept
         {
+            up::swap_noexcept(_expires_at, rhs._expires_at);
             up::swap_noexcept(_impl, rhs._impl);
         }
         friend void swap(self& lhs, self& rhs) noexcept
@@ -192,12 +241,81 @@ namespace up_stream
     };
 
 
+    /**
+     * Patience for latency-critical connections, that polls the handle
+     * without sleeping (zero timeout) for a budget, before it falls back to
+     * a blocking wait. This avoids the cost of putting the thread to sleep
+     * and waking it up again, at the expense of a busy core. It can be
+     * combined with busy polling of the socket (see
+     * tcp::connection::busy_poll).
+     *
+     * The budget adapts to the traffic: It is doubled, whenever a blocking
+     * wait has finished within the maximal budget (i.e. spinning longer
+     * would have succeeded), and it is halved, whenever a blocking wait has
+     * taken longer. The patience is intended for a single connection, and
+     * it can be reused for all operations on it (re-arm the deadline with
+     * assignment).
+     */
+    class stream::spinning_patience final : public stream::patience
+    {
+    public: // --- scope ---
+        using self = spinning_patience;
+    private: // --- state ---
+        up::steady_time_point _expires_at; // max if none
+        up::duration _max_budget;
+        up::duration _budget;
+        uint64_t _spun = 0; // waits finished by spinning
+        uint64_t _slept = 0; // waits finished by blocking
+    public: // --- life ---
+        // without deadline
+        explicit spinning_patience(const up::duration& max_budget = std::chrono::microseconds(50));
+        explicit spinning_patience(const up::steady_time_point& expires_at,
+            const up::duration& max_budget = std::chrono::microseconds(50));
+        spinning_patience(const self& rhs) = delete;
+        spinning_patience(self&& rhs) noexcept = default;
+        ~spinning_patience() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        auto operator=(const up::steady_time_point& expires_at) & -> self&;
+        auto operator=(const up::duration& expires_from_now) & -> self&;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_expires_at, rhs._expires_at);
+            up::swap_noexcept(_max_budget, rhs._max_budget);
+            up::swap_noexcept(_budget, rhs._budget);
+            up::swap_noexcept(_spun, rhs._spun);
+            up::swap_noexcept(_slept, rhs._slept);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        auto budget() const -> up::duration { return _budget; }
+        auto spun() const -> uint64_t { return _spun; }
+        auto slept() const -> uint64_t { return _slept; }
+    private:
+        void _wait(native_handle handle, operation op) override;
+    };
+
+
+    /**
+     * The I/O operations of the engine are non-blocking. If an operation can
+     * not make progress, it returns a status indicating that the caller has
+     * to wait until the native handle becomes readable or writable. Would
+     * block conditions are frequent on non-blocking sockets, so they are
+     * intentionally not signaled with exceptions. The member functions
+     * without the try_ prefix are thin wrappers, which throw unreadable or
+     * unwritable instead.
+     */
     class stream::engine
     {
     public: // --- scope ---
         using self = engine;
         struct unreadable { };
         struct unwritable { };
+        class status;
     public: // --- life ---
         virtual ~engine() noexcept = default;
     protected:
@@ -205,15 +323,25 @@ namespace up_stream
         engine(const self& rhs) = default;
         engine(self&& rhs) noexcept = default;
     public: // --- operations ---
-        virtual void shutdown() const = 0;
+        virtual auto try_shutdown() const -> status = 0;
         virtual void hard_close() const = 0; // hard close, not graceful
-        virtual auto read_some(up::chunk::into chunk) const -> std::size_t = 0;
-        virtual auto write_some(up::chunk::from chunk) const -> std::size_t = 0;
-        virtual auto read_some_bulk(up::chunk::into_bulk_t& chunks) const -> std::size_t = 0;
-        virtual auto write_some_bulk(up::chunk::from_bulk_t& chunks) const -> std::size_t = 0;
+        virtual auto try_read_some(up::chunk::into chunk) const -> status = 0;
+        virtual auto try_write_some(up::chunk::from chunk) const -> status = 0;
+        virtual auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status = 0;
+        virtual auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status = 0;
+        /* Sends a range of the given file (zero means end-of-file). The default
+         * implementation reads the range into a buffer and writes it with
+         * try_write_some. */
+        virtual auto try_send_file(native_handle file, off_t offset, std::size_t size) const -> status;
+        // throws unreadable or unwritable (rarely used, so no status)
         virtual auto downgrade() -> std::unique_ptr<engine> = 0;
         virtual auto get_underlying_engine() const -> const engine* = 0;
         virtual auto get_native_handle() const -> native_handle = 0;
+        void shutdown() const;
+        auto read_some(up::chunk::into chunk) const -> std::size_t;
+        auto write_some(up::chunk::from chunk) const -> std::size_t;
+        auto read_some_bulk(up::chunk::into_bulk_t& chunks) const -> std::size_t;
+        auto write_some_bulk(up::chunk::from_bulk_t& chunks) const -> std::size_t;
     protected:
         auto operator=(const self& rhs) & -> self& = default;
         auto operator=(self&& rhs) & noexcept -> self& = default;
@@ -223,11 +351,308 @@ namespace up_stream
         virtual void _vtable_dummy() const;
     };
 
+
+    /**
+     * Result of the non-blocking engine operations: Either the operation has
+     * been completed and has transferred count() bytes (zero means
+     * end-of-stream for read operations), or it would block on the given
+     * operation. The class is small and trivially copyable, so that it can be
+     * returned in registers.
+     */
+    class stream::engine::status final
+    {
+    public: // --- scope ---
+        using self = status;
+        enum class kind : uint8_t { done, unreadable, unwritable, };
+        static constexpr auto would_block(patience::operation op) noexcept -> self
+        {
+            return self(op == patience::operation::read ? kind::unreadable : kind::unwritable);
+        }
+    private: // --- state ---
+        std::size_t _count;
+        kind _kind;
+    public: // --- life ---
+        // implicit (the operation has been completed)
+        constexpr status(std::size_t count) noexcept
+            : _count(count), _kind(kind::done)
+        { }
+        constexpr explicit status(kind kind) noexcept
+            : _count(0), _kind(kind)
+        { }
+    public: // --- operations ---
+        auto get_kind() const noexcept { return _kind; }
+        bool done() const noexcept { return _kind == kind::done; }
+        auto count() const noexcept { return _count; }
+        // only valid if not done
+        auto blocked_on() const noexcept
+        {
+            return _kind == kind::unreadable ? patience::operation::read : patience::operation::write;
+        }
+        // throws unreadable or unwritable if the operation would block
+        auto get() const -> std::size_t
+        {
+            if (_kind == kind::done) {
+                return _count;
+            } else {
+                _raise();
+            }
+        }
+    private:
+        [[noreturn]]
+        void _raise() const;
+    };
+
+
+    /**
+     * I/O counters of streams: transferred bytes, engine calls and would
+     * block conditions (per direction of the operation), and the time spent
+     * waiting in patiences. The counters have a single writer (the thread
+     * using the streams), so they are updated without atomic
+     * read-modify-write operations. They can be read from any thread (e.g.
+     * by a metrics exporter), and the values are eventually consistent.
+     * Streams without counters only pay for a null check. Shutdowns are
+     * not counted.
+     */
+    class stream::counters final
+    {
+    public: // --- scope ---
+        using self = counters;
+        using operation = patience::operation;
+        using status = engine::status;
+    private: // --- state ---
+        std::atomic<uint64_t> _bytes[2] = { };
+        std::atomic<uint64_t> _calls[2] = { };
+        std::atomic<uint64_t> _would_block[2] = { };
+        std::atomic<up::duration::rep> _wait_time{0};
+    public: // --- life ---
+        explicit counters() = default;
+        counters(const self& rhs) = delete;
+        counters(self&& rhs) noexcept = delete;
+        ~counters() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto to_insight() const -> up::insight;
+        auto bytes(operation op) const -> uint64_t
+        {
+            return _bytes[_index(op)].load(std::memory_order_relaxed);
+        }
+        auto calls(operation op) const -> uint64_t
+        {
+            return _calls[_index(op)].load(std::memory_order_relaxed);
+        }
+        auto would_block(operation op) const -> uint64_t
+        {
+            return _would_block[_index(op)].load(std::memory_order_relaxed);
+        }
+        auto wait_time() const -> up::duration
+        {
+            return up::duration(_wait_time.load(std::memory_order_relaxed));
+        }
+        void record(operation op, const status& status) noexcept
+        {
+            auto i = _index(op);
+            _add(_calls[i], 1);
+            if (status.done()) {
+                _add(_bytes[i], status.count());
+            } else {
+                _add(_would_block[i], 1);
+            }
+        }
+        void record_wait(const up::duration& duration) noexcept
+        {
+            _add(_wait_time, duration.count());
+        }
+    private:
+        static auto _index(operation op) noexcept -> std::size_t
+        {
+            return op == operation::read ? 0 : 1;
+        }
+        template <typename Type>
+        static void _add(std::atomic<Type>& counter, std::common_type_t<Type> value) noexcept
+        {
+            // single writer: no need for an atomic read-modify-write operation
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+    };
+
+
+    inline auto stream::try_read_some(up::chunk::into chunk) const
+    {
+        auto status = _checked_engine().try_read_some(chunk);
+        if (_counters) {
+            _counters->record(patience::operation::read, status);
+        }
+        return status;
+    }
+
+    inline auto stream::try_write_some(up::chunk::from chunk) const
+    {
+        auto status = _checked_engine().try_write_some(chunk);
+        if (_counters) {
+            _counters->record(patience::operation::write, status);
+        }
+        return status;
+    }
+
+
+    /**
+     * Stream with an engine type known at compile time. The engine is stored
+     * by value, so there is neither a check for a missing engine nor an
+     * indirect call on the hot path, and the engine operations can be
+     * inlined. The engine has to provide the try_ operations, hard_close and
+     * get_native_handle of stream::engine. If it is derived from
+     * stream::engine, it should be final, so that the compiler can
+     * devirtualize the calls.
+     *
+     * Use up::stream instead, if the engine has to be replaced at runtime
+     * (i.e. upgrade and downgrade). The engine can be moved out with release
+     * for that purpose.
+     */
+    template <typename Engine>
+    class basic_stream final
+    {
+    public: // --- scope ---
+        using self = basic_stream;
+        using engine_type = Engine;
+        using native_handle = stream::native_handle;
+        using patience = stream::patience;
+        using status = stream::engine::status;
+    private: // --- state ---
+        Engine _engine;
+    public: // --- life ---
+        explicit basic_stream()
+            : _engine()
+        { }
+        // forwards to the engine (but never hijacks copies and moves)
+        template <typename Arg, typename... Args,
+            typename = std::enable_if_t<!std::is_same<std::decay_t<Arg>, self>::value>>
+        explicit basic_stream(Arg&& arg, Args&&... args)
+            : _engine(std::forward<Arg>(arg), std::forward<Args>(args)...)
+        { }
+        basic_stream(const self& rhs) = delete;
+        basic_stream(self&& rhs) noexcept = default;
+        ~basic_stream() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_engine, rhs._engine);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto get_engine() const -> const Engine& { return _engine; }
+        auto release() && -> Engine { return std::move(_engine); }
+        void shutdown(patience& patience) const
+        {
+            _blocking(patience, [&] { return _engine.try_shutdown(); });
+        }
+        void shutdown(patience&& patience) const
+        {
+            shutdown(patience);
+        }
+        void graceful_close(patience& patience) const
+        {
+            shutdown(patience);
+            char c;
+            if (read_some(up::chunk::into{&c, 1}, patience)) {
+                stream_graceful_close_error(get_native_handle());
+            }
+            _engine.hard_close();
+        }
+        void graceful_close(patience&& patience) const
+        {
+            graceful_close(patience);
+        }
+        auto read_some(up::chunk::into chunk, patience& patience) const -> std::size_t
+        {
+            return _blocking(patience, [&] { return _engine.try_read_some(chunk); });
+        }
+        auto read_some(up::chunk::into chunk, patience&& patience) const -> std::size_t
+        {
+            return read_some(std::move(chunk), patience);
+        }
+        auto write_some(up::chunk::from chunk, patience& patience) const -> std::size_t
+        {
+            return _blocking(patience, [&] { return _engine.try_write_some(chunk); });
+        }
+        auto write_some(up::chunk::from chunk, patience&& patience) const -> std::size_t
+        {
+            return write_some(std::move(chunk), patience);
+        }
+        auto read_some(up::chunk::into_bulk_t&& chunks, patience& patience) const -> std::size_t
+        {
+            return _blocking(patience, [&] { return _engine.try_read_some_bulk(chunks); });
+        }
+        auto read_some(up::chunk::into_bulk_t&& chunks, patience&& patience) const -> std::size_t
+        {
+            return read_some(std::move(chunks), patience);
+        }
+        auto write_some(up::chunk::from_bulk_t&& chunks, patience& patience) const -> std::size_t
+        {
+            return _blocking(patience, [&] { return _engine.try_write_some_bulk(chunks); });
+        }
+        auto write_some(up::chunk::from_bulk_t&& chunks, patience&& patience) const -> std::size_t
+        {
+            return write_some(std::move(chunks), patience);
+        }
+        void write_all(up::chunk::from chunk, patience& patience) const
+        {
+            // see stream::write_all
+            do {
+                chunk.drain(write_some(chunk, patience));
+            } while (chunk.size());
+        }
+        void write_all(up::chunk::from chunk, patience&& patience) const
+        {
+            write_all(std::move(chunk), patience);
+        }
+        void write_all(up::chunk::from_bulk_t&& chunks, patience& patience) const
+        {
+            do {
+                chunks.drain(_blocking(patience, [&] { return _engine.try_write_some_bulk(chunks); }));
+            } while (chunks.total());
+        }
+        void write_all(up::chunk::from_bulk_t&& chunks, patience&& patience) const
+        {
+            write_all(std::move(chunks), patience);
+        }
+        auto try_read_some(up::chunk::into chunk) const -> status
+        {
+            return _engine.try_read_some(chunk);
+        }
+        auto try_write_some(up::chunk::from chunk) const -> status
+        {
+            return _engine.try_write_some(chunk);
+        }
+        auto get_native_handle() const -> native_handle
+        {
+            return _engine.get_native_handle();
+        }
+    private:
+        template <typename Operation>
+        auto _blocking(patience& patience, Operation&& operation) const -> std::size_t
+        {
+            for (;;) {
+                status status = operation();
+                if (status.done()) {
+                    return status.count();
+                } else {
+                    patience(_engine.get_native_handle(), status.blocked_on());
+                }
+            }
+        }
+    };
+
 }
 
 namespace up
 {
 
     using up_stream::stream;
+    using up_stream::basic_stream;
 
 }
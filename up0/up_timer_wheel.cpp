@@ -0,0 +1,257 @@
+#include "up_timer_wheel.hpp"
+
+#include <array>
+
+#include "up_exception.hpp"
+#include "up_ints.hpp"
+
+
+namespace
+{
+
+    const constexpr std::size_t bits = 6;
+    const constexpr std::size_t slots = std::size_t(1) << bits;
+    const constexpr std::size_t levels = 5;
+
+    // first tick, that does not fit into the given level
+    constexpr auto level_limit(std::size_t level) -> uint64_t
+    {
+        return uint64_t(1) << (bits * (level + 1));
+    }
+
+}
+
+
+class up_timer_wheel::timer_wheel::impl final
+{
+public: // --- scope ---
+    using self = impl;
+private: // --- state ---
+    up::duration _resolution;
+    up::steady_time_point _origin;
+    uint64_t _current = 0; // ticks since origin (already processed)
+    std::size_t _size = 0;
+    std::array<std::size_t, levels> _counts = { };
+    std::array<std::array<timer*, slots>, levels> _slots = { };
+public: // --- life ---
+    explicit impl(const up::duration& resolution)
+        : _resolution(resolution), _origin(up::steady_clock::now())
+    {
+        if (_resolution <= up::duration::zero()) {
+            throw up::make_exception("invalid-timer-wheel-resolution").with(_resolution);
+        }
+    }
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        for (auto&& level : _slots) {
+            for (auto&& head : level) {
+                while (head) {
+                    _unlink(*head);
+                }
+            }
+        }
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "timer-wheel-impl",
+            up::invoke_to_insight_with_fallback(_resolution),
+            up::invoke_to_insight_with_fallback(_current),
+            up::invoke_to_insight_with_fallback(_size));
+    }
+    auto size() const { return _size; }
+    void arm(timer& timer, const up::steady_time_point& expires_at)
+    {
+        if (timer._wheel) {
+            _unlink(timer);
+        }
+        timer._expires_at = expires_at;
+        auto offset = expires_at - _origin;
+        uint64_t tick = 0;
+        if (offset > up::duration::zero()) {
+            // round up, so that the timer never fires early
+            auto q = offset / _resolution;
+            tick = up::ints::cast<uint64_t>(offset % _resolution == up::duration::zero() ? q : q + 1);
+        }
+        timer._tick = std::max(tick, _current + 1);
+        _link(timer);
+    }
+    void cancel(timer& timer) noexcept
+    {
+        _unlink(timer);
+    }
+    auto next_expiry() const -> up::steady_time_point
+    {
+        if (_size == 0) {
+            return up::steady_time_point::max();
+        }
+        uint64_t result = std::numeric_limits<uint64_t>::max();
+        for (std::size_t level = 0; level != levels; ++level) {
+            if (_counts[level] == 0) {
+                continue;
+            }
+            auto shift = bits * level;
+            auto base = _current >> shift;
+            for (uint64_t i = 1; i <= slots; ++i) {
+                if (_slots[level][(base + i) % slots]) {
+                    // tick at which the slot is processed
+                    result = std::min(result, (base + i) << shift);
+                    break;
+                }
+            }
+        }
+        return _origin + _resolution * up::ints::cast<up::duration::rep>(result);
+    }
+    auto advance(const up::steady_time_point& now) -> std::size_t
+    {
+        if (now <= _origin) {
+            return 0;
+        }
+        auto target = up::ints::cast<uint64_t>((now - _origin) / _resolution);
+        std::size_t result = 0;
+        while (_current < target) {
+            if (_size == 0) {
+                _current = target;
+                break;
+            }
+            /* Skip all ticks, where nothing can happen. That is up to the
+             * next cascade of the lowest non-empty level. */
+            std::size_t level = 0;
+            while (_counts[level] == 0) {
+                ++level;
+            }
+            auto step = uint64_t(1) << (bits * level);
+            _current = std::min(target, (_current / step + 1) * step);
+            result += _process();
+        }
+        return result;
+    }
+private:
+    void _link(timer& timer)
+    {
+        auto delta = timer._tick - _current;
+        std::size_t level = 0;
+        while (level + 1 != levels && delta >= level_limit(level)) {
+            ++level;
+        }
+        auto tick = timer._tick;
+        if (delta >= level_limit(levels - 1)) {
+            // beyond the range of the wheel (cascaded again later)
+            tick = _current + level_limit(levels - 1) - 1;
+        }
+        auto& head = _slots[level][(tick >> (bits * level)) % slots];
+        timer._wheel = this;
+        timer._level = level;
+        timer._next = head;
+        timer._pprev = &head;
+        if (head) {
+            head->_pprev = &timer._next;
+        }
+        head = &timer;
+        ++_counts[level];
+        ++_size;
+    }
+    void _unlink(timer& timer) noexcept
+    {
+        if (timer._wheel) {
+            *timer._pprev = timer._next;
+            if (timer._next) {
+                timer._next->_pprev = timer._pprev;
+            }
+            timer._wheel = nullptr;
+            timer._next = nullptr;
+            timer._pprev = nullptr;
+            --_counts[timer._level];
+            --_size;
+        }
+    }
+    // cascades the higher levels and fires the current slot
+    auto _process() -> std::size_t
+    {
+        for (std::size_t level = levels - 1; level != 0; --level) {
+            auto shift = bits * level;
+            if ((_current & ((uint64_t(1) << shift) - 1)) == 0) {
+                auto& head = _slots[level][(_current >> shift) % slots];
+                while (head) {
+                    auto& timer = *head;
+                    _unlink(timer);
+                    _link(timer);
+                }
+            }
+        }
+        std::size_t result = 0;
+        auto& head = _slots[0][_current % slots];
+        while (head) {
+            auto& timer = *head;
+            _unlink(timer);
+            if (timer._tick <= _current) {
+                ++result;
+                timer._callback();
+            } else {
+                _link(timer);
+            }
+        }
+        return result;
+    }
+};
+
+
+void up_timer_wheel::timer_wheel::destroy(impl* ptr)
+{
+    std::default_delete<impl>()(ptr);
+}
+
+up_timer_wheel::timer_wheel::timer_wheel(const up::duration& resolution)
+    : _impl(up::impl_make(resolution))
+{ }
+
+auto up_timer_wheel::timer_wheel::to_insight() const -> up::insight
+{
+    return _impl->to_insight();
+}
+
+auto up_timer_wheel::timer_wheel::size() const -> std::size_t
+{
+    return _impl->size();
+}
+
+auto up_timer_wheel::timer_wheel::next_expiry() const -> up::steady_time_point
+{
+    return _impl->next_expiry();
+}
+
+auto up_timer_wheel::timer_wheel::advance(const up::steady_time_point& now) -> std::size_t
+{
+    return _impl->advance(now);
+}
+
+
+up_timer_wheel::timer_wheel::timer::timer(callback callback)
+    : _callback(std::move(callback))
+{ }
+
+auto up_timer_wheel::timer_wheel::timer::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "timer-wheel-timer",
+        up::invoke_to_insight_with_fallback(armed()),
+        up::invoke_to_insight_with_fallback(_expires_at));
+}
+
+void up_timer_wheel::timer_wheel::timer::arm(timer_wheel& wheel, const up::steady_time_point& expires_at)
+{
+    if (_wheel && _wheel != wheel._impl.get()) {
+        _wheel->cancel(*this);
+    }
+    wheel._impl->arm(*this, expires_at);
+}
+
+void up_timer_wheel::timer_wheel::timer::cancel() noexcept
+{
+    if (_wheel) {
+        _wheel->cancel(*this);
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <functional>
+
+#include "up_chrono.hpp"
+#include "up_impl_ptr.hpp"
+#include "up_insight.hpp"
+#include "up_swap.hpp"
+
+namespace up_timer_wheel
+{
+
+    /**
+     * Hierarchical timer wheel for a large number of deadlines, e.g. for
+     * the idle expiry of many connections. Timers are intrusive, so that
+     * arming, re-arming and cancelling are O(1) operations without any
+     * allocation or syscall. The wheel has five levels with 64 slots each.
+     * Timers are moved to lower levels while the wheel advances, and they
+     * are never fired before their deadline (but up to one resolution
+     * later).
+     *
+     * The wheel does not wait by itself. The owner has to call advance
+     * regularly, and it can use next_expiry to determine the timeout of its
+     * wait operation. The wheel is owned by its user (e.g. the reactor
+     * provides one with reactor::timers), and it is not thread-safe.
+     */
+    class timer_wheel final
+    {
+    public: // --- scope ---
+        using self = timer_wheel;
+        class impl;
+        class timer;
+        static void destroy(impl* ptr);
+    private: // --- state ---
+        up::impl_ptr<impl, destroy> _impl;
+    public: // --- life ---
+        explicit timer_wheel(const up::duration& resolution = std::chrono::milliseconds(1));
+        timer_wheel(const self& rhs) = delete;
+        timer_wheel(self&& rhs) noexcept = default;
+        ~timer_wheel() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        // number of armed timers
+        auto size() const -> std::size_t;
+        bool empty() const { return size() == 0; }
+        /* Returns the time point, at which advance should be invoked next.
+         * It is at most one resolution after the earliest deadline. It might
+         * be earlier, because timers on higher levels have to be moved down
+         * in time. Returns max if there are no timers. */
+        auto next_expiry() const -> up::steady_time_point;
+        /* Fires all timers, whose deadlines have been reached. The timers
+         * are disarmed before their callbacks are invoked, so that the
+         * callbacks can re-arm them. Returns the number of fired timers. */
+        auto advance(const up::steady_time_point& now) -> std::size_t;
+    };
+
+
+    /**
+     * The timer must not be moved, while it is armed. It is automatically
+     * cancelled by its destructor. A timer, that is still armed when its
+     * wheel is destroyed, is silently disarmed.
+     */
+    class timer_wheel::timer final
+    {
+    public: // --- scope ---
+        using self = timer;
+        using callback = std::function<void()>;
+        friend timer_wheel::impl;
+    private: // --- state ---
+        impl* _wheel = nullptr;
+        timer* _next = nullptr;
+        timer** _pprev = nullptr;
+        uint64_t _tick = 0;
+        std::size_t _level = 0;
+        up::steady_time_point _expires_at;
+        callback _callback;
+    public: // --- life ---
+        explicit timer(callback callback);
+        timer(const self& rhs) = delete;
+        timer(self&& rhs) noexcept = delete;
+        ~timer() noexcept
+        {
+            cancel();
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto to_insight() const -> up::insight;
+        // re-arms the timer if it is already armed
+        void arm(timer_wheel& wheel, const up::steady_time_point& expires_at);
+        void cancel() noexcept;
+        bool armed() const noexcept { return _wheel; }
+        auto expires_at() const -> const up::steady_time_point& { return _expires_at; }
+    };
+
+}
+
+namespace up
+{
+
+    using up_timer_wheel::timer_wheel;
+
+}
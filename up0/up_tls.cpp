@@ -217,19 +217,29 @@ namespace
     public: // --- scope ---
         static BIO_METHOD methods;
     private:
+        static int _handle_status(BIO* bio, up::stream::engine::status status)
+        {
+            using kind = up::stream::engine::status::kind;
+            switch (status.get_kind()) {
+            case kind::done:
+                return up::ints::caster(status.count());
+            case kind::unreadable:
+                ::BIO_set_retry_read(bio);
+                return -1;
+            case kind::unwritable:
+                ::BIO_set_retry_write(bio);
+                return -1;
+            }
+            throw up::make_exception("tls-bio-unexpected-status")
+                .with(up::to_underlying_type(status.get_kind()));
+        }
         static int _bwrite(BIO* bio, const char* data, int size)
         {
             using engine = up::stream::engine;
             engine* stream = static_cast<engine*>(bio->ptr);
             try {
                 ::BIO_clear_retry_flags(bio);
-                return up::ints::caster(stream->write_some({data, up::ints::caster(size)}));
-            } catch (const engine::unreadable&) {
-                ::BIO_set_retry_read(bio);
-                return -1;
-            } catch (const engine::unwritable&) {
-                ::BIO_set_retry_write(bio);
-                return -1;
+                return _handle_status(bio, stream->try_write_some({data, up::ints::caster(size)}));
             } catch (...) {
                 up::suppress_current_exception("tls-bio-write-callback");
                 return -1;
@@ -241,13 +251,7 @@ namespace
             engine* stream = static_cast<engine*>(bio->ptr);
             try {
                 ::BIO_clear_retry_flags(bio);
-                return up::ints::caster(stream->read_some({data, up::ints::caster(size)}));
-            } catch (const engine::unreadable&) {
-                ::BIO_set_retry_read(bio);
-                return -1;
-            } catch (const engine::unwritable&) {
-                ::BIO_set_retry_write(bio);
-                return -1;
+                return _handle_status(bio, stream->try_read_some({data, up::ints::caster(size)}));
             } catch (...) {
                 up::suppress_current_exception("tls-bio-read-callback");
                 return -1;
@@ -424,23 +428,26 @@ namespace
         }
         ~base_engine() noexcept = default;
     private: // --- operations ---
-        void shutdown() const override final
+        auto try_shutdown() const -> status override final
         {
             try {
                 sentry sentry(this, state::shutdown_in_progress);
-                _graceful_shutdown();
+                auto result = _graceful_shutdown();
+                if (!result.done()) {
+                    return result;
+                }
             } catch (const already_shutdown&) {
                 /* Nothing, i.e. simulate the behavior of a regular socket
                  * that has been uni-directionally shutdown. */
             }
-            _underlying->shutdown();
+            return _underlying->try_shutdown();
         }
         void hard_close() const override final
         {
             _state = state::bad;
             _underlying->hard_close();
         }
-        auto read_some(up::chunk::into chunk) const -> std::size_t override final
+        auto try_read_some(up::chunk::into chunk) const -> status override final
         {
             try {
                 sentry sentry(this, state::read_in_progress);
@@ -453,29 +460,29 @@ namespace
                 return 0;
             }
         }
-        auto write_some(up::chunk::from chunk) const -> std::size_t override final
+        auto try_write_some(up::chunk::from chunk) const -> status override final
         {
             sentry sentry(this, state::write_in_progress);
             openssl_thread::instance();
             return _handle_io_result(
                 ::SSL_write(_ssl.get(), chunk.data(), up::ints::caster(chunk.size())), false);
         }
-        auto read_some_bulk(up::chunk::into_bulk_t& chunks) const -> std::size_t override final
+        auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status override final
         {
             /* Unfortunately, OpenSSL has no support for multiple buffers. So,
              * we only process the first non-empty buffer. */
-            return read_some(chunks.head());
+            return try_read_some(chunks.head());
         }
-        auto write_some_bulk(up::chunk::from_bulk_t& chunks) const -> std::size_t override final
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status override final
         {
             /* Unfortunately, OpenSSL has no support for multiple buffers. So,
              * we only process the first non-empty buffer. */
-            return write_some(chunks.head());
+            return try_write_some(chunks.head());
         }
         auto downgrade() -> std::unique_ptr<up::stream::engine> override final
         {
             sentry sentry(this, state::shutdown_in_progress);
-            _graceful_shutdown();
+            _graceful_shutdown().get();
             return std::move(_underlying);
         }
         auto get_underlying_engine() const -> const engine* override final
@@ -486,7 +493,7 @@ namespace
         {
             return _underlying->get_native_handle();
         }
-        void _graceful_shutdown() const
+        auto _graceful_shutdown() const -> status
         {
             openssl_thread::instance();
             for (;;) {
@@ -500,9 +507,9 @@ namespace
                 } else if (result < 0) {
                     auto error = ::SSL_get_error(_ssl.get(), result);
                     if (error == SSL_ERROR_WANT_READ) {
-                        throw up::make_exception("unreadable-tls-stream", unreadable());
+                        return status::would_block(patience::operation::read);
                     } else if (error == SSL_ERROR_WANT_WRITE) {
-                        throw up::make_exception("unwritable-tls-stream", unwritable());
+                        return status::would_block(patience::operation::write);
                     } else if (error == SSL_ERROR_SYSCALL && errno == 0) {
                         /* According to the OpenSSL documentation, an
                          * erroneous SSL_ERROR_SYSCALL may be flagged even
@@ -518,13 +525,14 @@ namespace
                 }
             }
             _state = state::shutdown_completed;
+            return 0;
         }
-        auto _handle_io_result(int result, bool allow_shutdown) const -> std::size_t
+        auto _handle_io_result(int result, bool allow_shutdown) const -> status
         {
             auto error = ::SSL_get_error(_ssl.get(), result);
             if (result > 0) {
                 _state = state::good;
-                return up::ints::caster(std::make_unsigned_t<decltype(result)>(result));
+                return up::ints::cast<std::size_t>(result);
             } else if (allow_shutdown && result == 0 && error == SSL_ERROR_ZERO_RETURN) {
                 /* Clean ssl shutdown; however, note that the socket might
                  * still be open. */
@@ -537,9 +545,9 @@ namespace
                 _state = state::shutdown_completed;
                 return 0;
             } else if (result < 0 && error == SSL_ERROR_WANT_READ) {
-                throw up::make_exception("unreadable-tls-stream", unreadable());
+                return status::would_block(patience::operation::read);
             } else if (result < 0 && error == SSL_ERROR_WANT_WRITE) {
-                throw up::make_exception("unwritable-tls-stream", unwritable());
+                return status::would_block(patience::operation::write);
             } else {
                 _state = state::bad;
                 raise_ssl_error("tls-io-error", result, error);
@@ -0,0 +1,777 @@
+#include "up_uring.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "up_chrono.hpp"
+#include "up_exception.hpp"
+#include "up_ints.hpp"
+#include "up_terminate.hpp"
+
+/*
+ * The implementation uses the raw syscalls and the shared memory layout from
+ * the kernel headers. It intentionally does not depend on liburing. Only
+ * features up to Linux 5.6 are used.
+ */
+
+namespace
+{
+
+    void close_aux(int& fd)
+    {
+        if (fd != -1) {
+            int temp = std::exchange(fd, -1);
+            int rv = ::close(temp);
+            if (rv != 0) {
+                up::terminate("bad-close", temp);
+            }
+        } // else: nothing
+    }
+
+    auto syscall_io_uring_setup(unsigned entries, io_uring_params* params)
+    {
+        return ::syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    auto syscall_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    auto syscall_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+    {
+        return ::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+    }
+
+
+    // shared or anonymous memory mapping
+    class mapping final
+    {
+    private: // --- scope ---
+        using self = mapping;
+    private: // --- state ---
+        void* _base = nullptr;
+        std::size_t _size = 0;
+    public: // --- life ---
+        explicit mapping() = default;
+        explicit mapping(int fd, off_t offset, std::size_t size)
+        {
+            int flags = fd == -1 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE;
+            _base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+            if (_base == MAP_FAILED) {
+                _base = nullptr;
+                throw up::make_exception("uring-mmap-error")
+                    .with(fd, offset, size, up::errno_info(errno));
+            }
+            _size = size;
+        }
+        mapping(const self& rhs) = delete;
+        mapping(self&& rhs) noexcept
+            : _base(std::exchange(rhs._base, nullptr)), _size(std::exchange(rhs._size, 0))
+        { }
+        ~mapping() noexcept
+        {
+            if (_base && ::munmap(_base, _size) != 0) {
+                up::terminate("uring-munmap-error", _size);
+            }
+        }
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self&
+        {
+            mapping temp(std::move(rhs));
+            std::swap(_base, temp._base);
+            std::swap(_size, temp._size);
+            return *this;
+        }
+        template <typename Type>
+        auto at(std::size_t offset) const
+        {
+            return reinterpret_cast<Type*>(static_cast<char*>(_base) + offset);
+        }
+        auto size() const { return _size; }
+    };
+
+
+    // the lowest two bits of user_data identify the operation
+    enum class tag : uint64_t { read = 0, write = 1, cancel = 2, };
+
+    auto make_user_data(std::size_t index, tag tag) -> uint64_t
+    {
+        return (uint64_t(index) << 2) | up::to_underlying_type(tag);
+    }
+
+    // the ring is only used if all required operations are supported
+    bool probe_operations(int fd)
+    {
+        constexpr std::size_t ops = 256;
+        std::vector<uint64_t> buffer(
+            (sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall_io_uring_register(fd, IORING_REGISTER_PROBE, probe, ops) != 0) {
+            // not supported before Linux 5.6
+            return false;
+        }
+        for (auto op : {IORING_OP_READ_FIXED, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_ASYNC_CANCEL}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // upper bound for the completion of pending writes on a graceful release
+    constexpr auto release_timeout = std::chrono::milliseconds(100);
+
+    auto next_power_of_two(std::size_t value)
+    {
+        std::size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+}
+
+
+class up_uring::uring::impl final
+{
+public: // --- scope ---
+    using self = impl;
+    using status = channel::status;
+    enum class state : uint8_t { idle, pending, ready, };
+    class slot final
+    {
+    public: // --- state ---
+        int _fd = -1;
+        int _wait_fd = -1; // duplicate of the ring (see channel)
+        bool _used = false;
+        bool _released = false;
+        std::size_t _in_flight = 0;
+        state _read = state::idle;
+        int _read_result = 0;
+        std::size_t _read_offset = 0;
+        bool _write_pending = false;
+        std::size_t _write_offset = 0;
+        std::size_t _write_size = 0;
+        int _write_error = 0;
+    };
+public: // --- state ---
+    int _fd;
+    std::size_t _batch_size;
+    std::size_t _buffer_size;
+    mapping _sq_ring;
+    mapping _cq_ring; // empty if both rings share a single mapping
+    mapping _sqe_array;
+    mapping _buffers;
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned _sq_mask;
+    unsigned _sq_entries;
+    unsigned _sq_local_tail;
+    io_uring_sqe* _sqes;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned _cq_mask;
+    io_uring_cqe* _cqes;
+    std::size_t _unsubmitted = 0;
+    bool _registered_buffers = false;
+    bool _fixed_files = false;
+    std::vector<slot> _slots;
+    std::vector<std::size_t> _free;
+public: // --- life ---
+    explicit impl(int fd, const io_uring_params& params, std::size_t batch_size, std::size_t channels, std::size_t buffer_size);
+    impl(const self& rhs) = delete;
+    impl(self&& rhs) noexcept = delete;
+    ~impl() noexcept
+    {
+        close_aux(_fd);
+    }
+public: // --- operations ---
+    auto operator=(const self& rhs) & -> self& = delete;
+    auto operator=(self&& rhs) & noexcept -> self& = delete;
+    auto to_insight() const -> up::insight
+    {
+        return up::insight(typeid(*this), "uring-impl",
+            up::invoke_to_insight_with_fallback(_fd),
+            up::invoke_to_insight_with_fallback(_batch_size),
+            up::invoke_to_insight_with_fallback(_buffer_size),
+            up::invoke_to_insight_with_fallback(_slots.size()),
+            up::invoke_to_insight_with_fallback(_free.size()),
+            up::invoke_to_insight_with_fallback(_registered_buffers),
+            up::invoke_to_insight_with_fallback(_fixed_files));
+    }
+    auto submit() -> std::size_t;
+    auto open(int fd) -> std::size_t; // returns size of _slots if exhausted
+    void release(std::size_t index, bool graceful);
+    auto try_read(std::size_t index, const iovec* iov, std::size_t count) -> status;
+    auto try_write(std::size_t index, const iovec* iov, std::size_t count) -> status;
+    auto try_flush(std::size_t index) -> status;
+private:
+    auto _checked(std::size_t index) -> slot&;
+    auto _read_buffer(std::size_t index) const -> char*
+    {
+        return _buffers.at<char>(index * 2 * _buffer_size);
+    }
+    auto _write_buffer(std::size_t index) const -> char*
+    {
+        return _buffers.at<char>((index * 2 + 1) * _buffer_size);
+    }
+    auto _get_sqe() -> io_uring_sqe*;
+    void _push(io_uring_sqe* sqe, std::size_t index, tag tag);
+    void _queue_read(std::size_t index);
+    void _queue_write(std::size_t index);
+    void _queue_cancel(std::size_t index, tag tag);
+    void _update_file(std::size_t index, int fd);
+    void _reap();
+    // returns false on timeout
+    bool _wait(const up::steady_time_point& deadline);
+    void _complete(std::size_t index, tag tag, int result);
+};
+
+
+up_uring::uring::impl::impl(int fd, const io_uring_params& params, std::size_t batch_size, std::size_t channels, std::size_t buffer_size)
+    : _fd(fd), _batch_size(std::max<std::size_t>(batch_size, 1)), _buffer_size(buffer_size)
+{
+    try {
+        std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        std::size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            _sq_ring = mapping(_fd, IORING_OFF_SQ_RING, std::max(sq_size, cq_size));
+        } else {
+            _sq_ring = mapping(_fd, IORING_OFF_SQ_RING, sq_size);
+            _cq_ring = mapping(_fd, IORING_OFF_CQ_RING, cq_size);
+        }
+        auto&& cq_ring = _cq_ring.size() ? _cq_ring : _sq_ring;
+        _sqe_array = mapping(_fd, IORING_OFF_SQES, params.sq_entries * sizeof(io_uring_sqe));
+        _sq_head = _sq_ring.at<unsigned>(params.sq_off.head);
+        _sq_tail = _sq_ring.at<unsigned>(params.sq_off.tail);
+        _sq_mask = *_sq_ring.at<unsigned>(params.sq_off.ring_mask);
+        _sq_entries = *_sq_ring.at<unsigned>(params.sq_off.ring_entries);
+        _sq_local_tail = *_sq_tail;
+        _sqes = _sqe_array.at<io_uring_sqe>(0);
+        // the submission entries are always used in order
+        auto array = _sq_ring.at<unsigned>(params.sq_off.array);
+        for (unsigned i = 0; i != _sq_entries; ++i) {
+            array[i] = i;
+        }
+        _cq_head = cq_ring.at<unsigned>(params.cq_off.head);
+        _cq_tail = cq_ring.at<unsigned>(params.cq_off.tail);
+        _cq_mask = *cq_ring.at<unsigned>(params.cq_off.ring_mask);
+        _cqes = cq_ring.at<io_uring_cqe>(params.cq_off.cqes);
+        _buffers = mapping(-1, 0, channels * 2 * _buffer_size);
+        /* Both registrations are optional. Registered buffers are pinned and
+         * count against RLIMIT_MEMLOCK, and sparse file tables are not
+         * supported by all kernels. */
+        iovec iov = { _buffers.at<void>(0), _buffers.size() };
+        _registered_buffers = syscall_io_uring_register(_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+        std::vector<int> fds(channels, -1);
+        _fixed_files = syscall_io_uring_register(_fd, IORING_REGISTER_FILES, fds.data(), up::ints::cast<unsigned>(channels)) == 0;
+        _slots.resize(channels);
+        _free.reserve(channels);
+        for (std::size_t i = channels; i != 0; --i) {
+            _free.push_back(i - 1);
+        }
+    } catch (...) {
+        close_aux(_fd);
+        throw;
+    }
+}
+
+auto up_uring::uring::impl::submit() -> std::size_t
+{
+    std::size_t result = 0;
+    while (_unsubmitted) {
+        auto rv = syscall_io_uring_enter(_fd, up::ints::cast<unsigned>(_unsubmitted), 0, 0);
+        if (rv > 0) {
+            auto n = up::ints::cast<std::size_t>(rv);
+            _unsubmitted -= n;
+            result += n;
+        } else if (rv == -1 && errno == EINTR) {
+            // restart
+        } else {
+            throw up::make_exception("uring-submit-error")
+                .with(_unsubmitted, up::errno_info(errno));
+        }
+    }
+    return result;
+}
+
+auto up_uring::uring::impl::open(int fd) -> std::size_t
+{
+    if (_free.empty()) {
+        return _slots.size();
+    }
+    auto index = _free.back();
+    /* Each channel has its own handle for waiting, so that several channels
+     * can be waited for at the same time (e.g. by fibers of a reactor). */
+    int wait_fd = ::fcntl(_fd, F_DUPFD_CLOEXEC, 0);
+    if (wait_fd == -1) {
+        throw up::make_exception("uring-dup-error").with(index, up::errno_info(errno));
+    }
+    if (_fixed_files) {
+        try {
+            _update_file(index, fd);
+        } catch (...) {
+            close_aux(wait_fd);
+            throw;
+        }
+    }
+    _free.pop_back();
+    auto& slot = _slots[index];
+    slot = impl::slot();
+    slot._fd = fd;
+    slot._wait_fd = wait_fd;
+    slot._used = true;
+    return index;
+}
+
+void up_uring::uring::impl::release(std::size_t index, bool graceful)
+{
+    auto& slot = _slots[index];
+    if (slot._released) {
+        return;
+    }
+    if (graceful) {
+        /* The written data has already been accepted by the channel, so it
+         * should not be lost (e.g. if the connection is closed afterwards).
+         * However, the peer might not read at all, so the wait is bounded,
+         * and the remaining write is cancelled afterwards. Errors can no
+         * longer be reported, and they are ignored. */
+        auto deadline = up::steady_clock::now() + release_timeout;
+        for (;;) {
+            submit();
+            _reap();
+            if (!slot._write_pending || !_wait(deadline)) {
+                break;
+            }
+        }
+    }
+    slot._released = true;
+    close_aux(slot._wait_fd);
+    if (slot._read == state::pending) {
+        _queue_cancel(index, tag::read);
+    }
+    if (slot._write_pending) {
+        _queue_cancel(index, tag::write);
+    }
+    if (_fixed_files) {
+        _update_file(index, -1);
+    }
+    submit();
+    if (slot._in_flight == 0) {
+        slot = impl::slot();
+        _free.push_back(index);
+    } // else: recycled by _complete
+}
+
+auto up_uring::uring::impl::try_read(std::size_t index, const iovec* iov, std::size_t count) -> status
+{
+    auto& slot = _checked(index);
+    std::size_t total = 0;
+    for (std::size_t i = 0; i != count; ++i) {
+        total += iov[i].iov_len;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    /* The first pass queues a read if necessary and submits the queue. The
+     * kernel often completes reads from sockets during the submission, so
+     * that the second pass can return the data without any further wait. */
+    for (std::size_t pass = 0; ; ++pass) {
+        _reap();
+        if (slot._read == state::ready) {
+            if (slot._read_result < 0) {
+                int error = -slot._read_result;
+                slot._read = state::idle;
+                if (error != EAGAIN && error != EINTR) {
+                    throw up::make_exception("uring-channel-read-error")
+                        .with(index, total, up::errno_info(error));
+                }
+            } else if (slot._read_result == 0) {
+                // end-of-stream (sticky)
+                return 0;
+            } else {
+                auto available = up::ints::cast<std::size_t>(slot._read_result) - slot._read_offset;
+                auto source = _read_buffer(index) + slot._read_offset;
+                std::size_t result = 0;
+                for (std::size_t i = 0; i != count && result != available; ++i) {
+                    auto n = std::min(iov[i].iov_len, available - result);
+                    std::memcpy(iov[i].iov_base, source + result, n);
+                    result += n;
+                }
+                slot._read_offset += result;
+                if (slot._read_offset == up::ints::cast<std::size_t>(slot._read_result)) {
+                    slot._read = state::idle;
+                }
+                return result;
+            }
+        }
+        if (slot._read == state::idle) {
+            _queue_read(index);
+        }
+        if (pass) {
+            return status::would_block(up::stream::patience::operation::read);
+        }
+        submit();
+    }
+}
+
+auto up_uring::uring::impl::try_write(std::size_t index, const iovec* iov, std::size_t count) -> status
+{
+    auto& slot = _checked(index);
+    for (std::size_t pass = 0; ; ++pass) {
+        _reap();
+        if (slot._write_error) {
+            int error = std::exchange(slot._write_error, 0);
+            throw up::make_exception("uring-channel-write-error")
+                .with(index, up::errno_info(error));
+        } else if (!slot._write_pending) {
+            auto target = _write_buffer(index);
+            std::size_t result = 0;
+            for (std::size_t i = 0; i != count && result != _buffer_size; ++i) {
+                auto n = std::min(iov[i].iov_len, _buffer_size - result);
+                std::memcpy(target + result, iov[i].iov_base, n);
+                result += n;
+            }
+            if (result) {
+                slot._write_offset = 0;
+                slot._write_size = result;
+                _queue_write(index);
+            }
+            return result;
+        } else if (pass) {
+            // see header regarding the operation
+            return status::would_block(up::stream::patience::operation::read);
+        } else {
+            submit();
+        }
+    }
+}
+
+auto up_uring::uring::impl::try_flush(std::size_t index) -> status
+{
+    auto& slot = _checked(index);
+    for (std::size_t pass = 0; ; ++pass) {
+        _reap();
+        if (slot._write_error) {
+            int error = std::exchange(slot._write_error, 0);
+            throw up::make_exception("uring-channel-write-error")
+                .with(index, up::errno_info(error));
+        } else if (!slot._write_pending) {
+            return 0;
+        } else if (pass) {
+            return status::would_block(up::stream::patience::operation::read);
+        } else {
+            submit();
+        }
+    }
+}
+
+auto up_uring::uring::impl::_checked(std::size_t index) -> slot&
+{
+    auto& slot = _slots[index];
+    if (slot._released) {
+        throw up::make_exception("uring-channel-released").with(index);
+    }
+    return slot;
+}
+
+auto up_uring::uring::impl::_get_sqe() -> io_uring_sqe*
+{
+    if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries) {
+        submit();
+        if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries) {
+            throw up::make_exception("uring-submission-queue-overflow").with(_sq_entries);
+        }
+    }
+    auto sqe = &_sqes[_sq_local_tail & _sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void up_uring::uring::impl::_push(io_uring_sqe* sqe, std::size_t index, tag tag)
+{
+    sqe->user_data = make_user_data(index, tag);
+    if (tag != tag::cancel) {
+        if (_fixed_files) {
+            sqe->fd = up::ints::cast<int>(index);
+            sqe->flags |= IOSQE_FIXED_FILE;
+        } else {
+            sqe->fd = _slots[index]._fd;
+        }
+        ++_slots[index]._in_flight;
+    } else {
+        sqe->fd = -1;
+    }
+    __atomic_store_n(_sq_tail, ++_sq_local_tail, __ATOMIC_RELEASE);
+    if (++_unsubmitted >= _batch_size) {
+        submit();
+    }
+}
+
+void up_uring::uring::impl::_queue_read(std::size_t index)
+{
+    auto sqe = _get_sqe();
+    if (_registered_buffers) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+    }
+    sqe->addr = reinterpret_cast<uintptr_t>(_read_buffer(index));
+    sqe->len = up::ints::cast<uint32_t>(_buffer_size);
+    _slots[index]._read = state::pending;
+    _push(sqe, index, tag::read);
+}
+
+void up_uring::uring::impl::_queue_write(std::size_t index)
+{
+    /* Note: IORING_OP_WRITE_FIXED would use the registered buffer. However,
+     * it does not support MSG_NOSIGNAL, i.e. it might raise SIGPIPE. */
+    auto& slot = _slots[index];
+    auto sqe = _get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->addr = reinterpret_cast<uintptr_t>(_write_buffer(index) + slot._write_offset);
+    sqe->len = up::ints::cast<uint32_t>(slot._write_size - slot._write_offset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    slot._write_pending = true;
+    _push(sqe, index, tag::write);
+}
+
+void up_uring::uring::impl::_queue_cancel(std::size_t index, tag tag)
+{
+    auto sqe = _get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = make_user_data(index, tag);
+    _push(sqe, index, tag::cancel);
+}
+
+void up_uring::uring::impl::_update_file(std::size_t index, int fd)
+{
+    io_uring_files_update update;
+    std::memset(&update, 0, sizeof(update));
+    update.offset = up::ints::cast<uint32_t>(index);
+    update.fds = reinterpret_cast<uintptr_t>(&fd);
+    auto rv = syscall_io_uring_register(_fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+    if (rv != 1) {
+        throw up::make_exception("uring-file-update-error")
+            .with(index, fd, up::errno_info(errno));
+    }
+}
+
+void up_uring::uring::impl::_reap()
+{
+    unsigned head = *_cq_head;
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        auto&& cqe = _cqes[head & _cq_mask];
+        auto index = up::ints::cast<std::size_t>(cqe.user_data >> 2);
+        auto kind = tag(cqe.user_data & 3);
+        if (kind != tag::cancel) {
+            _complete(index, kind, cqe.res);
+        }
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+bool up_uring::uring::impl::_wait(const up::steady_time_point& deadline)
+{
+    // io_uring_enter supports timeouts only since Linux 5.11
+    for (;;) {
+        auto remaining = deadline - up::steady_clock::now();
+        if (remaining <= up::duration::zero()) {
+            return false;
+        }
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+        pollfd fds = { _fd, POLLIN, 0 };
+        auto rv = ::poll(&fds, 1, up::ints::cast<int>(ms));
+        if (rv > 0) {
+            return true;
+        } else if (rv == -1 && errno != EINTR) {
+            throw up::make_exception("uring-wait-error").with(up::errno_info(errno));
+        } // else: timeout or interrupted (checked by the next iteration)
+    }
+}
+
+void up_uring::uring::impl::_complete(std::size_t index, tag tag, int result)
+{
+    auto& slot = _slots[index];
+    --slot._in_flight;
+    if (tag == tag::read) {
+        slot._read = state::ready;
+        slot._read_result = result;
+        slot._read_offset = 0;
+    } else if (result <= 0) {
+        slot._write_pending = false;
+        slot._write_error = result == 0 ? EPIPE : -result;
+    } else {
+        slot._write_offset += up::ints::cast<std::size_t>(result);
+        if (slot._write_offset != slot._write_size && !slot._released) {
+            _queue_write(index);
+        } else {
+            slot._write_pending = false;
+        }
+    }
+    if (slot._released && slot._in_flight == 0) {
+        slot = impl::slot();
+        _free.push_back(index);
+    }
+}
+
+
+up_uring::uring::uring(std::size_t batch_size, std::size_t channels, std::size_t buffer_size)
+    : _impl()
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    // each channel has at most two operations and two cancellations in flight
+    auto entries = up::ints::cast<unsigned>(next_power_of_two(std::max<std::size_t>(channels * 4, 8)));
+    auto rv = syscall_io_uring_setup(entries, &params);
+    if (rv == -1) {
+        if (errno == ENOSYS || errno == EPERM || errno == EINVAL) {
+            /* Not supported or disabled (unavailable). Kernels before 5.6
+             * reject IORING_SETUP_CLAMP with EINVAL. */
+            return;
+        }
+        throw up::make_exception("uring-setup-error")
+            .with(entries, up::errno_info(errno));
+    }
+    int fd = up::ints::cast<int>(rv);
+    bool supported = false;
+    try {
+        supported = probe_operations(fd);
+    } catch (...) {
+        close_aux(fd);
+        throw;
+    }
+    if (!supported) {
+        close_aux(fd);
+        return;
+    }
+    _impl = std::make_shared<impl>(fd, params, batch_size, channels, buffer_size);
+}
+
+auto up_uring::uring::to_insight() const -> up::insight
+{
+    if (_impl) {
+        return _impl->to_insight();
+    } else {
+        return up::insight(typeid(*this), "uring-unavailable");
+    }
+}
+
+bool up_uring::uring::available() const
+{
+    return bool(_impl);
+}
+
+auto up_uring::uring::get_batch_size() const -> std::size_t
+{
+    return _impl ? _impl->_batch_size : 1;
+}
+
+void up_uring::uring::set_batch_size(std::size_t batch_size)
+{
+    if (_impl) {
+        _impl->_batch_size = std::max<std::size_t>(batch_size, 1);
+        if (_impl->_unsubmitted >= _impl->_batch_size) {
+            _impl->submit();
+        }
+    }
+}
+
+auto up_uring::uring::submit() -> std::size_t
+{
+    return _impl ? _impl->submit() : 0;
+}
+
+auto up_uring::uring::open(up::stream::native_handle handle) -> std::unique_ptr<channel>
+{
+    if (!_impl) {
+        return nullptr;
+    }
+    auto index = _impl->open(up::to_underlying_type(handle));
+    if (index == _impl->_slots.size()) {
+        return nullptr;
+    }
+    return std::make_unique<channel>(_impl, index);
+}
+
+
+up_uring::uring::channel::channel(std::shared_ptr<impl> impl, std::size_t index)
+    : _impl(std::move(impl)), _index(index)
+{ }
+
+up_uring::uring::channel::~channel() noexcept
+{
+    release();
+}
+
+auto up_uring::uring::channel::to_insight() const -> up::insight
+{
+    return up::insight(typeid(*this), "uring-channel",
+        up::invoke_to_insight_with_fallback(*_impl),
+        up::invoke_to_insight_with_fallback(_index));
+}
+
+auto up_uring::uring::channel::try_read_some(up::chunk::into chunk) const -> status
+{
+    iovec iov = { chunk.data(), chunk.size() };
+    return _impl->try_read(_index, &iov, 1);
+}
+
+auto up_uring::uring::channel::try_write_some(up::chunk::from chunk) const -> status
+{
+    iovec iov = { const_cast<char*>(chunk.data()), chunk.size() };
+    return _impl->try_write(_index, &iov, 1);
+}
+
+auto up_uring::uring::channel::try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status
+{
+    return _impl->try_read(_index, chunks.as<iovec>(), chunks.count());
+}
+
+auto up_uring::uring::channel::try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status
+{
+    return _impl->try_write(_index, chunks.as<iovec>(), chunks.count());
+}
+
+auto up_uring::uring::channel::try_flush() const -> status
+{
+    return _impl->try_flush(_index);
+}
+
+void up_uring::uring::channel::flush(up::stream::patience& patience) const
+{
+    for (;;) {
+        auto status = try_flush();
+        if (status.done()) {
+            return;
+        }
+        patience(get_native_handle(), status.blocked_on());
+    }
+}
+
+void up_uring::uring::channel::release(bool graceful) const noexcept
+{
+    try {
+        _impl->release(_index, graceful);
+    } catch (...) {
+        up::terminate("uring-channel-release-error", _index);
+    }
+}
+
+auto up_uring::uring::channel::get_native_handle() const -> up::stream::native_handle
+{
+    return up::stream::native_handle(_impl->_slots[_index]._wait_fd);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "up_stream.hpp"
+#include "up_swap.hpp"
+
+namespace up_uring
+{
+
+    /**
+     * Submission and completion rings of io_uring, shared by the channels of
+     * many connections on the same thread. The ring uses a set of registered
+     * buffers (two per channel) and a sparse table of fixed files. If the
+     * kernel does not support io_uring (or if it is disabled), the ring is
+     * unavailable and open returns nullptr. In this case, connections use the
+     * regular (epoll compatible) path with one syscall per operation. The
+     * same applies to kernels before Linux 5.6, which lack the required
+     * operations.
+     *
+     * Submissions are batched: Queued entries are submitted with a single
+     * syscall if the batch size is reached, or if an operation is about to
+     * block. Completions are reaped from shared memory without any syscall.
+     * With a batch size larger than one, writes might remain queued until
+     * then. That means the application has to call submit before it waits
+     * for other events.
+     *
+     * The ring is not thread-safe. All channels of a ring must be used from
+     * the same thread.
+     */
+    class uring final
+    {
+    public: // --- scope ---
+        using self = uring;
+        class impl;
+        class channel;
+    private: // --- state ---
+        std::shared_ptr<impl> _impl;
+    public: // --- life ---
+        explicit uring(std::size_t batch_size = 1, std::size_t channels = 128, std::size_t buffer_size = 1 << 14);
+        uring(const self& rhs) = delete;
+        uring(self&& rhs) noexcept = default;
+        ~uring() noexcept = default;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = default;
+        void swap(self& rhs) noexcept
+        {
+            up::swap_noexcept(_impl, rhs._impl);
+        }
+        friend void swap(self& lhs, self& rhs) noexcept
+        {
+            lhs.swap(rhs);
+        }
+        auto to_insight() const -> up::insight;
+        bool available() const;
+        auto get_batch_size() const -> std::size_t;
+        void set_batch_size(std::size_t batch_size);
+        // returns the number of submitted entries
+        auto submit() -> std::size_t;
+        /* Returns nullptr if the ring is unavailable or if all channels are
+         * in use. The native handle is not owned by the channel, and it must
+         * remain open until the channel has been released. */
+        auto open(up::stream::native_handle handle) -> std::unique_ptr<channel>;
+    };
+
+
+    /**
+     * Non-blocking transfer operations through the ring for a single native
+     * handle, with the same semantics as the operations of stream::engine.
+     * Reads are submitted when no received data is available. Writes are
+     * copied to the send buffer of the channel, and they are completed in the
+     * background (errors are raised from the next operation).
+     *
+     * The native handle for waiting is a duplicate of the ring, i.e. each
+     * channel has its own handle, and several channels can be waited for at
+     * the same time (e.g. by fibers of the same reactor). It becomes
+     * readable when there are completions for any channel of the ring. For
+     * this reason, all would block conditions are reported as read, even
+     * for writes, and a waiting channel might be woken up spuriously.
+     */
+    class uring::channel final
+    {
+    public: // --- scope ---
+        using self = channel;
+        using status = up::stream::engine::status;
+    private: // --- state ---
+        std::shared_ptr<impl> _impl;
+        std::size_t _index;
+    public: // --- life ---
+        explicit channel(std::shared_ptr<impl> impl, std::size_t index);
+        channel(const self& rhs) = delete;
+        channel(self&& rhs) noexcept = delete;
+        ~channel() noexcept;
+    public: // --- operations ---
+        auto operator=(const self& rhs) & -> self& = delete;
+        auto operator=(self&& rhs) & noexcept -> self& = delete;
+        auto to_insight() const -> up::insight;
+        auto try_read_some(up::chunk::into chunk) const -> status;
+        auto try_write_some(up::chunk::from chunk) const -> status;
+        auto try_read_some_bulk(up::chunk::into_bulk_t& chunks) const -> status;
+        auto try_write_some_bulk(up::chunk::from_bulk_t& chunks) const -> status;
+        // waits until all written data has been passed to the kernel
+        auto try_flush() const -> status;
+        void flush(up::stream::patience& patience) const;
+        void flush(up::stream::patience&& patience) const
+        {
+            flush(patience);
+        }
+        /* Cancels pending operations and drops the fixed file, so that the
+         * native handle can be closed. A graceful release waits briefly (at
+         * most 100ms) for the pending writes, and it cancels them
+         * afterwards. Implicitly called by the destructor (graceful). So the
+         * written data should be flushed explicitly before, e.g. with
+         * stream::shutdown. */
+        void release(bool graceful = true) const noexcept;
+        auto get_native_handle() const -> up::stream::native_handle;
+    };
+
+}
+
+namespace up
+{
+
+    using up_uring::uring;
+
+}